@@ -11,7 +11,7 @@ cd .data
 cp ../../../../build/reaper_osara.dylib .
 cp ../../../../config/mac/reaper-kb.ini OSARA.ReaperKeyMap
 mkdir locale
-cp ../../../../locale/*.po locale/
+cp ../../../../locale/*.po ../../../../locale/*.cat locale/
 cd ../..
 rm -f $dmg
 # We seem to need a delay here to avoid an "hdiutil: create failed - Resource busy" error.
@@ -0,0 +1,151 @@
+# OSARA: Open Source Accessibility for the REAPER Application
+# Utility to compile translations (po) into binary catalogs
+# Copyright 2026 OSARA contributors
+# License: GNU General Public License version 2.0
+
+# The catalog format is read by src/translation.cpp. All integers are 32 bit
+# little endian. The file consists of:
+# 1. A header: magic ("OSCT"), version, size of the source po file, pool
+# offset of the Plural-Forms header (or NO_OFFSET), entry count, bucket count,
+# then the file offsets of the buckets, entries and string pool and the size of
+# the pool. OSARA treats the catalog as stale if the po file's size differs or
+# the po file is newer than the catalog.
+# 2. The buckets: a hash table using linear probing. Each bucket contains an
+# entry index + 1, or 0 if empty. The bucket count is a power of 2.
+# 3. The entries: key hash, pool offset of the key, number of translated
+# forms, pool offset of the first form. The key is the msgid, prefixed with
+# the msgctxt and "\x04" if there is a context. Forms are consecutive.
+# 4. The string pool: null terminated UTF-8 strings.
+# Fuzzy entries are included, since tinygettext (used when there is no usable
+# catalog) includes them too.
+
+import struct
+
+MAGIC = b"OSCT"
+VERSION = 2
+NO_OFFSET = 0xFFFFFFFF
+HEADER_FORMAT = "<4s9I"
+ENTRY_FORMAT = "<4I"
+CONTEXT_SEPARATOR = "\x04"
+
+def fnv1a(data):
+	h = 0x811C9DC5
+	for b in data:
+		h ^= b
+		h = (h * 0x01000193) & 0xFFFFFFFF
+	return h
+
+def unescape(s):
+	out = []
+	i = 0
+	while i < len(s):
+		c = s[i]
+		if c == "\\" and i + 1 < len(s):
+			i += 1
+			c = {"n": "\n", "t": "\t", "r": "\r", '"': '"', "\\": "\\"}.get(s[i], s[i])
+		out.append(c)
+		i += 1
+	return "".join(out)
+
+def parsePo(text):
+	"""Returns a list of (context, msgid, [msgstr, ...]), including the header.
+	"""
+	entries = []
+	entry = {}
+	field = None
+
+	def finish():
+		nonlocal entry, field
+		if "msgid" in entry:
+			forms = [entry[k] for k in sorted(k for k in entry if isinstance(k, int))]
+			entries.append((entry.get("msgctxt"), entry["msgid"], forms))
+		entry = {}
+		field = None
+
+	for line in text.splitlines():
+		line = line.strip()
+		if not line:
+			continue
+		if line.startswith("#"):
+			continue
+		if line.startswith('"'):
+			if field is None:
+				raise RuntimeError("Unexpected string: %s" % line)
+			entry[field] += unescape(line[1:-1])
+			continue
+		keyword, value = line.split(" ", 1)
+		value = unescape(value.strip()[1:-1])
+		if keyword == "msgctxt" or (keyword == "msgid" and "msgid" in entry):
+			finish()
+		if keyword.startswith("msgstr["):
+			field = int(keyword[7:-1])
+		elif keyword == "msgstr":
+			field = 0
+		else:
+			field = keyword
+		entry[field] = value
+	finish()
+	return entries
+
+def compileCatalog(poData):
+	header = None
+	entries = []
+	for context, msgid, forms in parsePo(poData.decode("UTF-8")):
+		if not msgid:
+			header = forms[0] if forms else ""
+			continue
+		if not any(forms):
+			# Untranslated, so the caller will fall back to the source string.
+			continue
+		key = context + CONTEXT_SEPARATOR + msgid if context else msgid
+		entries.append((key, forms))
+
+	pool = bytearray()
+	def addString(s):
+		offset = len(pool)
+		pool.extend(s.encode("UTF-8"))
+		pool.append(0)
+		return offset
+
+	pluralForms = NO_OFFSET
+	for line in (header or "").splitlines():
+		if line.startswith("Plural-Forms:"):
+			pluralForms = addString(line)
+	entryData = []
+	for key, forms in entries:
+		keyBytes = key.encode("UTF-8")
+		keyOffset = addString(key)
+		formsOffset = len(pool)
+		for form in forms:
+			addString(form)
+		entryData.append((fnv1a(keyBytes), keyOffset, len(forms), formsOffset))
+
+	bucketCount = 1
+	# Keep the load factor below 0.5 so probes stay short.
+	while bucketCount < len(entryData) * 2:
+		bucketCount *= 2
+	buckets = [0] * bucketCount
+	for index, (h, _, _, _) in enumerate(entryData):
+		b = h & (bucketCount - 1)
+		while buckets[b]:
+			b = (b + 1) & (bucketCount - 1)
+		buckets[b] = index + 1
+
+	headerSize = struct.calcsize(HEADER_FORMAT)
+	bucketsOffset = headerSize
+	entriesOffset = bucketsOffset + bucketCount * 4
+	poolOffset = entriesOffset + len(entryData) * struct.calcsize(ENTRY_FORMAT)
+	out = bytearray(struct.pack(HEADER_FORMAT, MAGIC, VERSION, len(poData),
+		pluralForms, len(entryData), bucketCount, bucketsOffset,
+		entriesOffset, poolOffset, len(pool)))
+	out.extend(struct.pack("<%dI" % bucketCount, *buckets))
+	for e in entryData:
+		out.extend(struct.pack(ENTRY_FORMAT, *e))
+	out.extend(pool)
+	return bytes(out)
+
+def makeCatalog(target, source, env):
+	with open(source[0].path, "rb") as inp:
+		poData = inp.read()
+	with open(target[0].path, "wb") as out:
+		out.write(compileCatalog(poData))
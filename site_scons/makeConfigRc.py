@@ -13,12 +13,8 @@ def makeConfigRc(target, source, env):
 		if line.startswith("#define ID_CONFIG_DLG "):
 			cid = int(line.strip().rsplit(" ")[-1])
 			break
-	out.write(
-"""#include <windows.h>
-{cid} DIALOGEX 250, 125, 185, 212
-	CAPTION "OSARA Configuration"
-BEGIN
-""".format(cid=cid))
+	dialogId = cid
+	controls = []
 	y = 6
 	settingsH = open(source[1].path, "rt", encoding="UTF-8")
 	setting = None
@@ -33,10 +29,18 @@ BEGIN
 			continue # Setting is split across multiple lines.
 		m = RE_BOOL_SETTING.match(setting)
 		cid += 1
-		out.write(
+		controls.append(
 			'\tCONTROL {displayName}, {cid}, "Button", BS_AUTOCHECKBOX | WS_TABSTOP, 10, {y}, 200, 14\n'
 			.format(displayName=m.group("displayName"), cid=cid, y=y))
 		y += 20
+	# Size the dialog to fit all of the settings plus the buttons.
+	out.write(
+"""#include <windows.h>
+{cid} DIALOGEX 250, 125, 185, {height}
+	CAPTION "OSARA Configuration"
+BEGIN
+""".format(cid=dialogId, height=max(212, y + 20)))
+	out.writelines(controls)
 	out.write('\tDEFPUSHBUTTON "OK", IDOK, 10, {y}, 30, 14\n'
 		'\tPUSHBUTTON "Cancel", IDCANCEL, 137, {y}, 40, 14\n'
 		.format(y=y))
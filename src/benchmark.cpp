@@ -0,0 +1,455 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Offline benchmark program
+ * Copyright 2026 OSARA contributors
+ * License: GNU General Public License version 2.0
+ */
+
+// This is a standalone program, not part of the plugin. It links OSARA's index
+// modules (itemIndex, markerIndex, trackStates, trackTable, fxTree and
+// tempoMap) against a fake REAPER API backed by a synthetic project, so the
+// results don't depend on REAPER and can be reproduced and compared between
+// builds. Build it with scons benchmarks=1.
+// The fake API functions are cheap, so the results measure OSARA's own lookup
+// costs rather than REAPER's.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#define REAPERAPI_IMPLEMENT
+#include "osara.h"
+#include "fxTree.h"
+#include "itemIndex.h"
+#include "markerIndex.h"
+#include "tempoMap.h"
+#include "trackStates.h"
+#include "trackTable.h"
+
+using namespace std;
+
+// The size of the synthetic project. This is roughly the size of the largest
+// projects users have reported performance problems with.
+const int BENCH_TRACKS = 600;
+const int BENCH_ITEMS_PER_TRACK = 20;
+const int BENCH_FX_PER_TRACK = 8;
+const int BENCH_MARKERS = 500;
+const int BENCH_REGIONS = 100;
+// Each item is this long and is followed by a gap of the same length.
+const double BENCH_ITEM_LENGTH = 1.0;
+const double BENCH_PROJECT_LENGTH = BENCH_ITEMS_PER_TRACK * BENCH_ITEM_LENGTH *
+	2;
+// The project has a constant tempo of 120 bpm in 4/4.
+const double BENCH_TEMPO = 120;
+const int BENCH_TIME_SIG_NUM = 4;
+const int BENCH_TIME_SIG_DENOM = 4;
+
+// The fake REAPER API. MediaTrack and MediaItem are opaque to OSARA, so we
+// hand out pointers to our own structures instead.
+namespace fakeReaper {
+
+struct Item {
+	double position;
+	double length;
+};
+
+struct Track {
+	int number;
+	bool muted;
+	vector<Item> items;
+	vector<string> fx;
+};
+
+struct Marker {
+	bool isRegion;
+	double start;
+	double end;
+	int number;
+};
+
+vector<Track> tracks;
+Track master;
+vector<Marker> markers;
+int stateCount = 1;
+// The project pointer only needs to be stable.
+int project;
+
+Track* asTrack(MediaTrack* track) {
+	return (Track*)track;
+}
+
+void build() {
+	tracks.resize(BENCH_TRACKS);
+	for (int t = 0; t < BENCH_TRACKS; ++t) {
+		Track& track = tracks[t];
+		track.number = t + 1;
+		// Give some tracks states so reporting states has something to find.
+		track.muted = t % 10 == 0;
+		for (int i = 0; i < BENCH_ITEMS_PER_TRACK; ++i) {
+			track.items.push_back({i * BENCH_ITEM_LENGTH * 2, BENCH_ITEM_LENGTH});
+		}
+		for (int f = 0; f < BENCH_FX_PER_TRACK; ++f) {
+			track.fx.push_back("VST: ReaEQ (Cockos)");
+		}
+	}
+	master.number = -1;
+	for (int m = 0; m < BENCH_MARKERS; ++m) {
+		markers.push_back({false, BENCH_PROJECT_LENGTH * m / BENCH_MARKERS, 0,
+			m + 1});
+	}
+	for (int r = 0; r < BENCH_REGIONS; ++r) {
+		const double start = BENCH_PROJECT_LENGTH * r / BENCH_REGIONS;
+		// Regions overlap, which is the slow case for finding regions.
+		markers.push_back({true, start,
+			start + BENCH_PROJECT_LENGTH * 3 / BENCH_REGIONS, r + 1});
+	}
+}
+
+ReaProject* enumProjects(int idx, char* projfn, int projfnSize) {
+	if (idx != -1 && idx != 0) {
+		return nullptr;
+	}
+	if (projfn && projfnSize > 0) {
+		projfn[0] = '\0';
+	}
+	return (ReaProject*)&project;
+}
+
+int getProjectStateChangeCount(ReaProject* proj) {
+	return stateCount;
+}
+
+int countTracks(ReaProject* proj) {
+	return (int)tracks.size();
+}
+
+MediaTrack* getTrack(ReaProject* proj, int index) {
+	if (index < 0 || index >= (int)tracks.size()) {
+		return nullptr;
+	}
+	return (MediaTrack*)&tracks[index];
+}
+
+MediaTrack* getMasterTrack(ReaProject* proj) {
+	return (MediaTrack*)&master;
+}
+
+void* getSetMediaTrackInfo(MediaTrack* track, const char* parm,
+	void* setNewValue
+) {
+	if (strcmp(parm, "IP_TRACKNUMBER") == 0) {
+		return (void*)(size_t)asTrack(track)->number;
+	}
+	return nullptr;
+}
+
+int countTrackMediaItems(MediaTrack* track) {
+	return (int)asTrack(track)->items.size();
+}
+
+MediaItem* getTrackMediaItem(MediaTrack* track, int index) {
+	auto& items = asTrack(track)->items;
+	if (index < 0 || index >= (int)items.size()) {
+		return nullptr;
+	}
+	return (MediaItem*)&items[index];
+}
+
+double getMediaItemInfo_Value(MediaItem* item, const char* parm) {
+	const Item* fakeItem = (Item*)item;
+	if (strcmp(parm, "D_POSITION") == 0) {
+		return fakeItem->position;
+	}
+	if (strcmp(parm, "D_LENGTH") == 0) {
+		return fakeItem->length;
+	}
+	return 0;
+}
+
+int countProjectMarkers(ReaProject* proj, int* numMarkers, int* numRegions) {
+	if (numMarkers) {
+		*numMarkers = BENCH_MARKERS;
+	}
+	if (numRegions) {
+		*numRegions = BENCH_REGIONS;
+	}
+	return (int)markers.size();
+}
+
+int enumProjectMarkers(int idx, bool* isRegion, double* pos, double* end,
+	const char** name, int* number
+) {
+	if (idx < 0 || idx >= (int)markers.size()) {
+		return 0;
+	}
+	const Marker& marker = markers[idx];
+	if (isRegion) {
+		*isRegion = marker.isRegion;
+	}
+	if (pos) {
+		*pos = marker.start;
+	}
+	if (end) {
+		*end = marker.end;
+	}
+	if (name) {
+		*name = "";
+	}
+	if (number) {
+		*number = marker.number;
+	}
+	return idx + 1;
+}
+
+int trackFxGetCount(MediaTrack* track) {
+	return (int)asTrack(track)->fx.size();
+}
+
+int trackFxGetRecCount(MediaTrack* track) {
+	return 0;
+}
+
+bool trackFxGetEnabled(MediaTrack* track, int fx) {
+	return true;
+}
+
+bool trackFxGetFXName(MediaTrack* track, int fx, char* buf, int bufSize) {
+	auto& names = asTrack(track)->fx;
+	if (fx < 0 || fx >= (int)names.size()) {
+		return false;
+	}
+	snprintf(buf, bufSize, "%s", names[fx].c_str());
+	return true;
+}
+
+bool trackFxGetNamedConfigParm(MediaTrack* track, int fx, const char* parm,
+	char* buf, int bufSize
+) {
+	// There are no containers.
+	return false;
+}
+
+int takeFxGetCount(MediaItem_Take* take) {
+	return 0;
+}
+
+bool takeFxGetEnabled(MediaItem_Take* take, int fx) {
+	return false;
+}
+
+bool takeFxGetFXName(MediaItem_Take* take, int fx, char* buf, int bufSize) {
+	return false;
+}
+
+bool takeFxGetNamedConfigParm(MediaItem_Take* take, int fx,
+	const char* parm, char* buf, int bufSize
+) {
+	return false;
+}
+
+int countTempoTimeSigMarkers(ReaProject* proj) {
+	return 1;
+}
+
+bool getTempoTimeSigMarker(ReaProject* proj, int idx, double* time,
+	int* measure, double* beat, double* bpm, int* timeSigNum, int* timeSigDenom,
+	bool* isLinear
+) {
+	if (idx != 0) {
+		return false;
+	}
+	if (time) {
+		*time = 0;
+	}
+	if (measure) {
+		*measure = 0;
+	}
+	if (beat) {
+		*beat = 0;
+	}
+	if (bpm) {
+		*bpm = BENCH_TEMPO;
+	}
+	if (timeSigNum) {
+		*timeSigNum = BENCH_TIME_SIG_NUM;
+	}
+	if (timeSigDenom) {
+		*timeSigDenom = BENCH_TIME_SIG_DENOM;
+	}
+	if (isLinear) {
+		*isLinear = false;
+	}
+	return true;
+}
+
+double timeMap2TimeToQN(ReaProject* proj, double time) {
+	return time * BENCH_TEMPO / 60;
+}
+
+double timeMap2TimeToBeats(ReaProject* proj, double time, int* measure,
+	int* measureLength, double* fullBeats, int* timeDenom
+) {
+	const double beats = timeMap2TimeToQN(proj, time) * BENCH_TIME_SIG_DENOM /
+		4;
+	const double measures = floor(beats / BENCH_TIME_SIG_NUM);
+	if (measure) {
+		*measure = (int)measures;
+	}
+	if (measureLength) {
+		*measureLength = BENCH_TIME_SIG_NUM;
+	}
+	if (fullBeats) {
+		*fullBeats = beats;
+	}
+	if (timeDenom) {
+		*timeDenom = BENCH_TIME_SIG_DENOM;
+	}
+	return beats - measures * BENCH_TIME_SIG_NUM;
+}
+
+void timeMapGetTimeSigAtTime(ReaProject* proj, double time, int* timeSigNum,
+	int* timeSigDenom, double* tempo
+) {
+	*timeSigNum = BENCH_TIME_SIG_NUM;
+	*timeSigDenom = BENCH_TIME_SIG_DENOM;
+	*tempo = BENCH_TEMPO;
+}
+
+// Point the REAPER API function pointers at the fake implementations. Any
+// other API function is left null, so calling it crashes rather than silently
+// measuring nothing.
+void install() {
+	EnumProjects = enumProjects;
+	GetProjectStateChangeCount = getProjectStateChangeCount;
+	CountTracks = countTracks;
+	GetTrack = getTrack;
+	GetMasterTrack = getMasterTrack;
+	GetSetMediaTrackInfo = getSetMediaTrackInfo;
+	CountTrackMediaItems = countTrackMediaItems;
+	GetTrackMediaItem = getTrackMediaItem;
+	GetMediaItemInfo_Value = getMediaItemInfo_Value;
+	CountProjectMarkers = countProjectMarkers;
+	EnumProjectMarkers = enumProjectMarkers;
+	TrackFX_GetCount = trackFxGetCount;
+	TrackFX_GetRecCount = trackFxGetRecCount;
+	TrackFX_GetEnabled = trackFxGetEnabled;
+	TrackFX_GetFXName = trackFxGetFXName;
+	TrackFX_GetNamedConfigParm = trackFxGetNamedConfigParm;
+	TakeFX_GetCount = takeFxGetCount;
+	TakeFX_GetEnabled = takeFxGetEnabled;
+	TakeFX_GetFXName = takeFxGetFXName;
+	TakeFX_GetNamedConfigParm = takeFxGetNamedConfigParm;
+	CountTempoTimeSigMarkers = countTempoTimeSigMarkers;
+	GetTempoTimeSigMarker = getTempoTimeSigMarker;
+	TimeMap2_timeToQN = timeMap2TimeToQN;
+	TimeMap2_timeToBeats = timeMap2TimeToBeats;
+	TimeMap_GetTimeSigAtTime = timeMapGetTimeSigAtTime;
+}
+
+} // namespace fakeReaper
+
+// trackStates calls these. The real versions are in reaper_osara.cpp, which
+// isn't part of this program.
+bool isTrackMuted(MediaTrack* track) {
+	return fakeReaper::asTrack(track)->muted;
+}
+
+bool isTrackSoloed(MediaTrack* track) {
+	return false;
+}
+
+bool isTrackArmed(MediaTrack* track) {
+	return false;
+}
+
+bool isTrackMonitored(MediaTrack* track) {
+	return false;
+}
+
+// Run func(i) for i in [0, iterations) and print the time taken.
+template<typename Func>
+void measure(const char* name, int iterations, Func func) {
+	const auto start = chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i) {
+		func(i);
+	}
+	const double elapsed = chrono::duration<double, micro>(
+		chrono::steady_clock::now() - start).count();
+	printf("%s: %d calls, %.2f ms total, %.3f us per call\n", name, iterations,
+		elapsed / 1000, elapsed / iterations);
+}
+
+// A position spread over the project for iteration i.
+double benchPos(int i) {
+	// 7919 is prime, so this visits positions in a scattered order.
+	return (double)(i * 7919 % 10000) / 10000 * BENCH_PROJECT_LENGTH;
+}
+
+MediaTrack* benchTrack(int i) {
+	return GetTrack(nullptr, i % BENCH_TRACKS);
+}
+
+// Simulate a change to the project, which makes indexes keyed on the project
+// state rebuild on their next lookup.
+void changeProject() {
+	++fakeReaper::stateCount;
+}
+
+int main() {
+	fakeReaper::build();
+	fakeReaper::install();
+	printf("%d tracks, %d items and %d effects per track, %d markers, "
+		"%d regions\n\n", BENCH_TRACKS, BENCH_ITEMS_PER_TRACK,
+		BENCH_FX_PER_TRACK, BENCH_MARKERS, BENCH_REGIONS);
+
+	// Lookups which build an index first are measured separately from lookups
+	// with a warm index.
+	measure("Find item, cold", 10000, [](int i) {
+		changeProject();
+		itemIndex::findItem(benchTrack(i), benchPos(i), 1, 0);
+	});
+	measure("Find item, warm", 100000, [](int i) {
+		itemIndex::findItem(benchTrack(i), benchPos(i), 1, 0);
+	});
+	measure("Find items at position", 100000, [](int i) {
+		itemIndex::findItemsAt(benchTrack(i), benchPos(i));
+	});
+	measure("Find last marker, cold", 1000, [](int i) {
+		changeProject();
+		markerIndex::findLastMarker(benchPos(i));
+	});
+	measure("Find last marker, warm", 100000, [](int i) {
+		markerIndex::findLastMarker(benchPos(i));
+	});
+	measure("Find region", 100000, [](int i) {
+		markerIndex::findRegion(benchPos(i));
+	});
+	measure("Find regions containing position", 100000, [](int i) {
+		markerIndex::findRegionsContaining(benchPos(i));
+	});
+	measure("Get muted tracks, cold", 1000, [](int i) {
+		trackStates::onTrackListChange();
+		trackStates::getTrackNumbers(trackStates::MUTED);
+	});
+	measure("Get muted tracks, warm", 100000, [](int i) {
+		trackStates::getTrackNumbers(trackStates::MUTED);
+	});
+	measure("Get FX tree, cold", 10000, [](int i) {
+		changeProject();
+		fxTree::get(benchTrack(i));
+	});
+	measure("Get FX tree, warm", 100000, [](int i) {
+		fxTree::get(benchTrack(i));
+	});
+	measure("Time to beats, cold", 10000, [](int i) {
+		changeProject();
+		tempoMap::timeToBeats(benchPos(i), nullptr, nullptr, nullptr);
+	});
+	measure("Time to beats, warm", 100000, [](int i) {
+		int measureNum, measureLength, timeDenom;
+		tempoMap::timeToBeats(benchPos(i), &measureNum, &measureLength, &timeDenom);
+	});
+	return 0;
+}
@@ -6,15 +6,20 @@
  */
 
 #include <string>
-#include <sstream>
-#include <iomanip>
-#include <map>
+#include <unordered_map>
 #include <WDL/db2val.h>
 #include <cstdint>
 #include "osara.h"
 #include "config.h"
 #include "fxChain.h"
 #include "paramsUi.h"
+#include "peakWatcher.h"
+#include "markerIndex.h"
+#include "trackStates.h"
+#include "fxTree.h"
+#include "latency.h"
+#include "trackTable.h"
+#include "messageBuilder.h"
 #include "midiEditorCommands.h"
 #include "translation.h"
 
@@ -22,7 +27,7 @@ using namespace std;
 
 // REAPER often notifies us about track states even if they haven't changed.
 // It also notifies us about these states when a track is first created.
-// We only want to report changes. So, we maintain a cache.
+// We only want to report changes. So, we maintain a cache in the track table.
 // We don't want to report the first value we're notified about. That means
 // we need to know not just enabled/disabled, but whether the value has been
 // cached yet. So, we have two flags for each state: one for enabled, one for
@@ -82,6 +87,7 @@ class Surface: public IReaperControlSurface {
 	}
 
 	void Run() final {
+		latency::Scope latencyScope(latency::SOURCE_SURFACE_RUN);
 		if (settings::reportMarkersWhilePlaying && GetPlayState() & 1) {
 			double playPos = GetPlayPosition();
 			if (playPos == this->lastPlayPos) {
@@ -116,23 +122,22 @@ class Surface: public IReaperControlSurface {
 		if (isParamsDialogOpen || !this->shouldHandleParamChange()) {
 			return;
 		}
-		ostringstream s;
+		MessageBuilder s;
 		bool different = this->reportTrackIfDifferent(track, s);
 		different |= this->lastParam != PARAM_VOLUME;
 		if (different) {
 			s << translate("volume") << " ";
 			this->lastParam = PARAM_VOLUME;
 		}
-		s << fixed << setprecision(2);
-		s << VAL2DB(volume);
-		outputMessage(s);
+		s.format("{:.2f}", VAL2DB(volume));
+		outputMessage(s, /* interrupt */ true, MS_SURFACE);
 	}
 
 	void SetSurfacePan(MediaTrack* track, double pan) final {
 		if (isParamsDialogOpen || !this->shouldHandleParamChange()) {
 			return;
 		}
-		ostringstream s;
+		MessageBuilder s;
 		bool different = this->reportTrackIfDifferent(track, s);
 		different |= this->lastParam != PARAM_PAN;
 		if (different) {
@@ -140,25 +145,27 @@ class Surface: public IReaperControlSurface {
 			this->lastParam = PARAM_PAN;
 		}
 		formatPan(pan, s);
-		outputMessage(s);
+		outputMessage(s, /* interrupt */ true, MS_SURFACE);
 	}
 
 	void SetSurfaceMute(MediaTrack* track, bool mute) final {
+		trackStates::update(track, trackStates::MUTED, mute);
 		if (!settings::reportSurfaceChanges) {
 			return;
 		}
 		auto cache = this->cachedTrackState<TC_MUTED, TC_UNMUTED>(track);
 		if (!isParamsDialogOpen && !this->wasCausedByCommand() &&
 				cache.hasChanged(mute)) {
-			ostringstream s;
+			MessageBuilder s;
 			this->reportTrackIfDifferent(track, s);
 			s << (mute ? translate("muted") : translate("unmuted"));
-			outputMessage(s);
+			outputMessage(s, /* interrupt */ true, MS_SURFACE);
 		}
 		cache.update(mute);
 	}
 
 	void SetSurfaceSolo(MediaTrack* track, bool solo) final {
+		trackStates::update(track, trackStates::SOLOED, solo);
 		if (!settings::reportSurfaceChanges) {
 			return;
 		}
@@ -170,25 +177,26 @@ class Surface: public IReaperControlSurface {
 		auto cache = this->cachedTrackState<TC_SOLOED, TC_UNSOLOED>(track);
 		if (!isParamsDialogOpen && !this->wasCausedByCommand() &&
 				cache.hasChanged(solo)) {
-			ostringstream s;
+			MessageBuilder s;
 			this->reportTrackIfDifferent(track, s);
 			s << (solo ? translate("soloed") : translate("unsoloed"));
-			outputMessage(s);
+			outputMessage(s, /* interrupt */ true, MS_SURFACE);
 		}
 		cache.update(solo);
 	}
 
 	void SetSurfaceRecArm(MediaTrack* track, bool arm) final {
+		trackStates::update(track, trackStates::ARMED, arm);
 		if (!settings::reportSurfaceChanges) {
 			return;
 		}
 		auto cache = this->cachedTrackState<TC_ARMED, TC_UNARMED>(track);
 		if (!isParamsDialogOpen && !this->wasCausedByCommand() &&
 				cache.hasChanged(arm)) {
-			ostringstream s;
+			MessageBuilder s;
 			this->reportTrackIfDifferent(track, s);
 			s << (arm ? translate("armed") : translate("unarmed"));
-			outputMessage(s);
+			outputMessage(s, /* interrupt */ true, MS_SURFACE);
 		}
 		cache.update(arm);
 		// REAPER calls SetSurfaceVolume after arming a track. Ensure we don't
@@ -217,6 +225,22 @@ class Surface: public IReaperControlSurface {
 	}
 
 	int Extended(int call, void* parm1, void* parm2, void* parm3) final {
+		if (call == CSURF_EXT_SETINPUTMONITOR) {
+			trackStates::update((MediaTrack*)parm1, trackStates::MONITORED,
+				*(int*)parm2);
+			return 0; // Unsupported.
+		}
+		if (call == CSURF_EXT_SETFXCHANGE) {
+			peakWatcher::onFxChainChange();
+			fxTree::onFxChainChange((MediaTrack*)parm1);
+			invalidateParamInfoCache();
+			return 0; // Unsupported.
+		}
+		if (call == CSURF_EXT_SETFXENABLED) {
+			// The cached enabled state is now stale.
+			fxTree::onFxChainChange((MediaTrack*)parm1);
+			return 0; // Unsupported.
+		}
 		if (call == CSURF_EXT_SETFXPARAM) {
 			if (!this->shouldHandleParamChange()) {
 				return 0; // Unsupported.
@@ -231,13 +255,17 @@ class Surface: public IReaperControlSurface {
 			}
 			int param = *(int*)parm2 & 0xFFFF;
 			double normVal = *(double*)parm3;
-			ostringstream s;
+			MessageBuilder s;
 			char chunk[256];
 			bool different = this->reportTrackIfDifferent(track, s);
 			different |= fx != this->lastFx;
 			if (different) {
-				TrackFX_GetFXName(track, fx, chunk, sizeof(chunk));
-				s << chunk << " ";
+				if (const fxTree::Fx* treeFx = fxTree::get(track).find(fx)) {
+					s << treeFx->name << " ";
+				} else {
+					TrackFX_GetFXName(track, fx, chunk, sizeof(chunk));
+					s << chunk << " ";
+				}
 			}
 			this->lastFx = fx;
 			different |= param != this->lastParam;
@@ -253,12 +281,17 @@ class Surface: public IReaperControlSurface {
 			} else {
 				s << normVal;
 			}
-			outputMessage(s);
+			outputMessage(s, /* interrupt */ true, MS_SURFACE);
 		}
 		return 0; // Unsupported.
 	}
 
 	void SetTrackListChange() final {
+		// Removing a track might free an FX chain and its effects.
+		peakWatcher::onFxChainChange();
+		trackTable::onTrackListChange();
+		trackStates::onTrackListChange();
+		fxTree::onTrackListChange();
 #ifdef _WIN32
 		// hack: A bug in earlier versions of JUCE breaks OSARA UIA events when
 		// a JUCE plugin is removed, which can happen when a track is removed. Hiding
@@ -290,7 +323,7 @@ class Surface: public IReaperControlSurface {
 	}
 	DWORD lastParamChangeTime = 0;
 
-	bool reportTrackIfDifferent(MediaTrack* track, ostringstream& output) {
+	bool reportTrackIfDifferent(MediaTrack* track, MessageBuilder& output) {
 		bool different = track != this->lastChangedTrack;
 		if (different) {
 			this->lastChangedTrack = track;
@@ -312,45 +345,50 @@ class Surface: public IReaperControlSurface {
 
 	template<uint8_t enableFlag, uint8_t disableFlag>
 	TrackCacheState<enableFlag, disableFlag> cachedTrackState(MediaTrack* track) {
-		uint8_t& value = this->trackCache[track];
-		return TrackCacheState<enableFlag, disableFlag>(value);
+		trackTable::Entry* entry = trackTable::get(track);
+		if (!entry) {
+			// This track isn't in the table; e.g. because it belongs to another
+			// project. Keep its states separately so changes are still reported.
+			return TrackCacheState<enableFlag, disableFlag>(
+				this->uncachedTrackStates[track]);
+		}
+		return TrackCacheState<enableFlag, disableFlag>(entry->surfaceStates);
 	}
 
 	void reportMarker(double playPos) {
-		int marker, region;
-		double markerPos;
-		GetLastMarkerAndCurRegion(0, playPos, &marker, &region);
-		const char* name;
-		int number;
-		ostringstream s;
-		if (marker >= 0 && marker != this->lastMarker) {
-			EnumProjectMarkers(marker, nullptr, &markerPos, nullptr, &name, &number);
+		// This is called for every frame during playback, so use the marker index
+		// rather than querying REAPER.
+		auto marker = markerIndex::findLastMarker(playPos);
+		auto region = markerIndex::findRegion(playPos);
+		const int markerId = marker ? marker->index : -1;
+		const int regionId = region ? region->index : -1;
+		MessageBuilder s;
+		if (marker && markerId != this->lastMarker) {
 			// Allow the cursor to be within 100ms, since this method is called
 			// periodically.
-			if (markerPos >= playPos - 0.1) {
-				if (name[0]) {
-					s << format(translate("{} marker"), name) << " ";
+			if (marker->start >= playPos - 0.1) {
+				if (!marker->name.empty()) {
+					s.format(translate("{} marker"), marker->name) << " ";
 				} else {
-					s << format(translate("marker {}"), number) << " ";
+					s.format(translate("marker {}"), marker->number) << " ";
 				}
 			}
 		}
-		this->lastMarker = marker;
-		if (region >= 0 && region != this->lastRegion) {
-			EnumProjectMarkers(region, nullptr, nullptr, nullptr, &name, &number);
-			if (name[0]) {
+		this->lastMarker = markerId;
+		if (region && regionId != this->lastRegion) {
+			if (!region->name.empty()) {
 				// Translators: Reported when playback reaches a named region. {} will
 				// be replaced with the region's name; e.g. "intro region".
-				s << format(translate("{} region"), name) << " ";
+				s.format(translate("{} region"), region->name) << " ";
 			} else {
 				// Translators: Reported when playback reaches an unnamed region. {}
 				// will be replaced with the region's number; e.g. "region 2".
-				s << format(translate("region {}"), number) << " ";
+				s.format(translate("region {}"), region->number) << " ";
 			}
 		}
-		this->lastRegion = region;
-		if (s.tellp() > 0) {
-			outputMessage(s, /* interrupt */ false);
+		this->lastRegion = regionId;
+		if (!s.empty()) {
+			outputMessage(s, /* interrupt */ false, MS_SURFACE);
 		}
 	}
 
@@ -381,7 +419,7 @@ class Surface: public IReaperControlSurface {
 		int channel = status - MIDI_NOTE_ON_C0;
 		const string noteName = getMidiNoteName(track, event[1], channel);
 		if (!noteName.empty()) {
-			outputMessage(noteName);
+			outputMessage(noteName, /* interrupt */ true, MS_SURFACE);
 		}
 	}
 
@@ -392,7 +430,8 @@ class Surface: public IReaperControlSurface {
 	const int PARAM_VOLUME = -2;
 	const int PARAM_PAN = -3;
 	int lastParam = PARAM_NONE;
-	map<MediaTrack*, uint8_t> trackCache;
+	// Surface states for tracks which aren't in the track table.
+	unordered_map<MediaTrack*, uint8_t> uncachedTrackStates;
 	double lastPlayPos = 0;
 	int lastMarker = -1;
 	int lastRegion = -1;
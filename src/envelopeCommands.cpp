@@ -8,12 +8,14 @@
 #include <string>
 #include <sstream>
 #include <tuple>
-#include <regex>
 #include <functional>
 #include <set>
 #include <algorithm>
+#include <bit>
 #include <optional>
 #include "osara.h"
+#include "envelopeIndex.h"
+#include "envelopePoints.h"
 #include "translation.h"
 
 using namespace std;
@@ -27,24 +29,15 @@ int getEnvelopePointByProjectTime(double time) {
 	if (!envelope) {
 		return -1;
 	}
-	double offset = 0.0;
-	double rate = 1.0;
-	if (selectedEnvelopeIsTake) {
-		MediaItem* item = GetSelectedMediaItem(0, 0);
-		if (!item) {
-			return -1;
-		}
-		offset = GetMediaItemInfo_Value(item, "D_POSITION");
-		MediaItem_Take* take = GetActiveTake(item);
-		if(!take) {
-			return -1;
-		}
-		rate = GetMediaItemTakeInfo_Value(take, "D_PLAYRATE");
+	const auto& points = envelopePoints::get(envelope);
+	if (selectedEnvelopeIsTake && !points.isTake) {
+		return -1;
 	}
-	// GetEnvelopePointByTime often returns the point before instead of right at the position.
-	// Increment the cursor position a bit to work around this.
-	return GetEnvelopePointByTimeEx(envelope, currentAutomationItem,
-		(time + 0.0001 - offset) * rate);
+	// Like GetEnvelopePointByTime, this might return the point before instead of
+	// right at the position due to rounding. Increment the cursor position a bit
+	// to work around this.
+	return points.findByTime(currentAutomationItem,
+		(time + 0.0001 - points.takeOffset) * points.takeRate);
 }
 
 int getEnvelopePointAtCursor() {
@@ -56,21 +49,8 @@ double envelopeTimeToProjectTime(double time) {
 	if (!envelope) {
 		return time;
 	}
-	double offset = 0.0;
-	double rate = 1.0;
-	if (selectedEnvelopeIsTake) {
-		MediaItem* item = GetSelectedMediaItem(0, 0);
-		if (!item) {
-			return time;
-		}
-		offset = GetMediaItemInfo_Value(item, "D_POSITION");
-		MediaItem_Take* take = GetActiveTake(item);
-		if(!take) {
-			return time + offset;
-		}
-		rate = GetMediaItemTakeInfo_Value(take, "D_PLAYRATE");
-	}
-	return time / rate + offset;
+	const auto& points = envelopePoints::get(envelope);
+	return time / points.takeRate + points.takeOffset;
 }
 
 void postMoveEnvelopePoint(int command) {
@@ -82,13 +62,12 @@ void postMoveEnvelopePoint(int command) {
 	int point = getEnvelopePointAtCursor();
 	if (point < 0)
 		return;
-	double value;
-	bool selected;
-	GetEnvelopePointEx(envelope, currentAutomationItem, point, nullptr, &value, nullptr, nullptr, &selected);
-	if (!selected)
+	const auto& points = envelopePoints::get(envelope);
+	const int index = points.getIndex(currentAutomationItem, point);
+	if (!points.isSelected(index))
 		return; // Not moved.
 	char out[64];
-	Envelope_FormatValue(envelope, value, out, sizeof(out));
+	Envelope_FormatValue(envelope, points.values[index], out, sizeof(out));
 	outputMessage(out);
 }
 
@@ -106,33 +85,19 @@ int countEnvelopePointsIncludingAutoItems(TrackEnvelope* envelope) {
 // For each automation item in the project, Call func(envelope, autoItemIndex).
 // func should return true to continue iterating, false to stop.
 void forEachAutomationItem(auto func) {
-	auto handleTrack = [&] (MediaTrack* track) {
-		int envelopes = CountTrackEnvelopes(track);
-		for (int e = 0; e < envelopes; ++e) {
-			TrackEnvelope* env = GetTrackEnvelope(track, e);
-			int items = CountAutomationItems(env);
-			for (int i = 0; i < items; ++i) {
-				if (!func(env, i)) {
-					return;
-				}
+	// Only envelopes which contain automation items need to be visited.
+	for (const auto& env: envelopeIndex::getAutoItemEnvelopes()) {
+		for (int i = 0; i < env.count; ++i) {
+			if (!func(env.envelope, i)) {
+				return;
 			}
 		}
-	};
-	handleTrack(GetMasterTrack(nullptr));
-	int tracks = CountTracks(nullptr);
-	for (int t = 0; t < tracks; ++t) {
-		handleTrack(GetTrack(nullptr, t));
 	}
 }
 
 // Counts automation items across all envelopes on all tracks.
 int countAllAutomationItems() {
-	int count = 0;
-	forEachAutomationItem([&count] (TrackEnvelope* env, int item) {
-		++count;
-		return true;
-	});
-	return count;
+	return envelopeIndex::countAllAutoItems();
 }
 
 void cmdhDeleteEnvelopePointsOrAutoItems(int command, bool checkPoints, bool checkItems) {
@@ -152,7 +117,7 @@ void cmdhDeleteEnvelopePointsOrAutoItems(int command, bool checkPoints, bool che
 	// Check items first, since deleting an item might also implicitly remove
 	// points.
 	if (checkItems) {
-		removed = oldItems - countAllAutomationItems();
+		removed = oldItems - envelopeIndex::recountAutoItemsAfterRemoval();
 		// If no items wer removed, fall through to the points check below unless
 		// we're not checking points, in which case report 0 items.
 		if (removed > 0) {
@@ -187,16 +152,18 @@ void cmdDeleteEnvelopePoints(Command* command) {
 // For each selected envelope point, Call func(autoItemIndex, pointIndex) .
 // func should return true to continue iterating, false to stop.
 void forEachSelectedEnvelopePoint(TrackEnvelope* envelope, auto func) {
-	// Iterate the points in the envelope itself and each automation item. -1
+	const auto& points = envelopePoints::get(envelope);
+	// Walk the selection bits so unselected points cost nothing. The points of
+	// the envelope itself come first, followed by each automation item. -1
 	// means the envelope itself.
-	int itemCount = CountAutomationItems(envelope);
-	for (int item = -1; item < itemCount; ++item) {
-		int pointCount = CountEnvelopePointsEx(envelope, item);
-		for (int point = 0; point < pointCount; ++point) {
-			bool selected;
-			GetEnvelopePointEx(envelope, item, point, nullptr, nullptr, nullptr, nullptr,
-				&selected);
-			if (selected && !func(item, point)) {
+	int item = -1;
+	for (int word = 0; word < (int)points.selection.size(); ++word) {
+		for (uint64_t bits = points.selection[word]; bits; bits &= bits - 1) {
+			const int index = word * 64 + countr_zero(bits);
+			while (index >= points.starts[item + 2]) {
+				++item;
+			}
+			if (!func(item, index - points.starts[item + 1])) {
 				return;
 			}
 		}
@@ -206,14 +173,7 @@ void forEachSelectedEnvelopePoint(TrackEnvelope* envelope, auto func) {
 // If max2 is true, this only counts to 2;
 // i.e. 2 or more selected envelope points returns 2.
 int countSelectedEnvelopePoints(TrackEnvelope* envelope, bool max2=false) {
-	int numSel = 0;
-	forEachSelectedEnvelopePoint(envelope,
-		[max2, &numSel](int item, int point) {
-			++numSel;
-			return !(max2 && numSel == 2);
-		}
-	);
-	return numSel;
+	return envelopePoints::get(envelope).countSelected(max2 ? 2 : -1);
 }
 
 optional<int> currentEnvelopePoint{};
@@ -241,7 +201,8 @@ void moveToEnvelopePoint(int direction, bool clearSelection=true, bool select =
 	if (!envelope) {
 		return;
 	}
-	int count = CountEnvelopePointsEx(envelope, currentAutomationItem);
+	const auto& points = envelopePoints::get(envelope);
+	int count = points.getCount(currentAutomationItem);
 	if (count == 0) {
 		return;
 	}
@@ -252,12 +213,8 @@ void moveToEnvelopePoint(int direction, bool clearSelection=true, bool select =
 			return;
 		++point;
 	}
-	double time, value;
-	int shape;
-	bool selected;
-	GetEnvelopePointEx(envelope, currentAutomationItem, point, &time, &value,
-		&shape, nullptr, &selected);
-	time = envelopeTimeToProjectTime(time);
+	int index = points.getIndex(currentAutomationItem, point);
+	double time = envelopeTimeToProjectTime(points.times[index]);
 	if ((direction == 1 && time < now)
 		// If this point is at the cursor, skip it only if it's the current point.
 		// This allows you to easily get to a point at the cursor
@@ -270,21 +227,24 @@ void moveToEnvelopePoint(int direction, bool clearSelection=true, bool select =
 		int newPoint = point + direction;
 		if (0 <= newPoint && newPoint < count) {
 			point = newPoint;
-			GetEnvelopePointEx(envelope, currentAutomationItem, point, &time, &value,
-				&shape, nullptr, &selected);
-			time = envelopeTimeToProjectTime(time);
+			index = points.getIndex(currentAutomationItem, point);
+			time = envelopeTimeToProjectTime(points.times[index]);
 		}
 	}
 	if (direction != 0 && direction == 1 ? time < now : time > now)
 		return; // No point in this direction.
 	fakeFocus = FOCUS_ENVELOPE;
 	currentEnvelopePoint.emplace(point);
+	const double value = points.values[index];
+	const int shape = points.shapes[index];
 	if (clearSelection) {
-		Main_OnCommand(40331, 0); // Envelope: Unselect all points
+		envelopePoints::clearSelection(envelope);
 		isSelectionContiguous = true;
 	}
-	if(select)
+	if(select) {
 		SetEnvelopePointEx(envelope, currentAutomationItem, point, nullptr, nullptr, nullptr, nullptr, &bTrue, &bTrue);
+		envelopePoints::setSelected(envelope, currentAutomationItem, point, true);
+	}
 	if (direction != 0)
 		SetEditCurPos(time, true, true);
 	char out[64];
@@ -296,10 +256,9 @@ void moveToEnvelopePoint(int direction, bool clearSelection=true, bool select =
 	// For example: "point 1 value 0.00 dB linear".
 	s << format(translate("point {point} value {value} {shape}"),
 		"point"_a=point, "value"_a=out, "shape"_a=getEnvelopeShapeName(shape));
-	bool isSelected;
-	GetEnvelopePointEx(envelope, currentAutomationItem, point, nullptr, nullptr, nullptr, nullptr, &isSelected);
-	if (isSelected) {
-		int numSel = countSelectedEnvelopePoints(envelope, true);
+	const auto& newPoints = envelopePoints::get(envelope);
+	if (newPoints.isSelected(newPoints.getIndex(currentAutomationItem, point))) {
+		int numSel = newPoints.countSelected(2);
 		// One selected point is the norm, so don't report selected in this case.
 		if (numSel > 1) {
 			s << " " << translate("selected");
@@ -320,6 +279,8 @@ optional<bool> toggleCurrentEnvelopePointSelection() {
 		return nullopt;
 	isSelected = !isSelected;
 	SetEnvelopePointEx(envelope, currentAutomationItem, *currentEnvelopePoint, nullptr, nullptr, nullptr, nullptr, &isSelected, &bTrue);
+	envelopePoints::setSelected(envelope, currentAutomationItem,
+		*currentEnvelopePoint, isSelected);
 	return {isSelected};
 }
 
@@ -334,11 +295,9 @@ void cmdInsertEnvelopePoint(Command* command) {
 	moveToEnvelopePoint(0); // Select and report inserted point.
 }
 
-const regex RE_ENVELOPE_STATE("<(AUX|HW)?(\\S+)[^]*?\\sACT (0|1)[^]*?\\sVIS (0|1)[^]*?\\sARM (0|1)");
 void cmdhSelectEnvelope(int direction) {
 	MediaTrack* track = nullptr;
-	int count;
-	function<TrackEnvelope*(int)> getEnvelope;
+	const envelopeIndex::Envelopes* envelopes;
 	// selectedEnvelopeIsTake is set when focus changes to track or item.
 	if (selectedEnvelopeIsTake) {
 		MediaItem* item = GetSelectedMediaItem(0, 0);
@@ -347,15 +306,15 @@ void cmdhSelectEnvelope(int direction) {
 		MediaItem_Take* take = GetActiveTake(item);
 		if (!take)
 			return;
-		count = CountTakeEnvelopes(take);
-		getEnvelope = [take] (int index) { return GetTakeEnvelope(take, index); };
+		envelopes = &envelopeIndex::get(take);
 	} else {
 		track = GetLastTouchedTrack();
 		if (!track)
 			return;
-		count = CountTrackEnvelopes(track);
-		getEnvelope = [track] (int index) { return GetTrackEnvelope(track, index); };
+		envelopes = &envelopeIndex::get(track);
 	}
+	const auto& list = envelopes->envelopes;
+	int count = (int)list.size();
 	if (count == 0) {
 		outputMessage(selectedEnvelopeIsTake ?
 			translate("no take envelopes") : translate("no track envelopes"));
@@ -369,7 +328,7 @@ void cmdhSelectEnvelope(int direction) {
 	int index;
 	TrackEnvelope* env;
 	for (index = start; 0 <= index && index < count; index += direction) {
-		env = getEnvelope(index);
+		env = list[index].envelope;
 		if (env == origEnv) {
 			origIndex = index;
 			break;
@@ -383,7 +342,7 @@ void cmdhSelectEnvelope(int direction) {
 	}
 
 	// Get the next envelope in the requested direction.
-	cmatch m;
+	const envelopeIndex::Envelope* info = nullptr;
 	index = origIndex;
 	for (; ;) {
 		index += direction;
@@ -397,11 +356,9 @@ void cmdhSelectEnvelope(int direction) {
 				break;
 			}
 		}
-		env = getEnvelope(index);
-		char state[200];
-		GetEnvelopeStateChunk(env, state, sizeof(state), false);
-		regex_search(state, m, RE_ENVELOPE_STATE);
-		bool invisible = !m.empty() && m.str(4)[0] == '0';
+		info = &list[index];
+		env = info->envelope;
+		bool invisible = info->hasState && !info->isVisible;
 		if (env == origEnv) {
 			// We're back where we started. Don't try to go any further.
 			if (invisible) {
@@ -425,9 +382,9 @@ void cmdhSelectEnvelope(int direction) {
 	fakeFocus = FOCUS_ENVELOPE;
 	shouldMoveToAutoItem = true;
 	ostringstream s;
-	if (!m.empty() && m.str(1).compare("AUX") == 0) {
+	if (info->isSend) {
 		// Send envelope. Get the name of the send.
-		string envType = '<' + m.str(2); // e.g. <VOLENV
+		string envType = '<' + info->type; // e.g. <VOLENV
 		int sendCount = GetTrackNumSends(track, 0);
 		for (int i = 0; i < sendCount; ++i) {
 			TrackEnvelope* sendEnv = (TrackEnvelope*)GetSetTrackSendInfo(track, 0, i, "P_ENV", (void*)envType.c_str());
@@ -440,16 +397,14 @@ void cmdhSelectEnvelope(int direction) {
 			}
 		}
 	}
-	char name[50];
-	GetEnvelopeName(env, name, sizeof(name));
 	// Translators: Reported when selecting an envelope. {} will be replaced
 	// with the name of the envelope; e.g. "volume envelope".
-	s << format(translate("{} envelope"), name);
-	if (!m.empty()) {
-		if (m.str(3)[0] == '0') {
+	s << format(translate("{} envelope"), info->name);
+	if (info->hasState) {
+		if (!info->isActive) {
 			s << " " << translate("bypassed");
 		}
-		if (m.str(5)[0] == '1') {
+		if (info->isArmed) {
 			s << " " << translate("armed");
 		}
 	}
@@ -625,35 +580,22 @@ void reportCopiedEnvelopePointsOrAutoItems() {
 	}
 }
 
-bool isEnvelopeVisible(TrackEnvelope* envelope) {
-	char state[200];
-	GetEnvelopeStateChunk(envelope, state, sizeof(state), false);
-	cmatch m;
-	regex_search(state, m, RE_ENVELOPE_STATE);
-	return !m.empty() && m.str(4)[0] == '1';
-}
-
-set<TrackEnvelope*> getVisibleEnvelopes(auto obj,
-	auto countFunc, auto getFunc
-) {
+set<TrackEnvelope*> getVisibleEnvelopes(auto obj) {
 	set<TrackEnvelope*> envelopes;
-	int count = countFunc(obj);
-	for (int i = 0; i < count; ++i) {
-		TrackEnvelope* env = getFunc(obj, i);
-		if (isEnvelopeVisible(env)) {
-			envelopes.emplace(env);
+	for (const auto& env: envelopeIndex::get(obj).envelopes) {
+		if (env.isVisible) {
+			envelopes.emplace(env.envelope);
 		}
 	}
 	return envelopes;
 }
 
 void cmdhToggleEnvelope(int command, auto obj,
-	auto countFunc, auto getFunc,
 	const char* showedMsg, const char* hidMsg
 ) {
-	set<TrackEnvelope*> before = getVisibleEnvelopes(obj, countFunc, getFunc);
+	set<TrackEnvelope*> before = getVisibleEnvelopes(obj);
 	Main_OnCommand(command, 0);
-	set<TrackEnvelope*> after = getVisibleEnvelopes(obj, countFunc, getFunc);
+	set<TrackEnvelope*> after = getVisibleEnvelopes(obj);
 	if (after.size() == before.size()) {
 		outputMessage(translate("no envelopes toggled"));
 		return;
@@ -676,7 +618,7 @@ void cmdhToggleTrackEnvelope(int command) {
 	if (!track) {
 		return;
 	}
-	cmdhToggleEnvelope(command, track, CountTrackEnvelopes, GetTrackEnvelope,
+	cmdhToggleEnvelope(command, track,
 		translate("showed track {} envelope"),
 		translate("hid track {} envelope"));
 }
@@ -694,7 +636,7 @@ void cmdhToggleTakeEnvelope(int command) {
 	if (!take) {
 		return;
 	}
-	cmdhToggleEnvelope(command, take, CountTakeEnvelopes, GetTakeEnvelope,
+	cmdhToggleEnvelope(command, take,
 		translate("showed take {} envelope"),
 		translate("hid take {} envelope"));
 }
@@ -746,13 +688,13 @@ void cmdCycleEnvelopePointShape(Command* command) {
 		return;
 	}
 	int shape = -1;
+	const auto& points = envelopePoints::get(envelope);
 	forEachSelectedEnvelopePoint(envelope,
-		[envelope, &shape](int item, int point) {
+		[envelope, &points, &shape](int item, int point) {
 			if (shape == -1) {
 				// Get the shape of the first selected point. (The shape variable will
 				// only be -1 for the first point we encounter.)
-				GetEnvelopePointEx(envelope, item, point, nullptr, nullptr, &shape, nullptr,
-					nullptr);
+				shape = points.shapes[points.getIndex(item, point)];
 				// Adjust the shape. This will be set for all selected points.
 				++shape;
 				if (shape > 4) {
@@ -769,6 +711,7 @@ void cmdCycleEnvelopePointShape(Command* command) {
 	if (shape == -1) {
 		return; // No selected points.
 	}
+	envelopePoints::invalidate();
 	outputMessage(getEnvelopeShapeName(shape));
 }
 
@@ -843,7 +786,7 @@ void cmdAddAutoItems(Command* command) {
 void cmdGlueAutoItems(Command* command) {
 	int oldItems = countAllAutomationItems();
 	Main_OnCommand(command->gaccel.accel.cmd, 0);
-	int removed = oldItems - countAllAutomationItems();
+	int removed = oldItems - envelopeIndex::recountAutoItemsAfterRemoval();
 	if (removed == 0) {
 		outputMessage(translate("no automation items glued"));
 	} else {
@@ -0,0 +1,167 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Envelope index code
+ * Copyright 2026 OSARA contributors
+ * License: GNU General Public License version 2.0
+ */
+
+#include <memory>
+#include <regex>
+#include <type_traits>
+#include <vector>
+#include "envelopeIndex.h"
+#include "trackTable.h"
+
+using namespace std;
+
+namespace envelopeIndex {
+
+const regex RE_ENVELOPE_TAG("^<(AUX|HW)?(\\S+)");
+
+template<typename ReaperObj>
+int getCount(ReaperObj* obj) {
+	if constexpr (is_same_v<ReaperObj, MediaTrack>) {
+		return CountTrackEnvelopes(obj);
+	} else {
+		return CountTakeEnvelopes(obj);
+	}
+}
+
+template<typename ReaperObj>
+TrackEnvelope* getEnvelope(ReaperObj* obj, int index) {
+	if constexpr (is_same_v<ReaperObj, MediaTrack>) {
+		return GetTrackEnvelope(obj, index);
+	} else {
+		return GetTakeEnvelope(obj, index);
+	}
+}
+
+template<typename ReaperObj>
+bool isStale(ReaperObj* obj, const Envelopes& envelopes) {
+	return envelopes.stateCount != GetProjectStateChangeCount(nullptr) ||
+		(int)envelopes.envelopes.size() != getCount(obj);
+}
+
+template<typename ReaperObj>
+void build(ReaperObj* obj, Envelopes& envelopes) {
+	envelopes.envelopes.clear();
+	envelopes.stateCount = GetProjectStateChangeCount(nullptr);
+	const int count = getCount(obj);
+	for (int i = 0; i < count; ++i) {
+		Envelope env{getEnvelope(obj, i)};
+		char active[8] = "";
+		char visible[8] = "";
+		char armed[8] = "";
+		if (GetSetEnvelopeInfo_String(env.envelope, "ACTIVE", active, false) &&
+				GetSetEnvelopeInfo_String(env.envelope, "VISIBLE", visible, false) &&
+				GetSetEnvelopeInfo_String(env.envelope, "ARM", armed, false)) {
+			env.hasState = true;
+			env.isActive = active[0] == '1';
+			env.isVisible = visible[0] == '1';
+			env.isArmed = armed[0] == '1';
+		}
+		// The tag isn't available any other way, but it's on the first line, so
+		// a small buffer is enough. REAPER still builds the whole chunk, points
+		// and all. If it doesn't fit, REAPER might report failure but still
+		// fill the buffer, so check what we got rather than the result.
+		char state[200] = "";
+		GetEnvelopeStateChunk(env.envelope, state, sizeof(state), false);
+		state[sizeof(state) - 1] = '\0';
+		cmatch m;
+		if (regex_search(state, m, RE_ENVELOPE_TAG)) {
+			env.isSend = m.str(1).compare("AUX") == 0;
+			env.type = m.str(2);
+		}
+		char name[50];
+		GetEnvelopeName(env.envelope, name, sizeof(name));
+		env.name = name;
+		envelopes.envelopes.push_back(std::move(env));
+	}
+}
+
+// Used for tracks which aren't in the track table; e.g. tracks in other
+// projects. This is rebuilt on every call.
+Envelopes uncached;
+
+const Envelopes& get(MediaTrack* track) {
+	trackTable::Entry* entry = trackTable::get(track);
+	if (entry && !entry->envelopes) {
+		entry->envelopes = make_unique<Envelopes>();
+	}
+	Envelopes& envelopes = entry ? *entry->envelopes : uncached;
+	if (!entry || isStale(track, envelopes)) {
+		build(track, envelopes);
+	}
+	return envelopes;
+}
+
+// Takes are usually queried repeatedly for the same take, so we only cache
+// the last one.
+MediaItem_Take* cachedTake = nullptr;
+Envelopes takeEnvelopes;
+
+const Envelopes& get(MediaItem_Take* take) {
+	if (take != cachedTake || isStale(take, takeEnvelopes)) {
+		cachedTake = take;
+		build(take, takeEnvelopes);
+	}
+	return takeEnvelopes;
+}
+
+vector<AutoItemEnvelope> autoItemEnvelopes;
+ReaProject* autoItemsProject = nullptr;
+int autoItemsStateCount = -1;
+
+const vector<AutoItemEnvelope>& getAutoItemEnvelopes() {
+	ReaProject* project = EnumProjects(-1, nullptr, 0);
+	const int stateCount = GetProjectStateChangeCount(project);
+	if (project == autoItemsProject && stateCount == autoItemsStateCount) {
+		return autoItemEnvelopes;
+	}
+	autoItemsProject = project;
+	autoItemsStateCount = stateCount;
+	autoItemEnvelopes.clear();
+	auto addTrack = [](MediaTrack* track) {
+		const int count = CountTrackEnvelopes(track);
+		for (int e = 0; e < count; ++e) {
+			TrackEnvelope* env = GetTrackEnvelope(track, e);
+			if (int items = CountAutomationItems(env)) {
+				autoItemEnvelopes.push_back({env, items});
+			}
+		}
+	};
+	addTrack(GetMasterTrack(nullptr));
+	const int tracks = CountTracks(nullptr);
+	for (int t = 0; t < tracks; ++t) {
+		addTrack(GetTrack(nullptr, t));
+	}
+	return autoItemEnvelopes;
+}
+
+int countAllAutoItems() {
+	int count = 0;
+	for (const auto& env: getAutoItemEnvelopes()) {
+		count += env.count;
+	}
+	return count;
+}
+
+int recountAutoItemsAfterRemoval() {
+	ReaProject* project = EnumProjects(-1, nullptr, 0);
+	if (project != autoItemsProject) {
+		return countAllAutoItems();
+	}
+	int total = 0;
+	erase_if(autoItemEnvelopes, [&total](AutoItemEnvelope& env) {
+		if (!ValidatePtr(env.envelope, "TrackEnvelope*")) {
+			return true;
+		}
+		env.count = CountAutomationItems(env.envelope);
+		total += env.count;
+		return env.count == 0;
+	});
+	autoItemsStateCount = GetProjectStateChangeCount(project);
+	return total;
+}
+
+}
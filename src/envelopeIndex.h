@@ -0,0 +1,60 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Envelope index header
+ * Copyright 2026 OSARA contributors
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "osara.h"
+
+// Caches the envelopes on each track and take along with the attributes OSARA
+// reports, so that cycling through envelopes or checking visibility doesn't
+// need to fetch and parse envelope state chunks every time. The envelopes for
+// each track are stored in the track table and are rebuilt when the project
+// state or the number of envelopes changes.
+// This also keeps a project wide list of envelopes which contain automation
+// items, so that commands dealing with automation items only visit those.
+namespace envelopeIndex {
+
+struct Envelope {
+	TrackEnvelope* envelope;
+	// False if the envelope's attributes couldn't be fetched, in which case the
+	// flags below are false.
+	bool hasState = false;
+	bool isActive = false;
+	bool isVisible = false;
+	bool isArmed = false;
+	// True for envelopes on sends.
+	bool isSend = false;
+	// The state chunk tag, excluding any AUX or HW prefix; e.g. "VOLENV".
+	std::string type;
+	std::string name;
+};
+
+struct Envelopes {
+	std::vector<Envelope> envelopes;
+	// The project state change count when this was built.
+	int stateCount = -1;
+};
+
+const Envelopes& get(MediaTrack* track);
+const Envelopes& get(MediaItem_Take* take);
+
+struct AutoItemEnvelope {
+	TrackEnvelope* envelope;
+	int count;
+};
+
+// Returns the track envelopes in the project which contain automation items.
+const std::vector<AutoItemEnvelope>& getAutoItemEnvelopes();
+int countAllAutoItems();
+// Recounts automation items after a command which can only remove or merge
+// them, such as deleting or gluing. Only envelopes which previously contained
+// automation items are visited.
+int recountAutoItemsAfterRemoval();
+
+}
@@ -0,0 +1,138 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Envelope point snapshot code
+ * Copyright 2026 OSARA contributors
+ * License: GNU General Public License version 2.0
+ */
+
+#include <algorithm>
+#include <bit>
+#include <vector>
+#include "envelopePoints.h"
+
+using namespace std;
+
+namespace envelopePoints {
+
+Snapshot snapshot;
+ReaProject* cachedProject = nullptr;
+int cachedStateCount = -1;
+
+int Snapshot::getCount(int item) const {
+	if (item < -1 || item + 2 >= (int)this->starts.size()) {
+		return 0;
+	}
+	return this->starts[item + 2] - this->starts[item + 1];
+}
+
+int Snapshot::countSelected(int max) const {
+	int count = 0;
+	for (uint64_t word: this->selection) {
+		count += popcount(word);
+		if (max != -1 && count >= max) {
+			return max;
+		}
+	}
+	return count;
+}
+
+int Snapshot::findByTime(int item, double time) const {
+	const int count = this->getCount(item);
+	if (count == 0) {
+		return -1;
+	}
+	auto begin = this->times.cbegin() + this->starts[item + 1];
+	auto it = upper_bound(begin, begin + count, time);
+	return (int)(it - begin) - 1;
+}
+
+void rebuild(TrackEnvelope* envelope) {
+	snapshot.envelope = envelope;
+	snapshot.isTake = false;
+	snapshot.takeOffset = 0.0;
+	snapshot.takeRate = 1.0;
+	auto take = (MediaItem_Take*)(INT_PTR)GetEnvelopeInfo_Value(envelope, "P_TAKE");
+	if (take) {
+		snapshot.isTake = true;
+		snapshot.takeOffset = GetMediaItemInfo_Value(GetMediaItemTake_Item(take),
+			"D_POSITION");
+		snapshot.takeRate = GetMediaItemTakeInfo_Value(take, "D_PLAYRATE");
+	}
+	snapshot.times.clear();
+	snapshot.values.clear();
+	snapshot.shapes.clear();
+	snapshot.selection.clear();
+	snapshot.starts.clear();
+	const int itemCount = CountAutomationItems(envelope);
+	// -1 is the envelope itself.
+	for (int item = -1; item < itemCount; ++item) {
+		snapshot.starts.push_back((int)snapshot.times.size());
+		const int pointCount = CountEnvelopePointsEx(envelope, item);
+		for (int point = 0; point < pointCount; ++point) {
+			double time = 0, value = 0;
+			int shape = 0;
+			bool selected = false;
+			GetEnvelopePointEx(envelope, item, point, &time, &value, &shape, nullptr,
+				&selected);
+			const int index = (int)snapshot.times.size();
+			snapshot.times.push_back(time);
+			snapshot.values.push_back(value);
+			snapshot.shapes.push_back(shape);
+			if (index % 64 == 0) {
+				snapshot.selection.push_back(0);
+			}
+			if (selected) {
+				snapshot.selection.back() |= uint64_t(1) << (index % 64);
+			}
+		}
+	}
+	snapshot.starts.push_back((int)snapshot.times.size());
+}
+
+const Snapshot& get(TrackEnvelope* envelope) {
+	ReaProject* project = EnumProjects(-1, nullptr, 0);
+	const int stateCount = GetProjectStateChangeCount(project);
+	// Checking the counts is cheap and catches changes made by scripts without
+	// an undo point.
+	if (envelope != snapshot.envelope || project != cachedProject ||
+			stateCount != cachedStateCount ||
+			(int)snapshot.starts.size() != CountAutomationItems(envelope) + 2 ||
+			snapshot.getCount(-1) != CountEnvelopePointsEx(envelope, -1)) {
+		cachedProject = project;
+		cachedStateCount = stateCount;
+		rebuild(envelope);
+	}
+	return snapshot;
+}
+
+void setSelected(TrackEnvelope* envelope, int item, int point, bool selected) {
+	if (envelope != snapshot.envelope || point < 0 ||
+			point >= snapshot.getCount(item)) {
+		return;
+	}
+	const int index = snapshot.getIndex(item, point);
+	const uint64_t bit = uint64_t(1) << (index % 64);
+	if (selected) {
+		snapshot.selection[index / 64] |= bit;
+	} else {
+		snapshot.selection[index / 64] &= ~bit;
+	}
+}
+
+void clearSelection(TrackEnvelope* envelope) {
+	const bool wasCurrent = envelope == snapshot.envelope &&
+		cachedStateCount == GetProjectStateChangeCount(cachedProject);
+	Main_OnCommand(40331, 0); // Envelope: Unselect all points
+	if (!wasCurrent) {
+		return;
+	}
+	// Only the selection changed, so there's no need to fetch the points again.
+	fill(snapshot.selection.begin(), snapshot.selection.end(), 0);
+	cachedStateCount = GetProjectStateChangeCount(cachedProject);
+}
+
+void invalidate() {
+	snapshot.envelope = nullptr;
+}
+
+}
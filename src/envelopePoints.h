@@ -0,0 +1,66 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Envelope point snapshot header
+ * Copyright 2026 OSARA contributors
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "osara.h"
+
+// Caches the points of an envelope and its automation items so that navigating
+// and reporting selected points doesn't need to query every point via the
+// REAPER API. Envelopes with recorded automation can have many thousands of
+// points.
+// The snapshot is rebuilt when the project state changes or when invalidate is
+// called. OSARA code which changes points without changing the project state
+// must call setSelected or invalidate.
+namespace envelopePoints {
+
+struct Snapshot {
+	TrackEnvelope* envelope = nullptr;
+	// For take envelopes, the position and play rate of the take, used to
+	// convert between envelope and project time.
+	bool isTake = false;
+	double takeOffset = 0.0;
+	double takeRate = 1.0;
+	// Points of the envelope itself followed by those of each automation item.
+	std::vector<double> times;
+	std::vector<double> values;
+	std::vector<int> shapes;
+	// A bit for each point.
+	std::vector<uint64_t> selection;
+	// starts[item + 1] is the index of the first point of item, where item -1 is
+	// the envelope itself. The last element is the total number of points.
+	std::vector<int> starts;
+
+	int getCount(int item) const;
+	int getTotalCount() const {
+		return (int)this->times.size();
+	}
+	// Returns the index into the arrays for a point in an automation item.
+	int getIndex(int item, int point) const {
+		return this->starts[item + 1] + point;
+	}
+	bool isSelected(int index) const {
+		return this->selection[index / 64] & (uint64_t(1) << (index % 64));
+	}
+	// If max is given, counting stops once max is reached.
+	int countSelected(int max = -1) const;
+	// Like GetEnvelopePointByTimeEx: returns the last point at or before time
+	// (in envelope time), or -1 if there is none.
+	int findByTime(int item, double time) const;
+};
+
+const Snapshot& get(TrackEnvelope* envelope);
+// Call after changing the selection of a point with SetEnvelopePointEx.
+void setSelected(TrackEnvelope* envelope, int item, int point, bool selected);
+// Unselects all points in the envelope using the REAPER action, updating the
+// snapshot rather than rebuilding it.
+void clearSelection(TrackEnvelope* envelope);
+void invalidate();
+
+}
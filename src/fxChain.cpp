@@ -20,6 +20,7 @@
 #include <regex>
 #include <WDL/win32_utf8.h>
 #include "fxChain.h"
+#include "messageBuilder.h"
 #include "resource.h"
 #include "translation.h"
 
@@ -79,8 +80,11 @@ bool isFxListFocused() {
 		getFocusedFx();
 }
 
-void shortenFxName(const char* name, ostringstream& s) {
-	const regex RE_FX_NAME("^(\\w+): (.+?)( \\(.*?\\))?$");
+template<typename Stream>
+void shortenFxNameImpl(const char* name, Stream& s) {
+	// This is called for every effect when navigating tracks, so only compile
+	// the regex once.
+	static const regex RE_FX_NAME("^(\\w+): (.+?)( \\(.*?\\))?$");
 	cmatch m;
 	regex_search(name, m, RE_FX_NAME);
 	if (m.empty()) {
@@ -98,6 +102,14 @@ void shortenFxName(const char* name, ostringstream& s) {
 	}
 }
 
+void shortenFxName(const char* name, ostringstream& s) {
+	shortenFxNameImpl(name, s);
+}
+
+void shortenFxName(const char* name, MessageBuilder& s) {
+	shortenFxNameImpl(name, s);
+}
+
 #ifdef _WIN32
 
 bool maybeSwitchToFxPluginWindow() {
@@ -202,12 +214,9 @@ bool maybeReportFxChainBypass(bool delayed, bool aboutToToggle) {
 		}, 1000);
 		return true;
 	}
-	bool enabled;
-	if (take) {
-		enabled = TakeFX_GetEnabled(take, fx);
-	} else {
-		enabled = TrackFX_GetEnabled(track, fx);
-	}
+	// Querying a single effect is cheap, so don't build the whole tree.
+	bool enabled = take ? TakeFX_GetEnabled(take, fx) :
+		TrackFX_GetEnabled(track, fx);
 	if (aboutToToggle) {
 		enabled = !enabled;
 	}
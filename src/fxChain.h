@@ -11,6 +11,7 @@ bool getFocusedFx(MediaTrack** track = nullptr, MediaItem_Take** take = nullptr,
 	int* fx = nullptr);
 bool isFxListFocused();
 void shortenFxName(const char* name, std::ostringstream& s);
+void shortenFxName(const char* name, MessageBuilder& s);
 bool maybeSwitchToFxPluginWindow();
 bool maybeReportFxChainBypass(bool delayed, bool aboutToToggle=false);
 bool maybeOpenFxPresetDialog();
@@ -0,0 +1,186 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * FX tree code
+ * Copyright 2026 OSARA contributors
+ * License: GNU General Public License version 2.0
+ */
+
+#include <cstdlib>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include "fxTree.h"
+#include "trackTable.h"
+
+using namespace std;
+
+namespace fxTree {
+
+template<typename ReaperObj>
+int getCount(ReaperObj* obj) {
+	if constexpr (is_same_v<ReaperObj, MediaTrack>) {
+		return TrackFX_GetCount(obj);
+	} else {
+		return TakeFX_GetCount(obj);
+	}
+}
+
+template<typename ReaperObj>
+int getRecCount(ReaperObj* obj) {
+	if constexpr (is_same_v<ReaperObj, MediaTrack>) {
+		return TrackFX_GetRecCount(obj);
+	} else {
+		return 0;
+	}
+}
+
+// Incremented when the track list changes, which invalidates every track's
+// tree.
+int generation = 1;
+
+template<typename ReaperObj>
+bool isStale(ReaperObj* obj, const Tree& tree, bool needNested) {
+	// Renaming an effect or taking it offline isn't notified and doesn't change
+	// the number of effects, but it does change the project state. REAPER
+	// doesn't notify us about take FX changes at all.
+	return tree.generation != generation ||
+		tree.stateCount != GetProjectStateChangeCount(nullptr) ||
+		(needNested && !tree.hasNested) ||
+		tree.topCount != getCount(obj) || tree.recCount != getRecCount(obj);
+}
+
+template<typename ReaperObj>
+void addFx(ReaperObj* obj, Tree& tree, int index, int level,
+	int indexInContainer, bool isRec
+) {
+	Fx fx;
+	fx.index = index;
+	fx.level = level;
+	fx.indexInContainer = indexInContainer;
+	fx.isRec = isRec;
+	char buf[256] = "0";
+	if constexpr (is_same_v<ReaperObj, MediaTrack>) {
+		TrackFX_GetNamedConfigParm(obj, index, "container_count", buf, sizeof(buf));
+		fx.containedCount = atoi(buf);
+		fx.isEnabled = TrackFX_GetEnabled(obj, index);
+		buf[0] = '\0';
+		TrackFX_GetFXName(obj, index, buf, sizeof(buf));
+	} else {
+		TakeFX_GetNamedConfigParm(obj, index, "container_count", buf, sizeof(buf));
+		fx.containedCount = atoi(buf);
+		fx.isEnabled = TakeFX_GetEnabled(obj, index);
+		buf[0] = '\0';
+		TakeFX_GetFXName(obj, index, buf, sizeof(buf));
+	}
+	fx.name = buf;
+	tree.positions[index] = (int)tree.fx.size();
+	tree.fx.push_back(std::move(fx));
+}
+
+// Add the effects in a container, walking into any containers within it.
+// See the REAPER API documentation for TrackFX_GetParamName for details about
+// how effects inside containers are addressed.
+// containerIndex is the address used as the base for effects in this
+// container. For top level containers, this isn't the index of the container
+// itself.
+template<typename ReaperObj>
+void addContainer(ReaperObj* obj, Tree& tree, int containerIndex,
+	int containedCount, int multiplier, int level, bool isRec
+) {
+	for (int i = 0; i < containedCount; ++i) {
+		const int index = (i + 1) * multiplier + containerIndex;
+		addFx(obj, tree, index, level, i, isRec);
+		const int subCount = tree.fx.back().containedCount;
+		if (subCount) {
+			addContainer(obj, tree, index, subCount,
+				multiplier * (containedCount + 1), level + 1, isRec);
+		}
+	}
+}
+
+template<typename ReaperObj>
+void build(ReaperObj* obj, Tree& tree, bool nested) {
+	tree.fx.clear();
+	tree.positions.clear();
+	tree.generation = generation;
+	tree.stateCount = GetProjectStateChangeCount(nullptr);
+	tree.hasNested = nested;
+	tree.topCount = getCount(obj);
+	tree.recCount = getRecCount(obj);
+	auto addChain = [&](int count, bool isRec) {
+		const int recFlag = isRec ? 0x1000000 : 0;
+		for (int f = 0; f < count; ++f) {
+			addFx(obj, tree, recFlag + f, 1, f, isRec);
+			const int containedCount = tree.fx.back().containedCount;
+			if (nested && containedCount) {
+				addContainer(obj, tree, recFlag + 0x2000000 + f + 1, containedCount,
+					count + 1, 2, isRec);
+			}
+		}
+	};
+	addChain(tree.topCount, false);
+	addChain(tree.recCount, true);
+}
+
+// Used for tracks which aren't in the track table; e.g. tracks in other
+// projects. This is rebuilt on every call.
+Tree uncached;
+
+const Tree& get(MediaTrack* track, bool nested) {
+	trackTable::Entry* entry = trackTable::get(track);
+	if (entry && !entry->fx) {
+		entry->fx = make_unique<Tree>();
+	}
+	Tree& tree = entry ? *entry->fx : uncached;
+	if (!entry || isStale(track, tree, nested)) {
+		build(track, tree, nested);
+	}
+	return tree;
+}
+
+const Tree& get(MediaTrack* track) {
+	return get(track, true);
+}
+
+const Tree& getTopLevel(MediaTrack* track) {
+	return get(track, false);
+}
+
+// Takes are usually queried repeatedly for the same take, so we only cache
+// the last one.
+MediaItem_Take* cachedTake = nullptr;
+Tree takeTree;
+
+const Tree& get(MediaItem_Take* take, bool nested) {
+	if (take != cachedTake || isStale(take, takeTree, nested)) {
+		cachedTake = take;
+		build(take, takeTree, nested);
+	}
+	return takeTree;
+}
+
+const Tree& get(MediaItem_Take* take) {
+	return get(take, true);
+}
+
+const Tree& getTopLevel(MediaItem_Take* take) {
+	return get(take, false);
+}
+
+void onFxChainChange(MediaTrack* track) {
+	if (trackTable::Entry* entry = trackTable::get(track)) {
+		if (entry->fx) {
+			// Force a rebuild on the next lookup.
+			entry->fx->generation = 0;
+		}
+	}
+	// A take's FX chain might have changed too.
+	cachedTake = nullptr;
+}
+
+void onTrackListChange() {
+	++generation;
+	cachedTake = nullptr;
+}
+
+}
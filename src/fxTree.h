@@ -0,0 +1,81 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * FX tree header
+ * Copyright 2026 OSARA contributors
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "osara.h"
+
+// Caches the effects on a track or take, including effects nested in
+// containers, so that code which lists or reports effects doesn't need to
+// query REAPER for every effect each time. The tree for each track is stored in
+// the track table. A tree is rebuilt when REAPER reports that its FX chain
+// changed or the track list changed, or when the project state or its number
+// of effects changes. Walking containers is only done for callers that need nested
+// effects.
+namespace fxTree {
+
+struct Fx {
+	// The index to pass to the TrackFX_*/TakeFX_* functions. For effects inside
+	// containers, this is the addressed index; e.g. 0x2000000 + ....
+	int index;
+	// 1 for effects which aren't inside a container, 2 for effects inside a top
+	// level container, etc.
+	int level;
+	// The position (0 based) of this effect within its container or chain.
+	int indexInContainer;
+	// The number of effects in this container, or 0 if this isn't a container.
+	int containedCount;
+	// Whether this is an input FX or, for the master track, a monitoring FX.
+	bool isRec;
+	bool isEnabled;
+	// The full name as returned by TrackFX_GetFXName/TakeFX_GetFXName.
+	std::string name;
+};
+
+struct Tree {
+	// All effects in depth first order: each container is followed by the
+	// effects it contains. Input/monitoring effects come last.
+	std::vector<Fx> fx;
+	// The number of effects in the top level chain, excluding input/monitoring
+	// effects.
+	int topCount = 0;
+	int recCount = 0;
+	// Whether effects inside containers are included.
+	bool hasNested = false;
+	// The generation (see onTrackListChange) when this was built, or 0 if it
+	// must be rebuilt.
+	int generation = 0;
+	// The project state change count when this was built.
+	int stateCount = -1;
+	// Maps Fx::index to a position in fx.
+	std::unordered_map<int, int> positions;
+
+	// Returns the effect with a given index, or nullptr if there isn't one.
+	const Fx* find(int index) const {
+		auto it = this->positions.find(index);
+		return it != this->positions.end() ? &this->fx[it->second] : nullptr;
+	}
+};
+
+const Tree& get(MediaTrack* track);
+const Tree& get(MediaItem_Take* take);
+// Like get, but the tree might only include effects which aren't inside
+// containers. Use this when only those are needed, since walking containers
+// requires a query for every effect.
+const Tree& getTopLevel(MediaTrack* track);
+const Tree& getTopLevel(MediaItem_Take* take);
+// Called when REAPER reports that effects were added, removed, moved, enabled
+// or disabled on a track.
+void onFxChainChange(MediaTrack* track);
+// Called when tracks are added, removed or reordered, which also happens when
+// undoing.
+void onTrackListChange();
+
+}
@@ -0,0 +1,109 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Item index code
+ * Copyright 2026 OSARA contributors
+ * License: GNU General Public License version 2.0
+ */
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include "itemIndex.h"
+#include "trackTable.h"
+
+using namespace std;
+
+namespace itemIndex {
+
+bool isStale(MediaTrack* track, const TrackItems& cached) {
+	return cached.stateCount != GetProjectStateChangeCount(nullptr) ||
+		(int)cached.items.size() != CountTrackMediaItems(track);
+}
+
+// Used for tracks which aren't in the track table; e.g. tracks in other
+// projects. This is rebuilt on every call.
+TrackItems uncached;
+
+const TrackItems& get(MediaTrack* track) {
+	trackTable::Entry* entry = trackTable::get(track);
+	if (entry && !entry->items) {
+		entry->items = make_unique<TrackItems>();
+	}
+	TrackItems& cached = entry ? *entry->items : uncached;
+	if (entry && !isStale(track, cached)) {
+		return cached;
+	}
+	cached.stateCount = GetProjectStateChangeCount(nullptr);
+	cached.items.clear();
+	cached.starts.clear();
+	cached.ends.clear();
+	cached.maxLength = 0;
+	const int count = CountTrackMediaItems(track);
+	cached.items.reserve(count);
+	cached.starts.reserve(count);
+	cached.ends.reserve(count);
+	for (int i = 0; i < count; ++i) {
+		MediaItem* item = GetTrackMediaItem(track, i);
+		const double start = GetMediaItemInfo_Value(item, "D_POSITION");
+		const double length = GetMediaItemInfo_Value(item, "D_LENGTH");
+		cached.items.push_back(item);
+		cached.starts.push_back(start);
+		cached.ends.push_back(start + length);
+		cached.maxLength = max(cached.maxLength, length);
+	}
+	return cached;
+}
+
+int findItem(MediaTrack* track, double pos, int direction, int start) {
+	const auto& starts = get(track).starts;
+	const int count = (int)starts.size();
+	if (direction == 1) {
+		int i = (int)(lower_bound(starts.begin(), starts.end(), pos) - starts.begin());
+		i = max(i, start);
+		return i < count ? i : -1;
+	}
+	int i = (int)(upper_bound(starts.begin(), starts.end(), pos) - starts.begin()) - 1;
+	i = min(i, start);
+	return i >= 0 ? i : -1;
+}
+
+vector<int> findItemsAt(MediaTrack* track, double pos) {
+	const auto& trackItems = get(track);
+	const auto& starts = trackItems.starts;
+	// Only items starting within maxLength before pos can contain it.
+	auto first = lower_bound(starts.begin(), starts.end(),
+		pos - trackItems.maxLength);
+	auto end = upper_bound(first, starts.end(), pos);
+	vector<int> found;
+	for (auto it = first; it != end; ++it) {
+		const int i = (int)(it - starts.begin());
+		if (pos <= trackItems.ends[i]) {
+			found.push_back(i);
+		}
+	}
+	return found;
+}
+
+int getItemNumber(MediaTrack* track, MediaItem* item) {
+	const auto& trackItems = get(track);
+	const auto& starts = trackItems.starts;
+	const double start = GetMediaItemInfo_Value(item, "D_POSITION");
+	// Several items can start at the same position.
+	auto range = equal_range(starts.begin(), starts.end(), start);
+	for (auto it = range.first; it != range.second; ++it) {
+		const int i = (int)(it - starts.begin());
+		if (trackItems.items[i] == item) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+void markCurrent(MediaTrack* track) {
+	trackTable::Entry* entry = trackTable::get(track);
+	if (entry && entry->items) {
+		entry->items->stateCount = GetProjectStateChangeCount(nullptr);
+	}
+}
+
+}
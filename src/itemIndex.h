@@ -0,0 +1,44 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Item index header
+ * Copyright 2026 OSARA contributors
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <vector>
+#include "osara.h"
+
+// Caches the positions of the items on each track so that item navigation
+// can use a binary search rather than querying every item. The cache for each
+// track is stored in the track table.
+namespace itemIndex {
+
+// The items on a track in the order REAPER keeps them; i.e. sorted by start.
+struct TrackItems {
+	std::vector<MediaItem*> items;
+	std::vector<double> starts;
+	std::vector<double> ends;
+	// The length of the longest item, used to bound searches for items
+	// containing a position.
+	double maxLength = 0;
+	// The project state change count when this was built.
+	int stateCount = -1;
+};
+
+const TrackItems& get(MediaTrack* track);
+// Returns the number (0 based) of the first item in a given direction which
+// starts at or after (1) or at or before (-1) pos, beginning the search at
+// item number start. Returns -1 if there is no such item.
+int findItem(MediaTrack* track, double pos, int direction, int start);
+// Returns the numbers of the items containing pos.
+std::vector<int> findItemsAt(MediaTrack* track, double pos);
+// Returns the number (0 based) of an item on a track, or -1 if not found.
+int getItemNumber(MediaTrack* track, MediaItem* item);
+// An index becomes stale whenever the project changes. Call this after
+// OSARA itself made a change which didn't move any items on this track; e.g.
+// selecting items. This avoids rebuilding the index on the next lookup.
+void markCurrent(MediaTrack* track);
+
+}
@@ -0,0 +1,387 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Latency measurement code
+ * Copyright 2026 OSARA contributors
+ * License: GNU General Public License version 2.0
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "latency.h"
+#include "messageBuilder.h"
+#include "translation.h"
+
+using namespace std;
+
+namespace latency {
+
+bool isEnabled = false;
+
+// The stages of handling a command which we measure. All are measured from
+// the start of the command.
+enum Stage {
+	// Until REAPER finished running the action.
+	STAGE_ACTION,
+	// Until the first message was handed to the screen reader.
+	STAGE_OUTPUT,
+	// Until the command was completely handled.
+	STAGE_TOTAL,
+	STAGE_COUNT
+};
+
+// Bucket b counts durations in [2^b, 2^(b + 1)) microseconds, except that
+// bucket 0 also includes 0 and the last bucket has no upper bound.
+const int BUCKET_COUNT = 24;
+
+struct Histogram {
+	atomic<uint32_t> buckets[BUCKET_COUNT];
+	atomic<uint32_t> count;
+	atomic<uint32_t> max;
+	atomic<uint64_t> sum;
+
+	void add(uint32_t us) {
+		int bucket = 0;
+		for (uint32_t v = us >> 1; v && bucket < BUCKET_COUNT - 1; v >>= 1) {
+			++bucket;
+		}
+		this->buckets[bucket].fetch_add(1, memory_order_relaxed);
+		this->count.fetch_add(1, memory_order_relaxed);
+		this->sum.fetch_add(us, memory_order_relaxed);
+		uint32_t prevMax = this->max.load(memory_order_relaxed);
+		while (us > prevMax &&
+			!this->max.compare_exchange_weak(prevMax, us, memory_order_relaxed)) {
+		}
+	}
+
+	// Returns an upper bound for the given percentile, in microseconds.
+	uint32_t percentile(double fraction) const {
+		const uint32_t total = this->count.load(memory_order_relaxed);
+		const uint32_t target = (uint32_t)(total * fraction);
+		uint32_t seen = 0;
+		for (int b = 0; b < BUCKET_COUNT - 1; ++b) {
+			seen += this->buckets[b].load(memory_order_relaxed);
+			if (seen > target) {
+				return min((2u << b) - 1, this->max.load(memory_order_relaxed));
+			}
+		}
+		return this->max.load(memory_order_relaxed);
+	}
+
+	uint32_t mean() const {
+		const uint32_t total = this->count.load(memory_order_relaxed);
+		return total ? (uint32_t)(this->sum.load(memory_order_relaxed) / total) : 0;
+	}
+};
+
+// A fixed size hash table using linear probing, so recording never allocates
+// or locks. Slots are claimed by setting their key and are never released
+// until the measurements are reset.
+struct Slot {
+	atomic<uint64_t> key;
+	Histogram stages[STAGE_COUNT];
+};
+const size_t SLOT_COUNT = 256;
+Slot slots[SLOT_COUNT];
+// Measurements dropped because the table was full.
+atomic<uint32_t> dropped{0};
+
+// Used as the section for sources other than commands. Section ids are
+// stored in 31 bits.
+const int SOURCE_SECTION = 0x7FFFFFFF;
+
+uint64_t makeKey(int section, int command) {
+	// The top bit ensures a key is never 0, which marks an empty slot.
+	return 1ull << 63 | (uint64_t)(section & 0x7FFFFFFF) << 32 |
+		(uint32_t)command;
+}
+
+int getSection(uint64_t key) {
+	return (int)(key >> 32 & 0x7FFFFFFF);
+}
+
+int getCommand(uint64_t key) {
+	return (int)(uint32_t)key;
+}
+
+Slot* findSlot(uint64_t key) {
+	size_t s = (key ^ key >> 29) * 0x9E3779B97F4A7C15ull >> 56;
+	for (size_t probes = 0; probes < SLOT_COUNT; ++probes) {
+		Slot& slot = slots[s % SLOT_COUNT];
+		uint64_t slotKey = slot.key.load(memory_order_acquire);
+		if (slotKey == key) {
+			return &slot;
+		}
+		if (slotKey == 0 && slot.key.compare_exchange_strong(slotKey, key,
+				memory_order_acq_rel)) {
+			return &slot;
+		}
+		if (slotKey == key) {
+			// Another thread claimed this slot for the same key.
+			return &slot;
+		}
+		++s;
+	}
+	return nullptr;
+}
+
+void reset() {
+	for (Slot& slot: slots) {
+		slot.key.store(0, memory_order_relaxed);
+		for (Histogram& hist: slot.stages) {
+			for (auto& bucket: hist.buckets) {
+				bucket.store(0, memory_order_relaxed);
+			}
+			hist.count.store(0, memory_order_relaxed);
+			hist.max.store(0, memory_order_relaxed);
+			hist.sum.store(0, memory_order_relaxed);
+		}
+	}
+	dropped.store(0, memory_order_relaxed);
+}
+
+int64_t now() {
+	// steady_clock uses QueryPerformanceCounter on Windows and mach_absolute_time
+	// on Mac.
+	return chrono::duration_cast<chrono::microseconds>(
+		chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The innermost active scope.
+Scope* current = nullptr;
+
+Scope::Scope(Source source) {
+	if (isEnabled) {
+		this->begin(SOURCE_SECTION, source);
+	}
+}
+
+void Scope::begin(int section, int command) {
+	this->isActive = true;
+	this->key = makeKey(section, command);
+	this->parent = current;
+	current = this;
+	this->start = now();
+}
+
+void Scope::end() {
+	const int64_t end = now();
+	current = this->parent;
+	this->isActive = false;
+	if (!isEnabled) {
+		// Measurement was disabled while this was running.
+		return;
+	}
+	Slot* slot = findSlot(this->key);
+	if (!slot) {
+		dropped.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+	auto elapsed = [this](int64_t time) {
+		return (uint32_t)min<int64_t>(time - this->start, UINT32_MAX);
+	};
+	if (this->actionEnd) {
+		slot->stages[STAGE_ACTION].add(elapsed(this->actionEnd));
+	}
+	if (this->output) {
+		slot->stages[STAGE_OUTPUT].add(elapsed(this->output));
+	}
+	slot->stages[STAGE_TOTAL].add(elapsed(end));
+}
+
+void Scope::discard() {
+	if (!this->isActive) {
+		return;
+	}
+	current = this->parent;
+	this->isActive = false;
+}
+
+void markActionEnd() {
+	if (current) {
+		current->actionEnd = now();
+	}
+}
+
+void markOutput() {
+	if (current && !current->output) {
+		current->output = now();
+	}
+}
+
+struct StartupStage {
+	const char* name;
+	int64_t micros;
+};
+const int MAX_STARTUP_STAGES = 8;
+StartupStage startupStages[MAX_STARTUP_STAGES];
+int startupStageCount = 0;
+
+void recordStartupStage(const char* name, int64_t micros) {
+	if (startupStageCount < MAX_STARTUP_STAGES) {
+		startupStages[startupStageCount++] = {name, micros};
+	}
+}
+
+string getName(uint64_t key) {
+	const int section = getSection(key);
+	const int command = getCommand(key);
+	if (section == SOURCE_SECTION) {
+		switch (command) {
+			case SOURCE_SURFACE_RUN:
+				return "control surface Run";
+			case SOURCE_PEAK_WATCHER:
+				return "Peak Watcher tick";
+			case SOURCE_WIN_EVENT:
+				return "WinEvent";
+		}
+	}
+	KbdSectionInfo* sectionInfo = SectionFromUniqueID(section);
+	const char* name = sectionInfo ? getActionName(command, sectionInfo, false) :
+		nullptr;
+	if (name && name[0]) {
+		return name;
+	}
+	return to_string(section) + ":" + to_string(command);
+}
+
+// Returns the used slots, slowest (by total time spent) first.
+vector<const Slot*> getUsedSlots() {
+	vector<const Slot*> used;
+	for (const Slot& slot: slots) {
+		if (slot.key.load(memory_order_acquire) &&
+				slot.stages[STAGE_TOTAL].count.load(memory_order_relaxed)) {
+			used.push_back(&slot);
+		}
+	}
+	sort(used.begin(), used.end(), [](const Slot* s1, const Slot* s2) {
+		return s1->stages[STAGE_TOTAL].sum.load(memory_order_relaxed) >
+			s2->stages[STAGE_TOTAL].sum.load(memory_order_relaxed);
+	});
+	return used;
+}
+
+bool exportCsv(const string& path, const vector<const Slot*>& used) {
+#ifdef _WIN32
+	// See the comment in initTranslation about wide paths.
+	ofstream out(widen(path));
+#else
+	ofstream out(path);
+#endif
+	if (!out) {
+		return false;
+	}
+	out << "section,command,name,stage,count,mean_us,p50_us,p95_us,max_us";
+	for (int b = 0; b < BUCKET_COUNT - 1; ++b) {
+		out << ",lt" << (2ull << b) << "us";
+	}
+	// The last bucket has no upper bound.
+	out << ",ge" << (1ull << (BUCKET_COUNT - 1)) << "us";
+	out << "\n";
+	static const char* STAGE_NAMES[STAGE_COUNT] = {"action", "output", "total"};
+	for (const Slot* slot: used) {
+		const uint64_t key = slot->key.load(memory_order_relaxed);
+		string name = getName(key);
+		// Quote the name, since action names often contain commas.
+		string quoted = "\"";
+		for (char c: name) {
+			if (c == '"') {
+				quoted += '"';
+			}
+			quoted += c;
+		}
+		quoted += '"';
+		for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+			const Histogram& hist = slot->stages[stage];
+			if (!hist.count.load(memory_order_relaxed)) {
+				continue;
+			}
+			out << getSection(key) << "," << getCommand(key) <<
+				"," << quoted << "," << STAGE_NAMES[stage] << "," <<
+				hist.count.load(memory_order_relaxed) << "," << hist.mean() << "," <<
+				hist.percentile(0.5) << "," << hist.percentile(0.95) << "," <<
+				hist.max.load(memory_order_relaxed);
+			for (const auto& bucket: hist.buckets) {
+				out << "," << bucket.load(memory_order_relaxed);
+			}
+			out << "\n";
+		}
+	}
+	return !!out;
+}
+
+void cmdToggleLatencyMeasurement(Command* command) {
+	isEnabled = !isEnabled;
+	if (isEnabled) {
+		// Start with fresh measurements.
+		reset();
+		// Translators: Reported when the OSARA: Toggle latency measurement action
+		// enables measurement.
+		outputMessage(translate("latency measurement on"));
+	} else {
+		// Translators: Reported when the OSARA: Toggle latency measurement action
+		// disables measurement.
+		outputMessage(translate("latency measurement off"));
+	}
+}
+
+void cmdReportLatency(Command* command) {
+	const vector<const Slot*> used = getUsedSlots();
+	if (used.empty() && startupStageCount == 0) {
+		// Translators: Reported by the OSARA: Report latency measurements action
+		// when nothing has been measured.
+		outputMessage(translate("no latency measurements"));
+		return;
+	}
+	string path(GetResourcePath());
+	path += "/osara_latency.csv";
+	const bool exported = exportCsv(path, used);
+	// The summary is diagnostic output for developers, so it isn't translated.
+	MessageBuilder s;
+	s << "Times in ms: mean, 95th percentile, maximum. Action is the REAPER "
+		"action, output is when the first message was spoken.\r\n";
+	if (exported) {
+		s << "Full results exported to " << path << "\r\n";
+	} else {
+		s << "Couldn't export results to " << path << "\r\n";
+	}
+	if (const uint32_t d = dropped.load(memory_order_relaxed)) {
+		s << d << " measurements dropped because the table was full\r\n";
+	}
+	s << "\r\n";
+	if (startupStageCount > 0) {
+		s << "Startup:";
+		for (int i = 0; i < startupStageCount; ++i) {
+			s.format(" {} {:.2f}{}", startupStages[i].name,
+				startupStages[i].micros / 1000.0,
+				i + 1 < startupStageCount ? "," : "");
+		}
+		s << "\r\n\r\n";
+	}
+	for (const Slot* slot: used) {
+		s << getName(slot->key.load(memory_order_relaxed)) << ": ";
+		const Histogram& total = slot->stages[STAGE_TOTAL];
+		s.format("{} calls, total {:.2f}, {:.2f}, {:.2f}",
+			total.count.load(memory_order_relaxed), total.mean() / 1000.0,
+			total.percentile(0.95) / 1000.0,
+			total.max.load(memory_order_relaxed) / 1000.0);
+		const Histogram& action = slot->stages[STAGE_ACTION];
+		if (action.count.load(memory_order_relaxed)) {
+			s.format("; action {:.2f}, {:.2f}", action.mean() / 1000.0,
+				action.percentile(0.95) / 1000.0);
+		}
+		const Histogram& output = slot->stages[STAGE_OUTPUT];
+		if (output.count.load(memory_order_relaxed)) {
+			s.format("; output {:.2f}, {:.2f}", output.mean() / 1000.0,
+				output.percentile(0.95) / 1000.0);
+		}
+		s << "\r\n";
+	}
+	// Translators: The title of the dialog showing latency measurements.
+	reviewMessage(translate("OSARA Latency Measurements"), s.str().c_str());
+}
+
+}
@@ -0,0 +1,84 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Latency measurement header
+ * Copyright 2026 OSARA contributors
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include "osara.h"
+
+// Optional measurement of how long OSARA takes to handle commands and
+// callbacks, so that slow paths can be found and reported with numbers. This
+// is off by default and is enabled with an action. While enabled, the time
+// taken by each command is recorded in a histogram for that command.
+namespace latency {
+
+// Sources of work other than commands. These are recorded as if they were
+// commands in a pseudo section so that they can share the same table.
+enum Source {
+	SOURCE_SURFACE_RUN,
+	SOURCE_PEAK_WATCHER,
+	SOURCE_WIN_EVENT,
+	SOURCE_COUNT
+};
+
+extern bool isEnabled;
+
+int64_t now();
+
+// Measures the time from construction until destruction. Scopes may be
+// nested; e.g. a WinEvent might be handled while a command is running.
+class Scope {
+	public:
+	Scope(int section, int command) {
+		if (isEnabled) {
+			this->begin(section, command);
+		}
+	}
+
+	Scope(Source source);
+
+	~Scope() {
+		if (this->isActive) {
+			this->end();
+		}
+	}
+
+	// Called when the measured work turns out not to be interesting; e.g. a
+	// command OSARA doesn't handle.
+	void discard();
+
+	private:
+	void begin(int section, int command);
+	void end();
+
+	bool isActive = false;
+	uint64_t key;
+	int64_t start;
+	int64_t actionEnd = 0;
+	int64_t output = 0;
+	Scope* parent;
+
+	friend void markActionEnd();
+	friend void markOutput();
+};
+
+// Called when REAPER has finished running the action for the current command.
+// The time after this is attributed to OSARA's post handler.
+void markActionEnd();
+// Called when a message is handed to the screen reader.
+void markOutput();
+
+// Records the time taken by a stage of OSARA's startup. These are always
+// recorded, since startup only happens once, and are included in the report.
+// name must remain valid for the life of the plugin.
+void recordStartupStage(const char* name, int64_t micros);
+
+void cmdToggleLatencyMeasurement(Command* command);
+void cmdReportLatency(Command* command);
+
+}
@@ -0,0 +1,153 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Marker index code
+ * Copyright 2026 OSARA contributors
+ * License: GNU General Public License version 2.0
+ */
+
+#include <algorithm>
+#include <vector>
+#include "markerIndex.h"
+
+using namespace std;
+
+namespace markerIndex {
+
+// Both sorted by start.
+vector<Marker> markers;
+vector<Marker> regions;
+// Indexes into regions, sorted by end.
+vector<int> regionsByEnd;
+// The length of the longest region, used to bound searches for regions
+// containing a position.
+double maxRegionLength = 0;
+
+ReaProject* cachedProject = nullptr;
+int cachedStateCount = -1;
+int cachedCount = -1;
+
+void update() {
+	ReaProject* project = EnumProjects(-1, nullptr, 0);
+	const int stateCount = GetProjectStateChangeCount(project);
+	const int count = CountProjectMarkers(project, nullptr, nullptr);
+	if (project == cachedProject && stateCount == cachedStateCount &&
+			count == cachedCount) {
+		return;
+	}
+	cachedProject = project;
+	cachedStateCount = stateCount;
+	cachedCount = count;
+	markers.clear();
+	regions.clear();
+	regionsByEnd.clear();
+	maxRegionLength = 0;
+	for (int i = 0; i < count; ++i) {
+		Marker marker{i};
+		const char* name = nullptr;
+		if (!EnumProjectMarkers(i, &marker.isRegion, &marker.start, &marker.end,
+				&name, &marker.number)) {
+			break;
+		}
+		if (name) {
+			marker.name = name;
+		}
+		if (marker.isRegion) {
+			maxRegionLength = max(maxRegionLength, marker.end - marker.start);
+			regions.push_back(std::move(marker));
+		} else {
+			markers.push_back(std::move(marker));
+		}
+	}
+	// REAPER enumerates markers in order of position, but we rely on this for
+	// binary searches, so make sure.
+	auto compareStart = [](const Marker& m1, const Marker& m2) {
+		return m1.start < m2.start;
+	};
+	stable_sort(markers.begin(), markers.end(), compareStart);
+	stable_sort(regions.begin(), regions.end(), compareStart);
+	regionsByEnd.resize(regions.size());
+	for (int r = 0; r < (int)regions.size(); ++r) {
+		regionsByEnd[r] = r;
+	}
+	stable_sort(regionsByEnd.begin(), regionsByEnd.end(), [](int r1, int r2) {
+		return regions[r1].end < regions[r2].end;
+	});
+}
+
+// Returns an iterator to the first marker in a list starting after pos.
+vector<Marker>::const_iterator firstStartingAfter(const vector<Marker>& list,
+	double pos
+) {
+	return upper_bound(list.cbegin(), list.cend(), pos,
+		[](double pos, const Marker& marker) { return pos < marker.start; });
+}
+
+const Marker* findLastMarker(double pos) {
+	update();
+	auto it = firstStartingAfter(markers, pos);
+	if (it == markers.cbegin()) {
+		return nullptr;
+	}
+	return &*(it - 1);
+}
+
+const Marker* findRegion(double pos) {
+	update();
+	// Walk backwards from the last region starting at or before pos, so the
+	// first containing region we find is the one starting nearest to pos.
+	for (auto it = firstStartingAfter(regions, pos); it != regions.cbegin();) {
+		--it;
+		if (it->start < pos - maxRegionLength) {
+			break;
+		}
+		if (pos < it->end) {
+			return &*it;
+		}
+	}
+	return nullptr;
+}
+
+// Used to compare a position with the end of a region in regionsByEnd.
+struct CompareRegionEnd {
+	bool operator() (int region, double pos) const { return regions[region].end < pos; }
+	bool operator() (double pos, int region) const { return pos < regions[region].end; }
+};
+
+const Marker* findRegionEndingAt(double pos) {
+	update();
+	auto range = equal_range(regionsByEnd.cbegin(), regionsByEnd.cend(), pos,
+		CompareRegionEnd{});
+	const Marker* found = nullptr;
+	for (auto it = range.first; it != range.second; ++it) {
+		const Marker& region = regions[*it];
+		if (!found || region.start > found->start) {
+			found = &region;
+		}
+	}
+	return found;
+}
+
+vector<const Marker*> findRegionsContaining(double pos) {
+	update();
+	auto first = lower_bound(regions.cbegin(), regions.cend(),
+		pos - maxRegionLength,
+		[](const Marker& region, double pos) { return region.start < pos; });
+	auto end = firstStartingAfter(regions, pos);
+	vector<const Marker*> found;
+	for (auto it = first; it < end; ++it) {
+		if (pos <= it->end) {
+			found.push_back(&*it);
+		}
+	}
+	return found;
+}
+
+const Marker* findByNumber(int number, bool isRegion) {
+	update();
+	const auto& list = isRegion ? regions : markers;
+	auto it = find_if(list.cbegin(), list.cend(),
+		[number](const Marker& marker) { return marker.number == number; });
+	return it != list.cend() ? &*it : nullptr;
+}
+
+}
@@ -0,0 +1,44 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Marker index header
+ * Copyright 2026 OSARA contributors
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "osara.h"
+
+// Caches the markers and regions in the current project so that lookups by
+// position don't need to enumerate them via the REAPER API every time.
+// The index is rebuilt when the project or its markers change.
+// Pointers returned by these functions are only valid until the index is next
+// rebuilt; i.e. until the next call after the project changes.
+namespace markerIndex {
+
+struct Marker {
+	// The index to pass to EnumProjectMarkers.
+	int index;
+	bool isRegion;
+	double start;
+	double end;
+	int number;
+	std::string name;
+};
+
+// Returns the last marker at or before pos, like GetLastMarkerAndCurRegion.
+const Marker* findLastMarker(double pos);
+// Returns the region containing pos which starts nearest to it, like
+// GetLastMarkerAndCurRegion. A region doesn't contain its end position.
+const Marker* findRegion(double pos);
+// Returns the region ending at pos. If several do, the one which starts last
+// is returned.
+const Marker* findRegionEndingAt(double pos);
+// Returns all regions which contain pos, including regions ending at pos, in
+// order of their start.
+std::vector<const Marker*> findRegionsContaining(double pos);
+const Marker* findByNumber(int number, bool isRegion);
+
+}
@@ -0,0 +1,98 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Message builder header
+ * Copyright 2026 OSARA contributors
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <concepts>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+// Builds a message to be reported. This is used instead of ostringstream in
+// frequently used code paths. Typical messages fit in the inline buffer, so
+// building a message doesn't allocate, and outputMessage can take the text
+// without copying it into a temporary string.
+class MessageBuilder {
+	public:
+	MessageBuilder& operator<<(std::string_view text) {
+		this->buffer.append(text);
+		return *this;
+	}
+
+	MessageBuilder& operator<<(const char* text) {
+		if (text) {
+			this->buffer.append(std::string_view(text));
+		}
+		return *this;
+	}
+
+	MessageBuilder& operator<<(const std::string& text) {
+		this->buffer.append(text);
+		return *this;
+	}
+
+	MessageBuilder& operator<<(char c) {
+		this->buffer.push_back(c);
+		return *this;
+	}
+
+	// bool is excluded because ostream would write it as a number, which is
+	// almost certainly not what the caller wants.
+	template<std::integral T> requires (!std::same_as<T, bool>)
+	MessageBuilder& operator<<(T value) {
+		fmt::format_to(std::back_inserter(this->buffer), "{}", value);
+		return *this;
+	}
+
+	// Formatted the same way as ostream's default; i.e. %g.
+	MessageBuilder& operator<<(double value) {
+		fmt::format_to(std::back_inserter(this->buffer), "{:g}", value);
+		return *this;
+	}
+
+	// Append a formatted string. Unlike s << format(...), this doesn't create a
+	// temporary string. Like format in translation.h, errors in (translated)
+	// format strings are reported rather than crashing.
+	template<typename... Args>
+	MessageBuilder& format(std::string_view formatStr, Args&&... args) {
+		const size_t oldSize = this->buffer.size();
+		try {
+			fmt::vformat_to(std::back_inserter(this->buffer), formatStr,
+				fmt::make_format_args(args...));
+		} catch (fmt::format_error) {
+			this->buffer.resize(oldSize);
+			fmt::format_to(std::back_inserter(this->buffer),
+				"error in format string: {}", formatStr);
+		}
+		return *this;
+	}
+
+	bool empty() const {
+		return this->buffer.size() == 0;
+	}
+
+	size_t size() const {
+		return this->buffer.size();
+	}
+
+	void clear() {
+		this->buffer.clear();
+	}
+
+	std::string_view view() const {
+		return std::string_view(this->buffer.data(), this->buffer.size());
+	}
+
+	std::string str() const {
+		return std::string(this->buffer.data(), this->buffer.size());
+	}
+
+	private:
+	fmt::basic_memory_buffer<char, 256> buffer;
+};
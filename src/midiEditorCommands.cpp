@@ -6,20 +6,25 @@
  */
 
 #include <string>
+#include <cstring>
 #include <sstream>
 #include <vector>
 #include <algorithm>
 #include <map>
+#include <unordered_map>
 #include <cassert>
 #include <functional>
 #include <float.h>
 #include <compare>
+#include <numeric>
+#include <atomic>
 #include<regex>
 #include<string_view>
 #include "midiEditorCommands.h"
 #include "osara.h"
 #include "config.h"
 #include "translation.h"
+#include "itemIndex.h"
 #ifdef _WIN32
 #include <Commctrl.h>
 #endif
@@ -27,34 +32,65 @@
 using namespace std;
 using namespace fmt::literals;
 
-// returns the pulses per quarter note of the first midi source in the item.
-int getItemPPQ(MediaItem* item) {
+struct FreeReaperPtr {
+	void operator()(void* p) {
+		FreeHeapPtr(p);
+	}
+};
+
+// Timing information for a take which is expensive to fetch, cached so that
+// reporting positions in ticks doesn't need to fetch it every time.
+struct TakeTiming {
+	// The cached information is only valid for this source. Gluing, pooling
+	// changes, etc. replace the source.
+	PCM_source* source;
+	int ppq;
+};
+unordered_map<MediaItem_Take*, TakeTiming> takeTimingCache;
+// Takes are only added when positions are reported in the MIDI editor, so this
+// stays small, but don't let it grow without bound.
+const size_t MAX_TAKE_TIMING_CACHE = 64;
+
+// Returns the pulses per quarter note of the take's MIDI source. This is read
+// from the HASDATA line of the source in the item's state, which follows the
+// take's GUID. getTakePPQ caches this until the take's source changes.
+int fetchTakePPQ(MediaItem_Take* take) {
 	const int defaultPPQ = 960;
-	static MediaItem* cachedItem;
-	static int cachedPPQ;
-	if(item == cachedItem) {
-		return cachedPPQ;
+	char guid[64] = "";
+	if (!GetSetMediaItemTakeInfo_String(take, "GUID", guid, false)) {
+		return defaultPPQ;
+	}
+	MediaItem* item = GetMediaItemTake_Item(take);
+	unique_ptr<char, FreeReaperPtr> state(GetSetObjectState(item, ""));
+	if (!state) {
+		return defaultPPQ;
 	}
-	char buff[4096] = "";
-	if(!GetItemStateChunk(item, buff, sizeof(buff), false)) {
+	const char* takeState = strstr(state.get(), guid);
+	if (!takeState) {
 		return defaultPPQ;
 	}
-	static const regex re("^\\s*HASDATA [0-9]+ ([0-9]+) ");
+	// The first HASDATA after the GUID belongs to this take's source.
+	static const regex re("HASDATA [0-9]+ ([0-9]+) ");
 	cmatch match;
-	if(!regex_search(buff, match, re)) {
+	if (!regex_search(takeState, match, re)) {
 		return defaultPPQ;
 	}
-	int ppq = stoi(match.str(1));
-	cachedPPQ = ppq;
-	cachedItem = item;
-	return ppq;
+	return stoi(match.str(1));
 }
 
-struct FreeReaperPtr {
-	void operator()(void* p) {
-		FreeHeapPtr(p);
+int getTakePPQ(MediaItem_Take* take) {
+	PCM_source* source = GetMediaItemTake_Source(take);
+	auto it = takeTimingCache.find(take);
+	if (it != takeTimingCache.end() && it->second.source == source) {
+		return it->second.ppq;
 	}
-};
+	if (takeTimingCache.size() >= MAX_TAKE_TIMING_CACHE) {
+		takeTimingCache.clear();
+	}
+	const int ppq = fetchTakePPQ(take);
+	takeTimingCache[take] = {source, ppq};
+	return ppq;
+}
 
 // return the midi editor zoom ratio of the take
 double getMidiZoomRatio(MediaItem_Take* take) {
@@ -150,15 +186,26 @@ struct MidiControlChange {
 		}
 		return cc;
 	}
+} ;
 
-	static const int getCount(MediaItem_Take* take) {
-		int count = 0;
-		while (MIDI_GetCC(take, count, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr)) {
-			++count;
-		}
-		return count;
+// Returns the number REAPER uses for the CC lane displaying a given CC event,
+// or -1 if it isn't displayed in a lane we support.
+// This matches the last_clicked_cc_lane MIDI editor setting, except that 14 bit
+// CC lanes are reported using the number of their MSB CC.
+int getCCLane(const MidiControlChange& cc) {
+	switch (cc.message1) {
+		case 0xB0:
+			return cc.message2;
+		case 0xC0:
+			return 0x202;
+		case 0xD0:
+			return 0x203;
+		case 0xE0:
+			return 0x201;
+		default:
+			return -1;
 	}
-} ;
+}
 
 const UINT DEFAULT_PREVIEW_LENGTH = 300; // ms
 
@@ -223,14 +270,223 @@ struct MidiNote {
 		}
 		return note;
 	}
+};
+
+// Incremented whenever a command starts, since a command (including REAPER
+// actions run by OSARA commands) might change the MIDI in a take.
+int midiCommandCount = 0;
+
+// A copy of the notes and CCs in a take.
+// Fetching events from REAPER one at a time is slow for large takes, so we
+// copy them once and reuse the copy until the MIDI data in the take changes.
+// Because MIDI positions are converted to project time, the copy is also
+// refreshed whenever the project changes; e.g. when the tempo changes.
+class MidiTakeSnapshot {
+	public:
+	// A group of notes which start at the same time.
+	struct Chord {
+		double start;
+		int firstNote;
+		int noteCount;
+
+		// Used to compare a position with the start of a chord.
+		struct CompareByStart {
+			bool operator() (const Chord& chord, double pos) const { return chord.start < pos; }
+			bool operator() (double pos, const Chord& chord) const { return pos < chord.start; }
+		};
+	};
+
+	vector<MidiNote> notes;
+	vector<MidiControlChange> ccs;
+	// The CCs in each CC lane, keyed by lane number (see getCCLane).
+	map<int, vector<MidiControlChange>> ccLanes;
+	vector<Chord> chords;
+	// The indexes of the notes in each chord, ordered by pitch.
+	// The entries for a chord begin at the chord's firstNote.
+	vector<int> notesByPitch;
+
+	bool isCurrent(MediaItem_Take* take) const {
+		if (take != this->take) {
+			return false;
+		}
+		// Hashing the take's MIDI isn't free, so only do it once per command.
+		if (isHandlingCommand && this->validatedCommand == midiCommandCount) {
+			return true;
+		}
+		if (GetProjectStateChangeCount(nullptr) != this->stateCount ||
+				getHash(take) != this->hash) {
+			return false;
+		}
+		this->validatedCommand = midiCommandCount;
+		return true;
+	}
+
+	void update(MediaItem_Take* take) {
+		this->take = take;
+		this->notes.clear();
+		this->ccs.clear();
+		this->ccLanes.clear();
+		this->chords.clear();
+		this->notesByPitch.clear();
+		this->refreshKey();
+		if (!take) {
+			return;
+		}
+		int noteCount = 0;
+		int ccCount = 0;
+		MIDI_CountEvts(take, &noteCount, &ccCount, nullptr);
+		this->notes.reserve(noteCount);
+		for (int n = 0; n < noteCount; ++n) {
+			this->notes.push_back(MidiNote::get(take, n, {
+				true,  // start
+				true,  // end
+				true,  // channel
+				true,  // pitch
+				true,  // velocity
+				true,  // selected
+				true  // muted
+			}));
+		}
+		this->buildChords();
+		this->ccs.reserve(ccCount);
+		for (int c = 0; c < ccCount; ++c) {
+			this->ccs.push_back(MidiControlChange::get(take, c, {
+				true,  // position
+				true,  // message1
+				true,  // channel
+				true,  // message2
+				true,  // message3
+				true,  // selected
+				true  // muted
+			}));
+			const auto& cc = this->ccs.back();
+			const int lane = getCCLane(cc);
+			if (lane != -1) {
+				this->ccLanes[lane].push_back(cc);
+			}
+		}
+	}
+
+	// Called after OSARA itself changed the take and patched the snapshot to
+	// match, so that the snapshot remains valid.
+	void refreshKey() {
+		this->stateCount = GetProjectStateChangeCount(nullptr);
+		this->hash = getHash(this->take);
+		this->validatedCommand = midiCommandCount;
+	}
+
+	void setNoteSelected(MediaItem_Take* take, int index, bool select) {
+		if (take == this->take && 0 <= index && index < (int)this->notes.size()) {
+			this->notes[index].selected = select;
+		}
+	}
 
-	static const int getCount(MediaItem_Take* take) {
-		int count = 0;
-		while (MIDI_GetNote(take, count, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr)) {
-			++count;
+	void setCCSelected(MediaItem_Take* take, int index, bool select) {
+		if (take != this->take || index < 0 || index >= (int)this->ccs.size()) {
+			return;
+		}
+		this->ccs[index].selected = select;
+		auto lane = this->ccLanes.find(getCCLane(this->ccs[index]));
+		if (lane == this->ccLanes.end()) {
+			return;
+		}
+		// CCs are added to lanes in index order.
+		auto cc = lower_bound(lane->second.begin(), lane->second.end(), index,
+			[](const MidiControlChange& cc, int index) { return cc.index < index; });
+		if (cc != lane->second.end() && cc->index == index) {
+			cc->selected = select;
+		}
+	}
+
+	void clearSelection(MediaItem_Take* take) {
+		if (take != this->take) {
+			return;
+		}
+		for (auto& note: this->notes) {
+			note.selected = false;
+		}
+		for (auto& cc: this->ccs) {
+			cc.selected = false;
+		}
+		for (auto& [lane, ccs]: this->ccLanes) {
+			for (auto& cc: ccs) {
+				cc.selected = false;
+			}
 		}
-		return count;
 	}
+
+	static string getHash(MediaItem_Take* take) {
+		char hash[64] = "";
+		if (!take || !MIDI_GetHash(take, false, hash, sizeof(hash))) {
+			return {};
+		}
+		return hash;
+	}
+
+	private:
+	void buildChords() {
+		const int noteCount = (int)this->notes.size();
+		for (int n = 0; n < noteCount;) {
+			const int first = n;
+			const double start = this->notes[n].start;
+			while (n < noteCount && this->notes[n].start == start) {
+				++n;
+			}
+			this->chords.push_back({start, first, n - first});
+		}
+		// Notes at the same position are ordered arbitrarily.
+		// This is not intuitive, so order them by pitch.
+		this->notesByPitch.resize(noteCount);
+		iota(this->notesByPitch.begin(), this->notesByPitch.end(), 0);
+		for (const auto& chord: this->chords) {
+			if (chord.noteCount < 2) {
+				continue;
+			}
+			auto first = this->notesByPitch.begin() + chord.firstNote;
+			stable_sort(first, first + chord.noteCount, [this](int note1, int note2) {
+				return MidiNote::compareByPitch(this->notes[note1], this->notes[note2]);
+			});
+		}
+	}
+
+	MediaItem_Take* take = nullptr;
+	string hash;
+	int stateCount = -1;
+	// The value of midiCommandCount when the snapshot was last known to be
+	// current.
+	mutable int validatedCommand = -1;
+};
+
+MidiTakeSnapshot midiSnapshot;
+
+void onMidiCommand() {
+	++midiCommandCount;
+}
+
+const MidiTakeSnapshot& getMidiSnapshot(MediaItem_Take* take) {
+	if (!midiSnapshot.isCurrent(take)) {
+		midiSnapshot.update(take);
+	}
+	return midiSnapshot;
+}
+
+// When OSARA changes the selection in a take itself (e.g. when moving to a
+// chord), the snapshot is patched to match. Creating one of these before such a
+// change keeps the snapshot valid afterwards, rather than rebuilding it on the
+// next lookup. This only happens if the snapshot was current beforehand.
+class MidiSnapshotUpdate {
+	public:
+	MidiSnapshotUpdate(MediaItem_Take* take):
+		wasCurrent(midiSnapshot.isCurrent(take)) {}
+
+	~MidiSnapshotUpdate() {
+		if (this->wasCurrent) {
+			midiSnapshot.refreshKey();
+		}
+	}
+
+	private:
+	bool wasCurrent;
 };
 
 struct MidiEventListData { 
@@ -256,8 +512,7 @@ struct MidiEventListData {
 		char eventData[255] = "\0";
 		if (MIDIEditor_GetSetting_str(editor, setting.c_str(), eventData, sizeof(eventData))) {
 			MediaItem_Take* take = MIDIEditor_GetTake (editor);
-			MediaItem* item = GetMediaItemTake_Item(take);
-			int ppq = getItemPPQ(item);
+			int ppq = getTakePPQ(take);
 			string key, val;
 			istringstream s(eventData);
 			double eventPosPpq = -1.0;
@@ -304,12 +559,74 @@ struct MidiEventListData {
 	}
 } ;
 
-vector<MidiNote> previewingNotes; // Notes currently being previewed.
+// Notes currently being previewed. Space is reserved when preview is
+// initialised, so this doesn't allocate while previewing.
+vector<MidiNote> previewingNotes;
+const size_t MAX_PREVIEW_NOTES = 128;
+// Used to stop the preview once all notes are off.
 CallLater previewDoneLater;
 const int MIDI_NOTE_ON = 0x90;
 const int MIDI_NOTE_OFF = 0x80;
 
+// A request from the main thread to the audio thread.
+struct PreviewCommand {
+	enum Type {
+		// Send a note on now and a note off after length seconds.
+		NOTE_ON,
+		// Send a note off now.
+		NOTE_OFF,
+		// Forget any scheduled note offs without sending them.
+		CANCEL_NOTES_OFF,
+	} type;
+	unsigned char status;
+	unsigned char pitch;
+	unsigned char velocity;
+	double length;
+};
+
+// A fixed size queue to pass commands from the main thread to the audio
+// thread without locking or allocating.
+class PreviewCommandQueue {
+	public:
+	// Called on the main thread only.
+	bool push(const PreviewCommand& command) {
+		const size_t tail = this->tail.load(memory_order_relaxed);
+		const size_t next = (tail + 1) % SIZE;
+		if (next == this->head.load(memory_order_acquire)) {
+			return false; // Full.
+		}
+		this->commands[tail] = command;
+		this->tail.store(next, memory_order_release);
+		return true;
+	}
+
+	// Called on the audio thread only.
+	bool pop(PreviewCommand& command) {
+		const size_t head = this->head.load(memory_order_relaxed);
+		if (head == this->tail.load(memory_order_acquire)) {
+			return false; // Empty.
+		}
+		command = this->commands[head];
+		this->head.store((head + 1) % SIZE, memory_order_release);
+		return true;
+	}
+
+	bool isEmpty() {
+		return this->head.load(memory_order_acquire) ==
+			this->tail.load(memory_order_acquire);
+	}
+
+	private:
+	static constexpr size_t SIZE = 256;
+	PreviewCommand commands[SIZE];
+	atomic<size_t> head = 0;
+	atomic<size_t> tail = 0;
+};
+
 // A minimal PCM_source to send MIDI events for preview.
+// The preview loops for as long as notes are being previewed, so note offs
+// are sent by the audio thread at the right time, rather than relying on a
+// timer on the main thread.
 class PreviewSource : public PCM_source {
 	public:
 	
@@ -319,9 +636,13 @@ class PreviewSource : public PCM_source {
 	virtual ~PreviewSource() {
 	}
 
-	// The events to send.
-	// These will be consumed (and the vector cleared) soon after PlayTrackPreview is called.
-	vector<MIDI_event_t> events;
+	PreviewCommandQueue commands;
+
+	// Whether there's nothing left for the audio thread to do.
+	bool isIdle() {
+		return this->commands.isEmpty() &&
+			this->scheduledCount.load(memory_order_acquire) == 0;
+	}
 
 	bool SetFileName(const char* fn) {
 		return false;
@@ -348,23 +669,66 @@ class PreviewSource : public PCM_source {
 	}
 
 	double GetLength() {
-		// This only needs to be long enough to send MIDI events immediately.
-		// Once we send note on events, the notes stay on, even though the preview stops.
-		// We then play another preview with more events to turn the notes off.
-		return 0.001;
+		// The preview loops until we stop it, so this just needs to be long
+		// enough that it doesn't wrap often.
+		return 3600.0;
 	}
 
 	int PropertiesWindow(HWND parent) {
 		return -1;
 	}
 
+	// Called on the audio thread.
 	void GetSamples(PCM_source_transfer_t* block) {
 		block->samples_out=0;
-		if (block->midi_events) {
-			for (auto event = this->events.begin(); event != this->events.end(); ++event)
-				block->midi_events->AddItem(&*event);
-			this->events.clear();
+		if (!block->midi_events || block->samplerate <= 0) {
+			return;
+		}
+		auto send = [block](unsigned char status, unsigned char pitch,
+			unsigned char velocity, int frame
+		) {
+			MIDI_event_t event = {frame, 3, {status, pitch, velocity}};
+			block->midi_events->AddItem(&event);
+		};
+		int count = this->scheduledCount.load(memory_order_relaxed);
+		PreviewCommand command;
+		while (this->commands.pop(command)) {
+			switch (command.type) {
+				case PreviewCommand::NOTE_ON:
+					send(MIDI_NOTE_ON | command.status, command.pitch, command.velocity,
+						0);
+					if (count < (int)MAX_PREVIEW_NOTES) {
+						ScheduledOff& off = this->scheduled[count++];
+						off.status = MIDI_NOTE_OFF | command.status;
+						off.pitch = command.pitch;
+						off.velocity = command.velocity;
+						off.time = this->time + command.length;
+					}
+					break;
+				case PreviewCommand::NOTE_OFF:
+					send(MIDI_NOTE_OFF | command.status, command.pitch,
+						command.velocity, 0);
+					break;
+				case PreviewCommand::CANCEL_NOTES_OFF:
+					count = 0;
+					break;
+			}
+		}
+		const double blockEnd = this->time + block->length / block->samplerate;
+		for (int i = 0; i < count;) {
+			ScheduledOff& off = this->scheduled[i];
+			if (off.time >= blockEnd) {
+				++i;
+				continue;
+			}
+			const int frame = max(0, min(block->length - 1,
+				(int)((off.time - this->time) * block->samplerate)));
+			send(off.status, off.pitch, off.velocity, frame);
+			// Order doesn't matter, so replace this with the last one.
+			off = this->scheduled[--count];
 		}
+		this->time = blockEnd;
+		this->scheduledCount.store(count, memory_order_release);
 	}
 
 	void GetPeakInfo(PCM_source_peaktransfer_t* block) {
@@ -392,31 +756,92 @@ class PreviewSource : public PCM_source {
 	void PeaksBuild_Finish() {
 	}
 
+	private:
+	struct ScheduledOff {
+		unsigned char status;
+		unsigned char pitch;
+		unsigned char velocity;
+		// The audio time at which to send the note off.
+		double time;
+	};
+	// Only accessed on the audio thread.
+	ScheduledOff scheduled[MAX_PREVIEW_NOTES];
+	// The audio time in seconds since the preview was created.
+	double time = 0;
+	// Written by the audio thread, read by the main thread.
+	atomic<int> scheduledCount = 0;
 };
 
 PreviewSource previewSource;
 preview_register_t previewReg = {0};
+bool isPreviewPlaying = false;
+
+void startPreview(void* track) {
+	if (isPreviewPlaying) {
+		if (track && track != previewReg.preview_track) {
+			// The audio thread reads this, so it must be changed with the lock
+			// held. This only happens when moving to another track.
+#ifdef _WIN32
+			EnterCriticalSection(&previewReg.cs);
+			previewReg.preview_track = track;
+			LeaveCriticalSection(&previewReg.cs);
+#else
+			pthread_mutex_lock(&previewReg.mutex);
+			previewReg.preview_track = track;
+			pthread_mutex_unlock(&previewReg.mutex);
+#endif
+		}
+		return;
+	}
+	if (track) {
+		previewReg.preview_track = track;
+	}
+	previewReg.curpos = 0.0;
+	PlayTrackPreview(&previewReg);
+	isPreviewPlaying = true;
+}
+
+void stopPreviewWhenIdle(UINT ms) {
+	previewDoneLater = CallLater([] {
+		if (!previewSource.isIdle()) {
+			// We're running inside previewDoneLater, so don't cancel it here.
+			stopPreviewWhenIdle(100);
+			return;
+		}
+		StopTrackPreview(&previewReg);
+		isPreviewPlaying = false;
+		previewingNotes.clear();
+	}, ms);
+}
+
+// Stop the preview once the audio thread has sent all note offs. This doesn't
+// affect when note offs are sent, so it doesn't need to be precise.
+void scheduleStopPreview(UINT ms) {
+	// Only one pending stop should ever exist.
+	previewDoneLater.cancel();
+	stopPreviewWhenIdle(ms);
+}
 
 // Queue note off events for the notes currently being previewed.
 // when sendNoteOff is true, this function  also sends the events.
 void previewNotesOff(bool sendNoteOff) {
-	for (auto note = previewingNotes.cbegin(); note != previewingNotes.cend(); ++note) {
-		MIDI_event_t event = {0, 3, {
-			(unsigned char)(MIDI_NOTE_OFF | note->channel),
-			(unsigned char)note->pitch, (unsigned char)note->velocity}};
-		previewSource.events.push_back(event);
+	if (!previewReg.src) {
+		return; // Preview was never initialised.
 	}
+	if (previewingNotes.empty()) {
+		return;
+	}
+	for (const auto& note: previewingNotes) {
+		previewSource.commands.push({PreviewCommand::NOTE_OFF,
+			(unsigned char)note.channel, (unsigned char)note.pitch,
+			(unsigned char)note.velocity});
+	}
+	previewingNotes.clear();
 	if (sendNoteOff) {
 		// Send the events.
-		previewReg.curpos = 0.0;
-		PlayTrackPreview(&previewReg);
+		startPreview(nullptr);
+		scheduleStopPreview(100);
 	}
-	previewingNotes.clear();
-}
-
-// Used to find out the minimum note length.
-bool compareNotesByLength(const MidiNote& note1, const MidiNote& note2) {
-	return note1.getLength() < note2.getLength();
 }
 
 void previewNotes(MediaItem_Take* take, const vector<MidiNote>& notes) {
@@ -432,144 +857,54 @@ void previewNotes(MediaItem_Take* take, const vector<MidiNote>& notes) {
 #endif
 		previewReg.src = &previewSource;
 		previewReg.m_out_chan = -1; // Use .preview_track.
+		previewReg.loop = true;
+		previewingNotes.reserve(MAX_PREVIEW_NOTES);
 	}
 	// Stop the current preview.
 	if (cancelPendingMidiPreviewNotesOff()) {
 		previewNotesOff(false);
 	}
-	// Queue note on events for the new notes.
+	// Calculate the minimum note length. All notes are turned off together.
+	double minLength = DBL_MAX;
 	for (auto const& note: notes) {
-		if (note.muted) {
+		if (!note.muted) {
+			minLength = min(minLength, note.getLength());
+		}
+	}
+	if (minLength == DBL_MAX) {
+		return; // All notes are muted.
+	}
+	if (!minLength) {
+		minLength = DEFAULT_PREVIEW_LENGTH / 1000.0;
+	}
+	// Queue note on events for the new notes. The audio thread sends the note
+	// offs after minLength.
+	for (auto const& note: notes) {
+		if (note.muted || previewingNotes.size() >= MAX_PREVIEW_NOTES) {
 			continue;
 		}
-		MIDI_event_t event = {0, 3, {
-			(unsigned char)(MIDI_NOTE_ON | note.channel),
-			(unsigned char)note.pitch, (unsigned char)note.velocity}};
-		previewSource.events.push_back(event);
+		if (!previewSource.commands.push({PreviewCommand::NOTE_ON,
+				(unsigned char)note.channel, (unsigned char)note.pitch,
+				(unsigned char)note.velocity, minLength})) {
+			break; // The queue is full.
+		}
 		// Save the note being previewed so we can turn it off later (previewNotesOff).
 		previewingNotes.push_back(note);
 	}
 	// Send the events.
-	void* track = GetSetMediaItemTakeInfo(take, "P_TRACK", nullptr);
-	previewReg.preview_track = track;
-	previewReg.curpos = 0.0;
-	PlayTrackPreview(&previewReg);
-	// Calculate the minimum note length.
-	double minLength = min_element(previewingNotes.cbegin(), previewingNotes.cend(), compareNotesByLength)->getLength();
-	// Schedule note off messages.
-	previewDoneLater = CallLater([] {
-		previewNotesOff(true);
-	}, (UINT)(minLength ? minLength * 1000 : DEFAULT_PREVIEW_LENGTH));
+	startPreview(GetSetMediaItemTakeInfo(take, "P_TRACK", nullptr));
+	scheduleStopPreview((UINT)(minLength * 1000) + 100);
 }
 
 bool cancelPendingMidiPreviewNotesOff() {
-	return previewDoneLater.cancel();
-}
-
-// A random access iterator for MIDI events.
-// The EventType template parameter is used to specialise the
-// template for different event types (note, CC, etc.).
-// The SourceType template parameter is used to define the source of events (MediaItem_Take*, HWND for event list window, etc.)
-template<typename EventType, typename SourceType>
-class MidiEventIterator {
-	public:
-	using difference_type = int;
-	using value_type = const EventType;
-	using pointer = value_type*;
-	using reference = value_type;
-	using iterator_category = random_access_iterator_tag;
-
-	MidiEventIterator(SourceType source, typename EventType::ReqParams ReqParams = {}, difference_type index=0)
-		: source(source),
-		reqParams(ReqParams),
-		index(index)
-	{
-		this->count = EventType::getCount(this->source);
-	}
-
-	bool operator==(const MidiEventIterator& other) const {
-		return this->source == other.source && this->index == other.index;
-	}
-
-	bool operator!=(const MidiEventIterator& other) const {
-		return !(*this == other);
-	}
-
-	auto operator<=>(const MidiEventIterator& other) const {
-		return this->index <=> other.index;
-	}
-
-	value_type operator[](const difference_type index) const{
-		return this->getEvent(this->index + index);
-	}
-
-	reference operator*() const {
-		return (*this)[0];
-	}
-
-	pointer operator->() const {
-		this->currentValue = (*this)[0];
-		return &(this->currentValue);
-	}
-
-	MidiEventIterator& operator++() {
-		++this->index;
-		return *this;
-	}
-
-	MidiEventIterator& operator--() {
-		--this->index;
-		return *this;
-	}
-
-	MidiEventIterator& operator+=(const difference_type increment) {
-		this->index += increment;
-		return *this;
-	}
-
-	MidiEventIterator& operator-=(const difference_type decrement) {
-		this->index -= decrement;
-		return *this;
-	}
-
-	MidiEventIterator operator+(const difference_type increment) {
-		auto tmpIt = *this;
-		tmpIt += increment;
-		return tmpIt;
-	}
-
-	MidiEventIterator operator-(const difference_type decrement) {
-		auto tmpIt = *this;
-		tmpIt -= decrement;
-		return tmpIt;
-	}
-
-	difference_type operator-(const MidiEventIterator& other) {
-		return this->index - other.index;
-	}
-
-	void moveToEnd() {
-		this->index = count;
-	}
-
-	difference_type getIndex() const {
-		return this->index;
-	}
-
-	protected:
-	value_type getEvent(difference_type index) const {
-		return EventType::get(this->source, index, this->reqParams);
+	if (previewingNotes.empty() || previewSource.isIdle()) {
+		return false;
 	}
-	SourceType source;
-
-	private:
-	int count;
-	typename EventType::ReqParams reqParams;
-	difference_type index;
-	mutable EventType currentValue;
-};
+	previewSource.commands.push({PreviewCommand::CANCEL_NOTES_OFF});
+	return true;
+}
 
-using MidiNoteIterator = MidiEventIterator<MidiNote, MediaItem_Take*>;
+using MidiNoteIterator = vector<MidiNote>::const_iterator;
 
 const string getMidiNoteName(MediaTrack* track, int pitch, int channel) {
 	static const char* names[] = {
@@ -621,50 +956,41 @@ const string getMidiNoteName(MediaItem_Take *take, int pitch, int channel) {
 	return getMidiNoteName(track, pitch, channel);
 }
 
-// Returns iterators to the first and exclusive last notes in a chord in a given direction.
-pair<MidiNoteIterator, MidiNoteIterator> findChord(MediaItem_Take* take, int direction, MidiNote::ReqParams reqParams={}) {
-	// Ensure we always collect the start of the note since we need it to find chords.
-	reqParams.start = true;
+// Returns the index in snapshot.chords of the chord in a given direction,
+// or -1 if there is no such chord.
+int findChordIndex(const MidiTakeSnapshot& snapshot, int direction) {
 	double now = GetCursorPosition();
-	MidiNoteIterator begin(take, reqParams);
-	MidiNoteIterator end = begin;
-	end.moveToEnd();
-	if (begin == end) {
-		// No notes.
-		return {begin, end};
-	}
-	auto range = equal_range(begin, end, now, MidiNote::CompareByStart{});
-	// Find the first note of the chord.
-	MidiNoteIterator firstNote = end;
-	if (direction == 1 && range.second != end) {
+	const auto& chords = snapshot.chords;
+	auto atOrAfter = lower_bound(chords.cbegin(), chords.cend(), now,
+		MidiTakeSnapshot::Chord::CompareByStart{});
+	const bool atCursor = atOrAfter != chords.cend() && atOrAfter->start == now;
+	auto after = atCursor ? atOrAfter + 1 : atOrAfter;
+	if (direction == 1 && after != chords.cend()) {
 		// Return chord after the cursor.
-		// range.second is the first note after now.
-		firstNote = range.second;
-	} else if (direction == -1 && range.first != begin) {
+		return static_cast<int>(after - chords.cbegin());
+	} else if (direction == -1 && atOrAfter != chords.cbegin()) {
 		// Return chord before the cursor.
-		// range.first is the first note at or after now, so one before that is
-		// the first note before now.
-		firstNote = range.first;
-		--firstNote;
-	} else if (range.first != range.second) {
+		// atOrAfter is the first chord at or after now, so one before that is
+		// the first chord before now.
+		return static_cast<int>(atOrAfter - chords.cbegin()) - 1;
+	} else if (atCursor) {
 		// Return chord at the cursor.
-		return range;
-	} else {
-		// Nothing in the requested direction or at the cursor.
-		return {end, end};
-	}
-	// Find the last note of the chord.
-	double firstStart = firstNote->start;
-	MidiNoteIterator lastNote = firstNote;
-	MidiNoteIterator note = firstNote;
-	for (note += direction; begin <= note && note < end; note += direction) {
-		if (note->start != firstStart) {
-			break;
-		}
-		lastNote = note;
+		return static_cast<int>(atOrAfter - chords.cbegin());
 	}
-	return {min(firstNote, lastNote),
-		max(lastNote, firstNote) + 1};
+	// Nothing in the requested direction or at the cursor.
+	return -1;
+}
+
+// Returns iterators to the first and exclusive last notes in a chord in a given direction.
+// The iterators are only valid until the MIDI snapshot is next updated.
+pair<MidiNoteIterator, MidiNoteIterator> findChord(MediaItem_Take* take, int direction) {
+	const auto& snapshot = getMidiSnapshot(take);
+	const int chord = findChordIndex(snapshot, direction);
+	if (chord == -1) {
+		return {snapshot.notes.cend(), snapshot.notes.cend()};
+	}
+	auto firstNote = snapshot.notes.cbegin() + snapshot.chords[chord].firstNote;
+	return {firstNote, firstNote + snapshot.chords[chord].noteCount};
 }
 
 // Keeps track of the note to which the user last moved in a chord.
@@ -678,27 +1004,20 @@ int curNoteInChord = -1;
 // It is not a REAPER CC index.
 // -1 means no position/CC.
 pair<double, int> currentCC = {-1, -1};
+// The CC lane in which the user last moved to a CC, or -1 if the user moved
+// through the CCs in all lanes.
+int currentCCLane = -1;
 
 // Finds a single note in the chord at the cursor in a given direction and returns its info.
 // This updates curNoteInChord.
 MidiNote findNoteInChord(MediaItem_Take* take, int direction) {
-	auto chord = findChord(take, 0, {
-		true,  // start
-		true,  // end
-		true,  // channel
-		true,  // pitch
-		true,  // velocity
-		true,  // selected
-		true  // muted
-	});
-	if (chord.first == chord.second) {
+	const auto& snapshot = getMidiSnapshot(take);
+	const int chordIndex = findChordIndex(snapshot, 0);
+	if (chordIndex == -1) {
 		return {-1};
 	}
-	// Notes at the same position are ordered arbitrarily.
-	// This is not intuitive, so sort them.
-	vector<MidiNote> notes(chord.first, chord.second);
-	stable_sort(notes.begin(), notes.end(), MidiNote::compareByPitch);
-	const int lastNoteIndex = (int)notes.size() - 1;
+	const auto& chord = snapshot.chords[chordIndex];
+	const int lastNoteIndex = chord.noteCount - 1;
 	// Work out which note to move to.
 	if (direction != 0 && 0 <= curNoteInChord &&
 			curNoteInChord <= (int)lastNoteIndex) {
@@ -711,24 +1030,18 @@ MidiNote findNoteInChord(MediaItem_Take* take, int direction) {
 		// We're moving into a new chord. Move to the first/last note.
 		curNoteInChord = direction == 1 ? 0 : (int)lastNoteIndex;
 	}
-	return notes[curNoteInChord];
+	// The notes in the chord are ordered by pitch.
+	return snapshot.notes[snapshot.notesByPitch[chord.firstNote + curNoteInChord]];
 }
 
 void cmdMidiMoveCursor(Command* command) {
 	HWND editor = MIDIEditor_GetActive();
 	MIDIEditor_OnCommand(editor, command->gaccel.accel.cmd);
+	onMidiCommand();
 	ostringstream s;
 	s << formatCursorPosition();
 	MediaItem_Take* take = MIDIEditor_GetTake(editor);
-	auto chord = findChord(take, 0, {
-		true,  // start
-		true,  // end
-		true,  // channel
-		true,  // pitch
-		true,  // velocity
-		false,  // selected
-		true  // muted
-	});
+	auto chord = findChord(take, 0);
 	vector<MidiNote> notes(chord.first, chord.second);
 	int count = static_cast<int>(notes.size());
 	if (count > 0) {
@@ -749,15 +1062,30 @@ void cmdMidiMoveCursor(Command* command) {
 
 void selectNote(MediaItem_Take* take, const int note, bool select=true) {
 	MIDI_SetNote(take, note, &select, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
+	midiSnapshot.setNoteSelected(take, note, select);
 }
 
+// The selection helpers below use the snapshot if it's current. Otherwise, the
+// take was probably just edited (e.g. by a post handler's command), so they
+// only fetch the selected events rather than rebuilding the snapshot for every
+// event in the take.
+
 bool isNoteSelected(MediaItem_Take* take, const int note) {
+	if (midiSnapshot.isCurrent(take)) {
+		const auto& notes = midiSnapshot.notes;
+		return 0 <= note && note < (int)notes.size() && notes[note].selected;
+	}
 	bool sel;
 	MIDI_GetNote(take, note, &sel, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
 	return sel;
 }
 
 int countSelectedNotes(MediaItem_Take* take, int offset=-1) {
+	if (midiSnapshot.isCurrent(take)) {
+		const auto& notes = midiSnapshot.notes;
+		return (int)count_if(notes.begin() + min(offset + 1, (int)notes.size()), notes.end(),
+			[](const MidiNote& note) { return note.selected; });
+	}
 	int noteIndex = offset;
 	int count = 0;
 	for(;;){
@@ -771,14 +1099,20 @@ int countSelectedNotes(MediaItem_Take* take, int offset=-1) {
 }
 
 vector<MidiNote> getSelectedNotes(MediaItem_Take* take, int offset=-1) {
+	vector<MidiNote> selected;
+	if (midiSnapshot.isCurrent(take)) {
+		const auto& notes = midiSnapshot.notes;
+		copy_if(notes.begin() + min(offset + 1, (int)notes.size()), notes.end(),
+			back_inserter(selected), [](const MidiNote& note) { return note.selected; });
+		return selected;
+	}
 	int noteIndex = offset;
-	vector<MidiNote> notes;
 	for(;;){
 		noteIndex = MIDI_EnumSelNotes(take, noteIndex);
 		if (noteIndex == -1) {
 			break;
 		}
-		notes.push_back(MidiNote::get(take, noteIndex, {
+		selected.push_back(MidiNote::get(take, noteIndex, {
 			true,  // start
 			true,  // end
 			true,  // channel
@@ -787,26 +1121,34 @@ vector<MidiNote> getSelectedNotes(MediaItem_Take* take, int offset=-1) {
 			false,  // selected
 			true  // muted
 		}));
+		selected.back().selected = true;
 	}
-	return notes;
+	return selected;
+}
+
+// Unselects all events in the MIDI editor.
+void midiUnselectAll(HWND editor, MediaItem_Take* take) {
+	MIDIEditor_OnCommand(editor, 40214); // Edit: Unselect all
+	onMidiCommand();
+	midiSnapshot.clearSelection(take);
 }
 
-using MidiControlChangeIterator = MidiEventIterator<MidiControlChange, MediaItem_Take*>;
+using MidiControlChangeIterator = vector<MidiControlChange>::const_iterator;
 
 // Finds a single CC at the cursor in a given direction and returns its info.
+// If lane isn't -1, only CCs in that lane are considered.
 // This updates currentCC.
-MidiControlChange findCC(MediaItem_Take* take, int direction) {
-	MidiControlChangeIterator begin(take, {
-		true,  // position
-		true,  // message1
-		true,  // channel
-		true,  // message2
-		true,  // message3,
-		true,  // selected
-		true  // muted
-	});
-	MidiControlChangeIterator end = begin;
-	end.moveToEnd();
+MidiControlChange findCC(MediaItem_Take* take, int direction, int lane=-1) {
+	const auto& snapshot = getMidiSnapshot(take);
+	static const vector<MidiControlChange> noCCs;
+	const vector<MidiControlChange>* laneCCs = &snapshot.ccs;
+	if (lane != -1) {
+		auto it = snapshot.ccLanes.find(lane);
+		laneCCs = it != snapshot.ccLanes.end() ? &it->second : &noCCs;
+	}
+	const auto& ccs = *laneCCs;
+	MidiControlChangeIterator begin = ccs.cbegin();
+	MidiControlChangeIterator end = ccs.cend();
 	if (begin == end) {
 		// No CCs.
 		currentCC = {-1, -1};
@@ -860,13 +1202,15 @@ MidiControlChange findCC(MediaItem_Take* take, int direction) {
 	// Find the last CC at the position of the first.
 	double firstPos = firstCC->position;
 	MidiControlChangeIterator lastCC = firstCC;
-	MidiControlChangeIterator cc = firstCC;
 	int movement = direction != -1 ? 1 : -1;
-	for (cc += movement; begin <= cc && cc < end; cc += movement) {
-		if (cc->position != firstPos) {
-			break;
+	if (movement == 1) {
+		while (lastCC + 1 != end && (lastCC + 1)->position == firstPos) {
+			++lastCC;
+		}
+	} else {
+		while (lastCC != begin && (lastCC - 1)->position == firstPos) {
+			--lastCC;
 		}
-		lastCC = cc;
 	}
 	int index = 0;
 	MidiControlChange ret;
@@ -890,29 +1234,45 @@ MidiControlChange findCC(MediaItem_Take* take, int direction) {
 
 void selectCC(MediaItem_Take* take, const int cc, bool select=true) {
 	MIDI_SetCC(take, cc, &select, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
+	midiSnapshot.setCCSelected(take, cc, select);
 }
 
 bool isCCSelected(MediaItem_Take* take, const int cc) {
+	if (midiSnapshot.isCurrent(take)) {
+		const auto& ccs = midiSnapshot.ccs;
+		return 0 <= cc && cc < (int)ccs.size() && ccs[cc].selected;
+	}
 	bool sel;
 	MIDI_GetCC(take, cc, &sel, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
 	return sel;
 }
 
 vector<MidiControlChange> getSelectedCCs(MediaItem_Take* take, int offset=-1) {
+	vector<MidiControlChange> selected;
+	if (midiSnapshot.isCurrent(take)) {
+		const auto& ccs = midiSnapshot.ccs;
+		copy_if(ccs.begin() + min(offset + 1, (int)ccs.size()), ccs.end(),
+			back_inserter(selected), [](const MidiControlChange& cc) { return cc.selected; });
+		return selected;
+	}
 	int ccIndex = offset;
-	vector<MidiControlChange> ccs;
 	for (;;) {
 		ccIndex = MIDI_EnumSelCC(take, ccIndex);
 		if (ccIndex == -1) {
 			break;
 		}
-		double position;
-		int chan, msg1, msg2, msg3;
-		MIDI_GetCC(take, ccIndex, nullptr, nullptr, &position, &msg1, &chan, &msg2, &msg3);
-		position = MIDI_GetProjTimeFromPPQPos(take, position);
-		ccs.push_back({chan, ccIndex, msg1, msg2, msg3, position});
+		selected.push_back(MidiControlChange::get(take, ccIndex, {
+			true,  // position
+			true,  // message1
+			true,  // channel
+			true,  // message2
+			true,  // message3
+			false,  // selected
+			true  // muted
+		}));
+		selected.back().selected = true;
 	}
-	return ccs;
+	return selected;
 }
 
 void cmdMidiToggleSelection(Command* command) {
@@ -933,23 +1293,18 @@ void cmdMidiToggleSelection(Command* command) {
 					return;
 				}
 				select = !note.selected;
+				MidiSnapshotUpdate update(take);
 				selectNote(take, note.index, select);
 			} else {
 				// Chord.
-				auto chord = findChord(take, 0, {
-					true,  // start
-					false,  // end
-					false,  // channel
-					false,  // pitch
-					false,  // velocity
-					true  // selected
-				});
+				auto chord = findChord(take, 0);
 				if (chord.first == chord.second) {
 					return;
 				}
 				select = !(chord.first->selected);
+				MidiSnapshotUpdate update(take);
 				for (auto note = chord.first; note < chord.second; ++note) {
-					selectNote(take, note.getIndex(), select);
+					selectNote(take, note->index, select);
 				}
 			}
 			break;
@@ -958,8 +1313,9 @@ void cmdMidiToggleSelection(Command* command) {
 			if (currentCC.first == -1 || currentCC.second == -1) {
 				return;
 			}
-			auto curCC= findCC(take, 0);
+			auto curCC= findCC(take, 0, currentCCLane);
 			select = !curCC.selected;
+			MidiSnapshotUpdate update(take);
 			selectCC(take, curCC.index, select);
 			break;
 		}
@@ -972,34 +1328,30 @@ void cmdMidiToggleSelection(Command* command) {
 void moveToChord(int direction, bool clearSelection=true, bool select=true) {
 	HWND editor = MIDIEditor_GetActive();
 	MediaItem_Take* take = MIDIEditor_GetTake(editor);
-	auto chord = findChord(take, direction, {
-		true,  // start
-		true,  // end
-		true,  // channel
-		true,  // pitch
-		true,  // velocity
-		false,  // selected
-		true  // muted
-	});
+	auto chord = findChord(take, direction);
 	if (chord.first == chord.second) {
 		return;
 	}
 	curNoteInChord = -1;
-	if (clearSelection) {
-		MIDIEditor_OnCommand(editor, 40214); // Edit: Unselect all
-		isSelectionContiguous = true;
-	}
-	const double oldCursor = GetCursorPosition();
-	// Move the edit cursor to this chord, select it and play it.
-	bool cursorSet = false;
+	// Copy the chord, since changing the selection might invalidate the iterators.
 	vector<MidiNote> notes(chord.first, chord.second);
-	for (auto const& note : notes) {
-		if (!cursorSet && direction != 0) {
-			SetEditCurPos(note.start, true, false);
-			cursorSet = true;
+	const double oldCursor = GetCursorPosition();
+	{
+		MidiSnapshotUpdate update(take);
+		if (clearSelection) {
+			midiUnselectAll(editor, take);
+			isSelectionContiguous = true;
 		}
-		if (select) {
-			selectNote(take, note.index);
+		// Move the edit cursor to this chord, select it and play it.
+		bool cursorSet = false;
+		for (auto const& note : notes) {
+			if (!cursorSet && direction != 0) {
+				SetEditCurPos(note.start, true, false);
+				cursorSet = true;
+			}
+			if (select) {
+				selectNote(take, note.index);
+			}
 		}
 	}
 	const bool cursorMoved = oldCursor != GetCursorPosition();
@@ -1014,11 +1366,11 @@ void moveToChord(int direction, bool clearSelection=true, bool select=true) {
 			s << " ";
 		}
 	}
-	if (cursorMoved && !select && !isNoteSelected(take, chord.first.getIndex())) {
+	if (cursorMoved && !select && !isNoteSelected(take, notes[0].index)) {
 		s << translate("unselected") << " ";
 	}
 	if (cursorMoved && settings::reportNotes && settings::reportPositionMIDI) {
-		int count = chord.second - chord.first;
+		int count = static_cast<int>(notes.size());
 		// Translators: used when reporting the number of notes in a chord.
 		// {} will be replaced by the number of notes. E.g. "3 notes"
 		s << format(
@@ -1059,12 +1411,15 @@ void moveToNoteInChord(int direction, bool clearSelection=true, bool select=true
 	if (note.channel == -1) {
 		return;
 	}
-	if (clearSelection) {
-		MIDIEditor_OnCommand(editor, 40214); // Edit: Unselect all
-		isSelectionContiguous = true;
-	}
-	if (select) {
-		selectNote(take, note.index);
+	{
+		MidiSnapshotUpdate update(take);
+		if (clearSelection) {
+			midiUnselectAll(editor, take);
+			isSelectionContiguous = true;
+		}
+		if (select) {
+			selectNote(take, note.index);
+		}
 	}
 	previewNotes(take, {note});
 	fakeFocus = FOCUS_NOTE;
@@ -1132,6 +1487,7 @@ void cmdMidiInsertNote(Command* command) {
 	int oldCount;
 	MIDI_CountEvts(take, &oldCount, nullptr, nullptr);
 	MIDIEditor_OnCommand(editor, command->gaccel.accel.cmd);
+	onMidiCommand();
 	int newCount;
 	MIDI_CountEvts(take, &newCount, nullptr, nullptr);
 	if (newCount <= oldCount) {
@@ -1174,6 +1530,7 @@ void cmdMidiDeleteEvents(Command* command) {
 	MediaItem_Take* take = MIDIEditor_GetTake(editor);
 	int oldCount = MIDI_CountEvts(take, nullptr, nullptr, nullptr);
 	MIDIEditor_OnCommand(editor, command->gaccel.accel.cmd);
+	onMidiCommand();
 	int removed = oldCount - MIDI_CountEvts(take, nullptr, nullptr, nullptr);
 	// Translators: Used when events are deleted in the MIDI editor. {} is
 	// replaced by the number of events. E.g. "3 events removed"
@@ -1232,6 +1589,7 @@ void cmdMidiToggleSelCC (Command* command) {
 	MediaItem_Take* take = MIDIEditor_GetTake(editor);
 	int oldCount = countSelectedEvents (take);
 	MIDIEditor_OnCommand(editor, command->gaccel.accel.cmd);
+	onMidiCommand();
 	int newCount = countSelectedEvents (take);
 	int count = newCount - oldCount;
 	if (count >= 0) {
@@ -1333,24 +1691,40 @@ const string getMidiControlName(MediaItem_Take *take, int control, int channel)
 	return s.str();
 }
 
-void moveToCC(int direction, bool clearSelection=true, bool select=true) {
+void moveToCC(int direction, bool clearSelection=true, bool select=true, bool inLane=false) {
 	HWND editor = MIDIEditor_GetActive();
 	MediaItem_Take* take = MIDIEditor_GetTake(editor);
-	auto cc = findCC(take, direction);
+	int lane = -1;
+	if (inLane) {
+		lane = MIDIEditor_GetSetting_int(editor, "last_clicked_cc_lane");
+		if (0x100 <= lane && lane < 0x120) {
+			// 14 bit CC lane. Navigate the MSB CCs.
+			lane &= 0xFF;
+		}
+		if (lane < 0) {
+			return;
+		}
+	}
+	if (lane != currentCCLane) {
+		// The CC ordering at a position differs between lanes, so forget the
+		// CC to which the user last moved.
+		currentCC = {-1, -1};
+		currentCCLane = lane;
+	}
+	auto cc = findCC(take, direction, lane);
 	if (cc.channel == -1) {
 		return;
 	}
 	if (clearSelection || select) {
+		MidiSnapshotUpdate update(take);
 		Undo_BeginBlock();
-	}
-	if (clearSelection) {
-		MIDIEditor_OnCommand(editor, 40214); // Edit: Unselect all
-		isSelectionContiguous = true;
-	}
-	if (select) {
-		selectCC(take, cc.index);
-	}
-	if (clearSelection || select) {
+		if (clearSelection) {
+			midiUnselectAll(editor, take);
+			isSelectionContiguous = true;
+		}
+		if (select) {
+			selectCC(take, cc.index);
+		}
 		Undo_EndBlock(translate("Change CC Selection"), 0);
 	}
 	SetEditCurPos(cc.position, true, false);
@@ -1405,25 +1779,29 @@ void cmdMidiMoveToPreviousCCKeepSel(Command* command) {
 	moveToCC(-1, false, isSelectionContiguous);
 }
 
+void cmdMidiMoveToNextCCInLane(Command* command) {
+	moveToCC(1, true, true, true);
+}
+
+void cmdMidiMoveToPreviousCCInLane(Command* command) {
+	moveToCC(-1, true, true, true);
+}
+
 void midiMoveToItem(int direction) {
 	HWND editor = MIDIEditor_GetActive();
 	MIDIEditor_OnCommand(editor, ((direction==1)?40798:40797)); // Contents: Activate next/previous MIDI media item on this track, clearing the editor first
+	onMidiCommand();
 	MIDIEditor_OnCommand(editor, 40036); // View: Go to start of file
+	onMidiCommand();
 	int cmd = NamedCommandLookup("_FNG_ME_SELECT_NOTES_NEAR_EDIT_CURSOR");
-	if(cmd>0)
+	if(cmd>0) {
 		MIDIEditor_OnCommand(editor, cmd); // SWS/FNG: Select notes nearest edit cursor
+		onMidiCommand();
+	}
 	MediaItem_Take* take = MIDIEditor_GetTake(editor);
 	MediaItem* item = GetMediaItemTake_Item(take);
 	MediaTrack* track = GetMediaItem_Track(item);
-	int count = CountTrackMediaItems(track);
-	int itemNum = 1;
-	for (int i=0; i<count; ++i) {
-		MediaItem* itemTmp = GetTrackMediaItem(track, i);
-		if (itemTmp == item) {
-			itemNum = i+1;
-			break;
-		}
-	}
+	int itemNum = max(itemIndex::getItemNumber(track, item), 0) + 1;
 	fakeFocus = FOCUS_ITEM;
 	ostringstream s;
 	s << itemNum << " " << GetTakeName(take);
@@ -1446,18 +1824,11 @@ void cmdMidiMoveToPrevItem(Command* command) {
 void cmdMidiMoveToTrack(Command* command) {
 	HWND editor = MIDIEditor_GetActive();
 	MIDIEditor_OnCommand(editor, command->gaccel.accel.cmd);
+	onMidiCommand();
 	MediaItem_Take* take = MIDIEditor_GetTake(editor);
 	MediaItem* item = GetMediaItemTake_Item(take);
 	MediaTrack* track = GetMediaItem_Track(item);
-	int count = CountTrackMediaItems(track);
-	int itemNum;
-	for (int i=0; i<count; ++i) {
-		MediaItem* itemTmp = GetTrackMediaItem(track, i);
-		if (itemTmp == item) {
-			itemNum = i+1;
-			break;
-		}
-	}
+	int itemNum = itemIndex::getItemNumber(track, item) + 1;
 	fakeFocus = FOCUS_TRACK;
 	ostringstream s;
 	int trackNum = (int)(size_t)GetSetMediaTrackInfo(track, "IP_TRACKNUMBER", nullptr);
@@ -1483,24 +1854,23 @@ void cmdMidiSelectSamePitchStartingInTimeSelection(Command* command) {
 	}
 	HWND editor = MIDIEditor_GetActive();
 	MediaItem_Take* take = MIDIEditor_GetTake(editor);
-	int selNote = MIDI_EnumSelNotes(take, -1);
-	if(selNote==-1) {
+	const auto& notes = getMidiSnapshot(take).notes;
+	auto selNote = find_if(notes.begin(), notes.end(),
+		[](const MidiNote& note) { return note.selected; });
+	if(selNote == notes.end()) {
 		outputMessage(translate("no notes selected"));
 		return;
 	}
-	int selPitch;
-	MIDI_GetNote(take, selNote, nullptr, nullptr, nullptr, nullptr, nullptr, &selPitch, nullptr);
+	int selPitch = selNote->pitch;
+	int selectCount {0};
+	MidiSnapshotUpdate update(take);
 	Undo_BeginBlock();
-	MIDIEditor_OnCommand(editor, 40214); // Edit: Unselect all
-	int noteCount {0}, selectCount {0};
-	MIDI_CountEvts(take, &noteCount, nullptr, nullptr);
-	for(int i=0; i<noteCount; i++) {
-		double startPPQPos;
-		int pitch;
-		MIDI_GetNote(take, i, nullptr, nullptr, &startPPQPos, nullptr, nullptr, &pitch, nullptr);
-		double startTime = MIDI_GetProjTimeFromPPQPos(take, startPPQPos);
-		if(tsStart<=startTime && startTime<tsEnd && pitch==selPitch) {
-			selectNote(take, i);
+	midiUnselectAll(editor, take);
+	// Notes are sorted by start, so we only need to visit those in the time selection.
+	for (auto note = lower_bound(notes.begin(), notes.end(), tsStart, MidiNote::CompareByStart{});
+			note != notes.end() && note->start < tsEnd; ++note) {
+		if(note->pitch == selPitch) {
+			selectNote(take, note->index);
 			selectCount++;
 		}
 	}
@@ -1518,6 +1888,7 @@ void cmdMidiNoteSplitOrJoin(Command* command) {
 	auto oldCount = countSelectedNotes(take);
 	auto cmdId = command->gaccel.accel.cmd;
 	MIDIEditor_OnCommand(editor, cmdId);
+	onMidiCommand();
 	auto newCount = countSelectedNotes(take);
 	if (oldCount == newCount) {
 		return;
@@ -1549,29 +1920,74 @@ void cmdMidiNoteSplitOrJoin(Command* command) {
 }
 
 #ifdef _WIN32
-using MidiEventListDataIterator = MidiEventIterator<MidiEventListData, HWND>;
+// A cache of the rows in the MIDI editor event list. Getting a row requires
+// REAPER to format it and us to parse it, which is slow for long lists, so all
+// rows are read in one pass and kept until the take's MIDI or the list changes.
+// Only searching for the nearest event needs every row, so only that builds
+// the cache.
+// The rows aren't built from the MIDI take snapshot because the event list can
+// be filtered and includes events the snapshot doesn't cover, such as sysex.
+class MidiEventListModel {
+	public:
+	// Sorted by position, as the list is.
+	vector<MidiEventListData> rows;
+
+	bool isCurrent(HWND editor, MediaItem_Take* take) const {
+		return editor == this->editor && take == this->take &&
+			GetProjectStateChangeCount(nullptr) == this->stateCount &&
+			MidiEventListData::getCount(editor) == (int)this->rows.size() &&
+			MidiTakeSnapshot::getHash(take) == this->hash;
+	}
+
+	void update(HWND editor, MediaItem_Take* take) {
+		this->editor = editor;
+		this->take = take;
+		this->stateCount = GetProjectStateChangeCount(nullptr);
+		this->hash = MidiTakeSnapshot::getHash(take);
+		this->rows.clear();
+		const int count = MidiEventListData::getCount(editor);
+		this->rows.reserve(count);
+		for (int i = 0; i < count; ++i) {
+			this->rows.push_back(MidiEventListData::get(editor, i));
+		}
+	}
+
+	private:
+	HWND editor = nullptr;
+	MediaItem_Take* take = nullptr;
+	string hash;
+	int stateCount = -1;
+};
+
+MidiEventListModel midiEventList;
+
+const MidiEventListModel& getMidiEventList(HWND editor) {
+	MediaItem_Take* take = MIDIEditor_GetTake(editor);
+	if (!midiEventList.isCurrent(editor, take)) {
+		midiEventList.update(editor, take);
+	}
+	return midiEventList;
+}
 
 void focusNearestMidiEvent(HWND hwnd) {
 	double cursorPos = GetCursorPosition();
 	HWND editor = MIDIEditor_GetActive();
 	assert(editor == GetParent(hwnd));
-	auto begin = MidiEventListDataIterator(editor);
-	auto end = begin;
-	end.moveToEnd();
-	if (begin == end) {
+	const auto& rows = getMidiEventList(editor).rows;
+	if (rows.empty()) {
 		// No events
 		return;
 	}
-	auto range = equal_range(begin, end, cursorPos, MidiEventListData::CompareByPosition{});
-	auto first = range.first;
-	auto last = range.second - 1;
-	if (first == end) {
+	auto range = equal_range(rows.cbegin(), rows.cend(), cursorPos,
+		MidiEventListData::CompareByPosition{});
+	if (range.first == rows.cend()) {
 		// Cursor is after all events.
 		return;
 	}
 	const int curFocus = ListView_GetNextItem(hwnd, -1, LVNI_FOCUSED);
-	auto firstIndex = first.getIndex();
-	auto lastIndex = last.getIndex();
+	const int firstIndex = (int)(range.first - rows.cbegin());
+	// If there are no events at the cursor, this is before firstIndex.
+	const int lastIndex = (int)(range.second - rows.cbegin()) - 1;
 	if (curFocus != -1 && firstIndex <= curFocus && curFocus <= lastIndex) {
 		// Current focus is within the range of events at the cursor.
 		return;
@@ -1599,9 +2015,10 @@ void cmdFocusNearestMidiEvent(Command* command) {
 void cmdMidiFilterWindow(Command *command) {
 	HWND editor = MIDIEditor_GetActive();
 	MIDIEditor_OnCommand(editor, command->gaccel.accel.cmd);
+	onMidiCommand();
 	// TODO: we could also check the command state was "off", to skip searching otherwise
 	HWND filter = FindWindowW(L"#32770",
-		widen(LocalizeString("Filter Events", "midi_DLG_128", 0)).c_str());
+		widenToBuffer(LocalizeString("Filter Events", "midi_DLG_128", 0)).data());
 	if (filter && (filter != GetFocus())) {
 		SetFocus(filter); // focus the window
 	}
@@ -1624,6 +2041,12 @@ void maybeHandleEventListItemFocus(HWND hwnd, long childId) {
 	HWND editor = MIDIEditor_GetActive();
 	assert(editor == GetParent(hwnd));
 	auto focused = ListView_GetNextItem(hwnd, -1, LVNI_FOCUSED);
+	MediaItem_Take* take = MIDIEditor_GetTake(editor);
+	// We only need this row. Reading it directly is cheaper than checking
+	// whether the cached list is current, let alone rebuilding it.
+	if (focused < 0 || focused >= MidiEventListData::getCount(editor)) {
+		return;
+	}
 	auto event = MidiEventListData::get(editor, focused);
 	// Check whether this is a note
 	if (event.length == -1) {
@@ -1631,7 +2054,6 @@ void maybeHandleEventListItemFocus(HWND hwnd, long childId) {
 		return;
 	}
 	auto note = event.toMidiNote();
-	MediaItem_Take* take = MIDIEditor_GetTake(editor);
 	previewNotes(take, {note});
 }
 
@@ -1667,9 +2089,11 @@ void postMidiChangeVelocity(int command) {
 		if (chord.first == chord.second) {
 			generalize = true;
 		} else {
+			const int firstIndex = chord.first->index;
+			const int endIndex = firstIndex + static_cast<int>(chord.second - chord.first);
 			generalize = !(all_of(
 				selectedNotes.begin(), selectedNotes.end(),
-				[chord](MidiNote n) { return chord.first.getIndex() <= n.index && n.index < chord.second.getIndex(); }
+				[firstIndex, endIndex](MidiNote n) { return firstIndex <= n.index && n.index < endIndex; }
 			));
 		}
 	}
@@ -1728,9 +2152,11 @@ void postMidiChangeLength(int command) {
 		if (chord.first == chord.second) {
 			generalize = true;
 		} else {
+			const int firstIndex = chord.first->index;
+			const int endIndex = firstIndex + static_cast<int>(chord.second - chord.first);
 			generalize = !(all_of(
 				selectedNotes.begin(), selectedNotes.end(),
-				[chord](MidiNote n) { return chord.first.getIndex() <= n.index && n.index < chord.second.getIndex(); }
+				[firstIndex, endIndex](MidiNote n) { return firstIndex <= n.index && n.index < endIndex; }
 			));
 		}
 	}
@@ -1825,9 +2251,11 @@ void postMidiChangePitch(int command) {
 		if (chord.first == chord.second) {
 			generalize = true;
 		} else {
+			const int firstIndex = chord.first->index;
+			const int endIndex = firstIndex + static_cast<int>(chord.second - chord.first);
 			generalize = !(all_of(
 				selectedNotes.begin(), selectedNotes.end(),
-				[chord](MidiNote n) { return chord.first.getIndex() <= n.index && n.index <= chord.second.getIndex(); }
+				[firstIndex, endIndex](MidiNote n) { return firstIndex <= n.index && n.index <= endIndex; }
 			));
 		}
 	}
@@ -1972,7 +2400,9 @@ void postMidiMoveStart(int command) {
 void postMidiChangeCCValue(int command) {
 	HWND editor = MIDIEditor_GetActive();
 	MediaItem_Take* take = MIDIEditor_GetTake(editor);
-	// Get selected CCs.
+	// This doesn't use the snapshot's CC lanes. The action changes the selected
+	// CCs in every lane, so the snapshot is stale here, and getSelectedCCs only
+	// enumerates the selected CCs rather than rebuilding it.
 	vector<MidiControlChange> selectedCCs = getSelectedCCs(take);
 	int count = static_cast<int>(selectedCCs.size());
 	if (count == 0) {
@@ -2022,6 +2452,9 @@ void postMidiChangeCCValue(int command) {
 }
 
 void postMidiSwitchCCLane(int command) {
+	// This only reports the lane's name, which doesn't depend on the CCs in it,
+	// so it doesn't need the snapshot's CC lanes. moveToCC notices the lane
+	// change itself.
 	HWND editor = MIDIEditor_GetActive();
 	ostringstream s;
 	int ccNum = MIDIEditor_GetSetting_int(editor, "last_clicked_cc_lane");
@@ -2072,8 +2505,7 @@ void postMidiChangeZoom(int command) {
 	//the zoom is in pixels per midi tick. we need to convert it to pixels per beat.
 	if(GetToggleCommandState2(SectionFromUniqueID(MIDI_EDITOR_SECTION), 40459) == 1 // Timebase: Beats (project)
 		|| GetToggleCommandState2(SectionFromUniqueID(MIDI_EDITOR_SECTION), 40470) == 1) { // Timebase: Beats (source)
-		MediaItem* item = GetMediaItemTake_Item(take);
-		zoom *= getItemPPQ(item);
+		zoom *= getTakePPQ(take);
 		// Translators: Reported when zooming in or out horizontally. {} will be
 		// replaced with the number of pixels per beat; e.g. 100 pixels/beat.
 		outputMessage(format(translate("{} pixels/beat"), formatDouble(zoom, 1)));
@@ -19,10 +19,15 @@ void previewNotesOff(bool sendNoteOff=true);
 // This must be called when playback starts, as otherwise, pending note off
 // messages for OSARA MIDI preview might interfere with MIDI playback.
 // It must also be called when canceling MIDI note preview explicitly, e.g. when not to wait on the timer to elapse.
-// Returns true when previewDoneTimer was set at the time of calling the function, false otherwise.
+// Returns true if note offs were still pending at the time of calling the function, false otherwise.
 bool cancelPendingMidiPreviewNotesOff();
 
-int getItemPPQ(MediaItem* item);
+// Called when any command starts, since it might change MIDI in the active
+// take.
+void onMidiCommand();
+
+// Returns the number of MIDI ticks per quarter note for a take.
+int getTakePPQ(MediaItem_Take* take);
 
 void cmdMidiMoveCursor(Command* command);
 void cmdMidiToggleSelection(Command* command);
@@ -44,6 +49,8 @@ void cmdMidiMoveToNextCC(Command* command);
 void cmdMidiMoveToPreviousCC(Command* command);
 void cmdMidiMoveToNextCCKeepSel(Command* command);
 void cmdMidiMoveToPreviousCCKeepSel(Command* command);
+void cmdMidiMoveToNextCCInLane(Command* command);
+void cmdMidiMoveToPreviousCCInLane(Command* command);
 void cmdMidiMoveToNextItem(Command* command) ;
 void cmdMidiMoveToPrevItem(Command* command) ;
 void cmdMidiMoveToTrack(Command* command);
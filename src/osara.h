@@ -20,6 +20,7 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <sstream>
 
 #define REAPERAPI_MINIMAL
@@ -79,6 +80,7 @@
 #define REAPERAPI_WANT_GetEnvelopePoint
 #define REAPERAPI_WANT_GetEnvelopePointEx
 #define REAPERAPI_WANT_GetEnvelopePointByTimeEx
+#define REAPERAPI_WANT_GetEnvelopeInfo_Value
 #define REAPERAPI_WANT_CountEnvelopePoints
 #define REAPERAPI_WANT_CountEnvelopePointsEx
 #define REAPERAPI_WANT_format_timestr_pos
@@ -109,6 +111,8 @@
 #define REAPERAPI_WANT_MIDI_GetProjTimeFromPPQPos
 #define REAPERAPI_WANT_MIDI_EnumSelNotes
 #define REAPERAPI_WANT_MIDI_EnumSelCC
+#define REAPERAPI_WANT_MIDI_GetHash
+#define REAPERAPI_WANT_GetProjectStateChangeCount
 #define REAPERAPI_WANT_MIDIEditor_GetSetting_int
 #define REAPERAPI_WANT_MIDIEditor_GetSetting_str
 #define REAPERAPI_WANT_MIDIEditor_OnCommand
@@ -126,6 +130,7 @@
 #define REAPERAPI_WANT_CountTakeEnvelopes
 #define REAPERAPI_WANT_GetTakeEnvelope
 #define REAPERAPI_WANT_GetEnvelopeStateChunk
+#define REAPERAPI_WANT_GetSetEnvelopeInfo_String
 #define REAPERAPI_WANT_GetSetTrackSendInfo
 #define REAPERAPI_WANT_GetTrackNumSends
 #define REAPERAPI_WANT_CountTakes
@@ -140,6 +145,7 @@
 #define REAPERAPI_WANT_CountAutomationItems
 #define REAPERAPI_WANT_GetSetAutomationItemInfo
 #define REAPERAPI_WANT_Track_GetPeakHoldDB
+#define REAPERAPI_WANT_Audio_RegHardwareHook
 #define REAPERAPI_WANT_Master_GetPlayRate
 #define REAPERAPI_WANT_ShowPopupMenu
 #define REAPERAPI_WANT_GetMediaItemTake_Track
@@ -191,6 +197,7 @@
 #define REAPERAPI_WANT_get_ini_file
 #define REAPERAPI_WANT_TrackFX_AddByName
 #define REAPERAPI_WANT_TrackFX_Delete
+#define REAPERAPI_WANT_TrackFX_GetFXGUID
 #define REAPERAPI_WANT_GetSetTrackGroupMembership
 #define REAPERAPI_WANT_GetSetTrackGroupMembershipHigh
 #define REAPERAPI_WANT_GetSetProjectInfo_String
@@ -198,7 +205,6 @@
 #define REAPERAPI_WANT_MIDI_GetEvt
 #define REAPERAPI_WANT_TrackFX_GetParamFromIdent
 #define REAPERAPI_WANT_TrackFX_GetNamedConfigParm
-#define REAPERAPI_WANT_GetItemStateChunk
 #define REAPERAPI_WANT_MIDI_GetRecentInputEvent
 #define REAPERAPI_WANT_GetTrackGUID
 #define REAPERAPI_WANT_guidToString
@@ -219,6 +225,7 @@
 #define REAPERAPI_WANT_format_timestr_len
 #define REAPERAPI_WANT_parse_timestr_len
 #define REAPERAPI_WANT_TimeMap_GetTimeSigAtTime
+#define REAPERAPI_WANT_GetMediaItemTake_Source
 
 #include <reaper/reaper_plugin.h>
 #include <reaper/reaper_plugin_functions.h>
@@ -269,8 +276,29 @@ extern bool shouldMoveToAutoItem;
 extern int lastCommand;
 
 bool shouldReportTimeMovement() ;
-void outputMessage(const std::string& message, bool interrupt = true);
-void outputMessage(std::ostringstream& message, bool interrupt = true);
+// Where a message came from. Except for navigation messages, which are always
+// output immediately, messages from the same source which arrive in quick
+// succession are coalesced so that only the latest is spoken. Sources
+// are listed in order of priority. An interrupting message drops any queued
+// messages from sources of lower priority.
+// A queued message which doesn't interrupt is spoken after those already
+// queued rather than replacing them. If key isn't -1, an interrupting message
+// only replaces a queued message with the same key; e.g. a peak watcher channel.
+enum MessageSource {
+	// Direct feedback for something the user did; e.g. a command.
+	MS_NAVIGATION,
+	MS_TRANSPORT,
+	MS_SURFACE,
+	MS_PEAK_WATCHER,
+	MS_COUNT
+};
+void outputMessage(std::string_view message, bool interrupt = true,
+	MessageSource source = MS_NAVIGATION, int key = -1);
+void outputMessage(std::ostringstream& message, bool interrupt = true,
+	MessageSource source = MS_NAVIGATION, int key = -1);
+class MessageBuilder;
+void outputMessage(const MessageBuilder& message, bool interrupt = true,
+	MessageSource source = MS_NAVIGATION, int key = -1);
 
 // Call a function or lambda (even a lambda with capture) asynchronously after
 // the specified number of ms. The function must take no parameters and return
@@ -333,9 +361,13 @@ std::string formatNoteLength(double start, double end);
 std::string formatCursorPosition(TimeFormat format=TF_RULER,
 	FormatTimeCacheRequest cache=FT_CACHE_DEFAULT);
 const char* getActionName(int command, KbdSectionInfo* section=nullptr, bool skipCategory=true);
+void reviewMessage(const char* title, const char* message);
 
 bool isTrackSelected(MediaTrack* track);
+bool isTrackMuted(MediaTrack* track);
+bool isTrackSoloed(MediaTrack* track);
 bool isTrackArmed(MediaTrack* track);
+bool isTrackMonitored(MediaTrack* track);
 std::string formatDouble(double d, int precision, bool plus=false);
 MediaItem* getItemWithFocus();
 
@@ -344,6 +376,11 @@ MediaItem* getItemWithFocus();
 #include <oleacc.h>
 
 std::wstring widen(const std::string& text);
+// Convert UTF-8 to UTF-16 into a reusable buffer owned by the calling thread.
+// This avoids allocating for every conversion. The result is null terminated
+// and is only valid until the next call on the same thread.
+std::wstring_view widenToBuffer(std::string_view text,
+	bool appendSpace = false);
 std::string narrow(const std::wstring& text);
 
 extern IAccPropServices* accPropServices;
@@ -352,7 +389,7 @@ extern IAccPropServices* accPropServices;
 bool initializeUia();
 bool terminateUia();
 bool shouldUseUiaNotifications();
-bool sendUiaNotification(const std::string& message, bool interrupt = true);
+bool sendUiaNotification(std::string_view message, bool interrupt = true);
 void resetUia();
 
 #else
@@ -363,13 +400,14 @@ void resetUia();
 #define ComboBox_ResetContent(hwnd) (int)SendMessage(hwnd, CB_RESETCONTENT, 0, 0)
 #endif
 
-bool isClassName(HWND hwnd, std::string className);
+bool isClassName(HWND hwnd, std::string_view className);
 
 extern bool isHandlingCommand;
 void reportTransportState(int state);
 void reportRepeat(bool repeat);
 void postGoToTrack(int command, MediaTrack* track);
 void formatPan(double pan, std::ostringstream& output);
+void formatPan(double pan, MessageBuilder& output);
 IReaperControlSurface* createSurface();
 // envelopeCommands.cpp
 extern bool selectedEnvelopeIsTake;
@@ -13,6 +13,7 @@
 #include <iomanip>
 #include <memory>
 #include <regex>
+#include <unordered_map>
 // osara.h includes windows.h, which must be included before other Windows
 // headers.
 #include "osara.h"
@@ -27,6 +28,8 @@
 #include <reaper/reaper_plugin.h>
 #include "config.h"
 #include "fxChain.h"
+#include "fxTree.h"
+#include "messageBuilder.h"
 #include "resource.h"
 #include "translation.h"
 
@@ -78,6 +81,13 @@ class ParamSource {
 	virtual string getParamName(int param) = 0;
 	virtual unique_ptr<Param> getParam(int param) = 0;
 
+	// Returns a key which identifies this set of parameters, used to cache
+	// parameter names so that reopening the dialog for the same object is fast.
+	// An empty key means the names shouldn't be cached.
+	virtual string getCacheKey() {
+		return "";
+	}
+
 	// Called to rebuild the parameter list because one or more parameters were
 	// invalidated. This need only be implemented if the source doesn't
 	// dynamically fetch parameter info when the getParam* methods are called.
@@ -290,6 +300,32 @@ const char CFGKEY_DIALOG_POS[] = "paramsDialogPos";
 
 bool isParamsDialogOpen = false;
 
+// Information about a parameter's name, cached so that filtering doesn't need
+// to fetch names again.
+struct ParamInfo {
+	string name;
+	// Used for case insensitive filtering.
+	string lowerName;
+	bool isUnnamed;
+};
+
+// Parameter names from previous dialogs, keyed by ParamSource::getCacheKey.
+unordered_map<string, vector<ParamInfo>> paramInfoCache;
+// Fetching names is cheap for most sources, so we only cache a few large
+// lists.
+const size_t MAX_PARAM_INFO_CACHE = 16;
+
+void invalidateParamInfoCache() {
+	paramInfoCache.clear();
+}
+// When reusing cached names, check this many of them against the source in
+// case the names changed without the FX chain changing; e.g. a plugin which
+// renames its parameters when a preset is loaded.
+const int PARAM_INFO_CACHE_SAMPLES = 8;
+// Fetch names for this many parameters before showing the dialog. The rest are
+// fetched in batches of this size while the dialog is open.
+const int PARAM_INFO_BATCH_SIZE = 200;
+
 class ParamsDialog {
 	private:
 	unique_ptr<ParamSource> source;
@@ -300,7 +336,23 @@ class ParamsDialog {
 	HWND valueLabel;
 	HWND moreButton;
 	string filter;
+	// Parameter names are cached when the list is first built, since fetching
+	// them can be slow for effects with thousands of parameters. For such
+	// effects, names are fetched in batches after the dialog opens, so this may
+	// not contain all parameters yet.
+	vector<ParamInfo> paramInfo;
+	int paramInfoTotal = 0;
+	string paramInfoKey;
+	CallLater fetchParamInfoLater;
+	// The filter and unnamed setting used to build visibleParams. If the filter
+	// is extended, we only need to check the parameters which are already
+	// visible.
+	string listedFilter;
+	bool listedUnnamed = true;
 	vector<int> visibleParams;
+	// The parameter selected before cacheParamInfo cleared visibleParams, so
+	// that updateParamList can select it again. -1 if none.
+	int selParamBeforeRebuild = -1;
 	int paramNum;
 	unique_ptr<Param> param;
 	double val;
@@ -321,7 +373,7 @@ class ParamsDialog {
 #ifdef _WIN32
 		// Set the slider's accessible value to this text.
 		accPropServices->SetHwndPropStr(this->slider, OBJID_CLIENT, CHILDID_SELF,
-			PROPID_ACC_VALUE, widen(this->valText).c_str());
+			PROPID_ACC_VALUE, widenToBuffer(this->valText).data());
 		if (!this->suppressValueChangeReport) {
 			NotifyWinEvent(EVENT_OBJECT_VALUECHANGE, this->slider,
 				OBJID_CLIENT, CHILDID_SELF);
@@ -540,8 +592,8 @@ class ParamsDialog {
 				dialog->suppressValueChangeReport = true;
 				dialog->onParamChange();
 				dialog->suppressValueChangeReport = false;
-				ostringstream s;
-				s << dialog->source->getParamName(dialog->paramNum) << ", " <<
+				MessageBuilder s;
+				s << dialog->paramInfo[dialog->paramNum].name << ", " <<
 					dialog->valText;
 				outputMessage(s);
 			}
@@ -588,6 +640,7 @@ class ParamsDialog {
 	}
 
 	~ParamsDialog() {
+		this->fetchParamInfoLater.cancel();
 		plugin_register("-accelerator", &this->accelReg);
 		isParamsDialogOpen = false;
 		// Try to restore focus back to where it was when the dialog was opened.
@@ -599,40 +652,147 @@ class ParamsDialog {
 	}
 
 	const regex RE_UNNAMED_PARAM{"(?:|-|\\d{1,4} -|[P#]\\d{3}) \\(\\d+\\)"};
-	bool shouldIncludeParam(string name) {
-		if (!IsDlgButtonChecked(this->dialog, ID_PARAM_UNNAMED)) {
-			smatch m;
-			regex_match(name, m, RE_UNNAMED_PARAM);
-			if (!m.empty()) {
+	// Fetch names for parameters up to end.
+	void fetchParamInfo(int end) {
+		this->paramInfo.reserve(this->paramInfoTotal);
+		for (int p = (int)this->paramInfo.size(); p < end; ++p) {
+			ParamInfo info;
+			info.name = this->source->getParamName(p);
+			info.lowerName = info.name;
+			// Convert param name to lower case for match.
+			transform(info.lowerName.begin(), info.lowerName.end(),
+				info.lowerName.begin(), ::tolower);
+			info.isUnnamed = regex_match(info.name, RE_UNNAMED_PARAM);
+			this->paramInfo.push_back(std::move(info));
+		}
+		if ((int)this->paramInfo.size() < this->paramInfoTotal) {
+			this->fetchParamInfoLater = CallLater([this] {
+				this->fetchNextParamInfoBatch();
+			}, 0);
+		} else if (!this->paramInfoKey.empty()) {
+			if (paramInfoCache.size() >= MAX_PARAM_INFO_CACHE) {
+				paramInfoCache.clear();
+			}
+			paramInfoCache[this->paramInfoKey] = this->paramInfo;
+		}
+	}
+
+	void fetchNextParamInfoBatch() {
+		const int start = (int)this->paramInfo.size();
+		this->fetchParamInfoLater = CallLater();
+		this->fetchParamInfo(min(start + PARAM_INFO_BATCH_SIZE,
+			this->paramInfoTotal));
+		// Add any new parameters which match the current filter.
+		const bool wasEmpty = this->visibleParams.empty();
+		const bool includeUnnamed = IsDlgButtonChecked(this->dialog,
+			ID_PARAM_UNNAMED);
+		for (int p = start; p < (int)this->paramInfo.size(); ++p) {
+			if (!this->shouldIncludeParam(this->paramInfo[p], includeUnnamed)) {
+				continue;
+			}
+			this->visibleParams.push_back(p);
+			ComboBox_AddString(this->paramCombo, this->paramInfo[p].name.c_str());
+		}
+		if (wasEmpty && !this->visibleParams.empty()) {
+			// Nothing matched before, so there's now a parameter to select.
+			ComboBox_SetCurSel(this->paramCombo, 0);
+			EnableWindow(this->slider, TRUE);
+			this->onParamChange();
+		}
+	}
+
+	bool isCachedParamInfoCurrent(const vector<ParamInfo>& cached) {
+		const int count = (int)cached.size();
+		const int samples = min(count, PARAM_INFO_CACHE_SAMPLES);
+		for (int s = 0; s < samples; ++s) {
+			// Spread the samples across the list, including the last parameter.
+			const int p = samples == 1 ? 0 : (int)((long long)s * (count - 1) /
+				(samples - 1));
+			if (cached[p].name != this->source->getParamName(p)) {
 				return false;
 			}
 		}
+		return true;
+	}
+
+	void cacheParamInfo(bool useCache) {
+		this->fetchParamInfoLater.cancel();
+		this->paramInfoTotal = this->source->getParamCount();
+		this->paramInfoKey = this->source->getCacheKey();
+		this->paramInfo.clear();
+		// The visible list no longer applies, but remember what was selected.
+		const int sel = ComboBox_GetCurSel(this->paramCombo);
+		this->selParamBeforeRebuild = 0 <= sel && sel < (int)this->visibleParams.size() ?
+			this->visibleParams[sel] : -1;
+		this->visibleParams.clear();
+		this->listedFilter.clear();
+		this->listedUnnamed = true;
+		if (!this->paramInfoKey.empty()) {
+			auto it = paramInfoCache.find(this->paramInfoKey);
+			if (it != paramInfoCache.end()) {
+				// If the parameters were invalidated or their number changed, the
+				// cached names might be stale.
+				if (useCache && (int)it->second.size() == this->paramInfoTotal &&
+						this->isCachedParamInfoCurrent(it->second)) {
+					this->paramInfo = it->second;
+					return;
+				}
+				paramInfoCache.erase(it);
+			}
+		}
+		this->fetchParamInfo(min(PARAM_INFO_BATCH_SIZE, this->paramInfoTotal));
+	}
+
+	bool shouldIncludeParam(const ParamInfo& info, bool includeUnnamed) {
+		if (!includeUnnamed && info.isUnnamed) {
+			return false;
+		}
 		if (filter.empty())
 			return true;
-		// Convert param name to lower case for match.
-		transform(name.begin(), name.end(), name.begin(), ::tolower);
-		return name.find(filter) != string::npos;
+		return info.lowerName.find(filter) != string::npos;
 	}
 
 	void updateParamList() {
 		int prevSelParam;
 		if (this->visibleParams.empty())
-			prevSelParam = -1;
+			prevSelParam = this->selParamBeforeRebuild;
 		else
 			prevSelParam = this->visibleParams[ComboBox_GetCurSel(this->paramCombo)];
+		this->selParamBeforeRebuild = -1;
+		const bool includeUnnamed = IsDlgButtonChecked(this->dialog,
+			ID_PARAM_UNNAMED);
+		// If the new list can only be a subset of the current list, we only need
+		// to check the parameters which are currently visible. That's the case
+		// when the filter has been extended or unnamed parameters have been hidden.
+		const bool narrowing = !this->visibleParams.empty() &&
+			this->filter.find(this->listedFilter) != string::npos &&
+			(this->listedUnnamed || !includeUnnamed);
+		vector<int> candidates;
+		if (narrowing) {
+			candidates.swap(this->visibleParams);
+		}
 		this->visibleParams.clear();
+		this->listedFilter = this->filter;
+		this->listedUnnamed = includeUnnamed;
 		// Use the first item if the previously selected param gets filtered out.
 		int newComboSel = 0;
-		ComboBox_ResetContent(this->paramCombo);
-		for (int p = 0; p < this->source->getParamCount(); ++p) {
-			const string name = source->getParamName(p);
-			if (!this->shouldIncludeParam(name))
-				continue;
-			this->visibleParams.push_back(p);
-			ComboBox_AddString(this->paramCombo, name.c_str());
+		auto consider = [&](int p) {
+			if (!this->shouldIncludeParam(this->paramInfo[p], includeUnnamed))
+				return;
 			if (p == prevSelParam)
-				newComboSel = (int)this->visibleParams.size() - 1;
+				newComboSel = (int)this->visibleParams.size();
+			this->visibleParams.push_back(p);
+		};
+		if (narrowing) {
+			for (int p: candidates) {
+				consider(p);
+			}
+		} else {
+			for (int p = 0; p < (int)this->paramInfo.size(); ++p) {
+				consider(p);
+			}
 		}
+		this->populateParamCombo();
 		ComboBox_SetCurSel(this->paramCombo, newComboSel);
 		if (this->visibleParams.empty()) {
 			EnableWindow(this->slider, FALSE);
@@ -642,6 +802,31 @@ class ParamsDialog {
 		this->onParamChange();
 	}
 
+	void populateParamCombo() {
+#ifdef _WIN32
+		// Adding thousands of items one at a time is slow if the combo box redraws
+		// and reallocates for each item, so suspend redrawing and allocate all of
+		// the storage up front.
+		SendMessage(this->paramCombo, WM_SETREDRAW, FALSE, 0);
+#endif
+		ComboBox_ResetContent(this->paramCombo);
+#ifdef _WIN32
+		size_t chars = 0;
+		for (int p: this->visibleParams) {
+			chars += this->paramInfo[p].name.size() + 1;
+		}
+		SendMessage(this->paramCombo, CB_INITSTORAGE, this->visibleParams.size(),
+			chars);
+#endif
+		for (int p: this->visibleParams) {
+			ComboBox_AddString(this->paramCombo, this->paramInfo[p].name.c_str());
+		}
+#ifdef _WIN32
+		SendMessage(this->paramCombo, WM_SETREDRAW, TRUE, 0);
+		InvalidateRect(this->paramCombo, nullptr, TRUE);
+#endif
+	}
+
 	void onFilterChange() {
 		char rawText[100];
 		GetDlgItemText(this->dialog, ID_PARAM_FILTER, rawText, sizeof(rawText));
@@ -682,6 +867,7 @@ class ParamsDialog {
 			this->onParamChange();
 		} else if (after == Param::AfterOption::invalidateParams) {
 			this->source->rebuildParams();
+			this->cacheParamInfo(false);
 			this->updateParamList();
 		} else {
 			SendMessage(this->dialog, WM_CLOSE, 0, 0);
@@ -724,6 +910,7 @@ class ParamsDialog {
 		this->valueLabel = GetDlgItem(this->dialog, ID_PARAM_VAL_LABEL);
 		this->moreButton = GetDlgItem(this->dialog, ID_PARAM_MORE);
 		CheckDlgButton(this->dialog, ID_PARAM_UNNAMED, BST_CHECKED);
+		this->cacheParamInfo(true);
 		this->updateParamList();
 		this->restoreWindowPos();
 		ShowWindow(this->dialog, SW_SHOWNORMAL);
@@ -763,6 +950,7 @@ class FxParams: public ParamSource {
 	bool (*_FormatParamValue)(ReaperObj*, int, int, double, char*, int);
 	bool (*_GetNamedConfigParm)(ReaperObj*, int, const char*, char*, int);
 	bool (*_SetNamedConfigParm)(ReaperObj*, int, const char*, const char*);
+	GUID* (*_GetFXGUID)(ReaperObj*, int);
 
 	void initNamedConfigParams();
 
@@ -783,6 +971,8 @@ class FxParams: public ParamSource {
 			(apiPrefix + "_GetNamedConfigParm").c_str());
 		*(void**)&this->_SetNamedConfigParm = plugin_getapi(
 			(apiPrefix + "_SetNamedConfigParm").c_str());
+		*(void**)&this->_GetFXGUID = plugin_getapi(
+			(apiPrefix + "_GetFXGUID").c_str());
 		if (fx >= 0) {
 			this->initNamedConfigParams();
 		}
@@ -813,6 +1003,16 @@ class FxParams: public ParamSource {
 		return ns.str();
 	}
 
+	string getCacheKey() final {
+		GUID* guid = this->_GetFXGUID(this->obj, this->fx);
+		if (!guid) {
+			return "";
+		}
+		char guidStr[64];
+		guidToString(guid, guidStr);
+		return guidStr;
+	}
+
 	unique_ptr<Param> getParam(int fx, int param);
 	unique_ptr<Param> getParam(int param) final {
 		auto namedCount = (int)this->namedConfigParams.size();
@@ -1783,158 +1983,32 @@ void cmdParamsFocus(Command* command) {
 	new ParamsDialog(std::move(source));
 }
 
-// Iterates through effects, including effects in containers.
+// Get the name to present for an effect in the menu of effects.
 template<typename ReaperObj>
-class FxIterator {
-	public:
-	FxIterator(ReaperObj obj): obj(obj) {
-		StackItem item;
-		// The first call to next() should move to the first effect, index 0.
-		item.indexInContainer = -1;
-		if constexpr(is_same_v<ReaperObj, MediaTrack*>) {
-			item.containerCount = TrackFX_GetCount(obj);
-		} else {
-			item.containerCount = TakeFX_GetCount(obj);
-		}
-		this->stack.push_back(item);
-	}
-
-	bool next() {
-		StackItem* current = &this->stack.back();
-		if (this->containedCount) {
-			// This is a container. Enter it.
-			StackItem sub;
-			if (this->stack.size() == 1) {
-				// This is a top level container.
-				sub.containerFxIndex = 0x2000000 + current->indexInContainer + 1;
+string getFxMenuName(ReaperObj* obj, const fxTree::Fx& fx) {
+	MessageBuilder s;
+	s << (fx.indexInContainer + 1) << " ";
+	shortenFxName(fx.name.c_str(), s);
+	if constexpr (is_same_v<ReaperObj, MediaTrack>) {
+		if (fx.isRec && fx.level == 1) {
+			s << " ";
+			if (obj == GetMasterTrack(nullptr)) {
+				// Translators: In the menu of effects when opening the FX Parameters
+				// dialog, this is presented after effects which are monitoring FX.
+				s << translate("[monitor]");
 			} else {
-				sub.containerFxIndex = this->fxIndex;
-			}
-			sub.multiplier = current->multiplier * (current->containerCount + 1);
-			sub.containerCount = this->containedCount;
-			this->stack.push_back(sub);
-			return this->success();
-		}
-		for (;;) {
-			// Get the next effect.
-			++current->indexInContainer;
-			if (current->indexInContainer < current->containerCount) {
-				return this->success();
-			}
-			// We've reached the end of this container. Walk out of it.
-			this->stack.pop_back();
-			if (this->stack.empty()) {
-				// There are no more effects of this type.
-				break;
-			}
-			current = &this->stack.back();
-		}
-		if constexpr(is_same_v<ReaperObj, MediaTrack*>) {
-			if (!this->rec) {
-				// There might be input or monitoring effects.
-				return this->firstRec();
+				// Translators: In the menu of effects when opening the FX Parameters
+				// dialog, this is presented after effects which are input FX.
+				s << translate("[input]");
 			}
 		}
-		// There are no more effects.
-		return false;
-	}
-
-	int getFxIndex() {
-		return this->fxIndex;
 	}
-
-	bool isContainer() {
-		return !!this->containedCount;
-	}
-
-	string getName() {
-		char name[256];
-		if constexpr (is_same_v<ReaperObj, MediaTrack*>) {
-			TrackFX_GetFXName(obj, this->fxIndex, name, sizeof(name));
-		} else {
-			TakeFX_GetFXName(obj, this->fxIndex, name, sizeof(name));
-		}
-		ostringstream s;
-		s << (this->stack.back().indexInContainer + 1) << " ";
-		shortenFxName(name, s);
-		if constexpr (is_same_v<ReaperObj, MediaTrack*>) {
-			if (rec && this->stack.size() == 1) {
-				s << " ";
-				if (obj == GetMasterTrack(nullptr)) {
-					// Translators: In the menu of effects when opening the FX Parameters
-					// dialog, this is presented after effects which are monitoring FX.
-					s << translate("[monitor]");
-				} else {
-					// Translators: In the menu of effects when opening the FX Parameters
-					// dialog, this is presented after effects which are input FX.
-					s << translate("[input]");
-				}
-			}
-		}
-		return s.str();
-	}
-
-	int getLevel() {
-		return this->stack.size();
-	}
-
-	private:
-	// Called when we successfully iterate to the next effect.
-	bool success() {
-		// Cache the index for this effect.
-		this->fxIndex = this->rec ? 0x1000000 : 0;
-		const StackItem& item = this->stack.back();
-		if (this->stack.size() == 1) {
-			// We're not in a container.
-			this->fxIndex += item.indexInContainer;
-		} else {
-			this->fxIndex +=
-				(item.indexInContainer + 1) * item.multiplier + item.containerFxIndex;
-		}
-		// If this is a container, cache how many effects it contains.
-		char res[5] = "0";
-		if constexpr (is_same_v<ReaperObj, MediaTrack*>) {
-			TrackFX_GetNamedConfigParm(obj, this->fxIndex, "container_count", res,
-				sizeof(res));
-		} else {
-			TakeFX_GetNamedConfigParm(obj, this->fxIndex, "container_count", res,
-				sizeof(res));
-		}
-		this->containedCount = atoi(res);
-		return true;
-	}
-
-	// Iterate to the first input or monitoring effect, if any.
-	bool firstRec() {
-		int count = TrackFX_GetRecCount(obj);
-		if (count > 0) {
-			this->rec = true;
-			StackItem item;
-			item.indexInContainer = 0;
-			item.containerCount = count;
-			this->stack.push_back(item);
-			return this->success();
-		}
-		return false;
-	}
-
-	ReaperObj obj;
-	bool rec = false;
-	int fxIndex = -1;
-	int containedCount = 0;
-
-	struct StackItem {
-		int indexInContainer = 0;
-		int containerCount = 0;
-		int containerFxIndex = 0;
-		int multiplier = 1;
-	};
-	vector<StackItem> stack;
-};
+	return s.str();
+}
 
 template<typename ReaperObj>
 void fxParams_begin(ReaperObj* obj, const string& apiPrefix) {
-	FxIterator iter(obj);
+	const fxTree::Tree& tree = fxTree::get(obj);
 	int fx = -1;
 	// Present a menu of effects.
 	// We might have sub-menus, so we need a stack.
@@ -1943,19 +2017,19 @@ void fxParams_begin(ReaperObj* obj, const string& apiPrefix) {
 	MENUITEMINFO itemInfo;
 	itemInfo.cbSize = sizeof(MENUITEMINFO);
 	int count = 0;
-	while (iter.next()) {
+	for (const fxTree::Fx& treeFx: tree.fx) {
 		// If we've exited containers, move to the appropriate ancestor menu.
-		for (int level = menus.size(); level > iter.getLevel(); --level) {
+		for (int level = menus.size(); level > treeFx.level; --level) {
 			menus.pop_back();
 		}
 		itemInfo.fMask = MIIM_TYPE;
 		itemInfo.fType = MFT_STRING;
 		// Make sure this stays around until the InsertMenuItem call.
-		const string name = iter.getName();
+		const string name = getFxMenuName(obj, treeFx);
 		itemInfo.dwTypeData = (char*)name.c_str();
 		itemInfo.cch = name.length();
-		fx = iter.getFxIndex();
-		if (iter.isContainer()) {
+		fx = treeFx.index;
+		if (treeFx.containedCount) {
 			// Create a sub-menu for this container.
 			itemInfo.fMask |= MIIM_SUBMENU;
 			HMENU subMenu = CreatePopupMenu();
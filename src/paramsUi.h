@@ -11,3 +11,6 @@ void cmdFxParamsFocus(Command* command);
 void cmdFxParamsMaster(Command* command);
 void cmdParamsFocus(Command* command);
 extern bool isParamsDialogOpen;
+// Called when an FX chain changes, since cached parameter names might be
+// stale.
+void invalidateParamInfoCache();
@@ -6,6 +6,8 @@
  */
 
 #include <math.h>
+#include <algorithm>
+#include <atomic>
 #include <string>
 #include <sstream>
 #include <iomanip>
@@ -13,7 +15,6 @@
 #include <variant>
 #include <vector>
 #include<map>
-#include<array>
 #include <utility>
 // osara.h includes windows.h, which must be included before other Windows
 // headers.
@@ -25,9 +26,12 @@
 #include <WDL/win32_utf8.h>
 #include <WDL/db2val.h>
 #include <WDL/wdltypes.h>
+#include "config.h"
 #include "fxChain.h"
+#include "latency.h"
 #include "resource.h"
 #include "translation.h"
+#include "messageBuilder.h"
 
 using namespace std;
 
@@ -48,7 +52,7 @@ T& varGet(V& var) {
 	return *get_if<T>(&var);
 }
 
-class Watcher;
+class WatcherSet;
 bool isWatchingAnything();
 void stop();
 bool isPaused{false};
@@ -65,8 +69,8 @@ struct LevelType {
 	// This means that values greater than the notification level will be reported
 	// and the maximum value will be held if appropriate.
 	bool isSmallerSignificant : 1;
-	double (*getLevel)(Watcher& watcher, int channel);
-	void (*reset)(Watcher& watcher);
+	double (*getLevel)(WatcherSet& set, int watcher, int channel);
+	void (*reset)(WatcherSet& set, int watcher);
 
 	bool isLevelSignificant(double a, double b) const {
 		if (this->isSmallerSignificant) {
@@ -111,89 +115,354 @@ void describeTarget(Target& target, ostringstream& s) {
 	}
 }
 
-const int NUM_CHANNELS = 2;
+// The number of watchers and channels provided by default. Users can add more
+// watchers and channels are added as needed by the targets being watched.
+const int DEFAULT_WATCHERS = 2;
+const int DEFAULT_CHANNELS = 2;
+// REAPER tracks can have at most 128 channels.
+const int MAX_CHANNELS = 128;
+// This keeps the configuration menu and each tick bounded.
+const int MAX_WATCHERS = 64;
 
 // Peak Watcher can watch one or more values. Each "watcher" consists of a
 // target, level type and other parameters that determine how/when it is
-// reported.
-class Watcher {
+// reported. All of the watchers for a project are kept in a WatcherSet.
+// Per-watcher and per-channel state are each stored in contiguous arrays so
+// that a tick over many watchers stays cache friendly.
+class WatcherSet {
 	public:
-	unsigned int levelType = 0;
-	const LevelType& levelTypeInfo();
-	Target target;
-	bool follow = false;
-	void description(ostringstream& s);
-	double notifyLevel = 0;
+	// Per-watcher state, indexed by watcher.
+	vector<unsigned int> levelType;
+	vector<Target> target;
+	vector<unsigned char> follow;
+	vector<double> notifyLevel;
 	// Hold time in ms; -1 disabled, 0 forever.
-	int hold = 0;
-	struct {
-		bool notify = true;
-		double peak = NO_LEVEL;
-		DWORD time = 0;
-	} channels[NUM_CHANNELS];
+	vector<int> hold;
+	// The number of channels measured for each watcher.
+	vector<int> numChannels;
+	// The loudness meter effect used by each watcher, if any. See
+	// getLoudnessMeterParam.
+	vector<MediaTrack*> meterTrack;
+	vector<int> meterFx;
+	vector<GUID> meterGuid;
+	vector<unsigned int> meterGeneration;
+
+	// Per-channel state, indexed by channel().
+	vector<unsigned char> notify;
+	vector<double> peak;
+	vector<DWORD> time;
+
+	WatcherSet() {
+		for (int w = 0; w < DEFAULT_WATCHERS; ++w) {
+			this->add();
+		}
+	}
 
-	bool isDisabled() {
-		return holds_alternative<NoTarget>(target);
+	int size() const {
+		return (int)this->target.size();
 	}
 
-	Target getLatestFollowTarget() {
-		if (holds_alternative<MediaTrack*>(this->target)) {
-			return GetLastTouchedTrack();
-		}
-		return this->target;
+	int getChannelStride() const {
+		return this->channelStride;
 	}
 
-	bool isValid() {
-		if (MediaTrack** track = get_if<MediaTrack*>(&this->target)) {
-			return *track && ValidatePtr((void*)*track, "MediaTrack*");
-		}
-		return true;
+	size_t channel(int watcher, int channel) const {
+		return (size_t)watcher * this->channelStride + channel;
 	}
 
-	void reset() {
-		for (auto& channel : this->channels) {
-			channel.peak = NO_LEVEL;
-		}
-		const LevelType& levelType = this->levelTypeInfo();
-		if (!this->isDisabled() && levelType.reset) {
-			levelType.reset(*this);
+	// Returns the index of the new watcher.
+	int add() {
+		this->levelType.push_back(0);
+		this->target.push_back(NoTarget());
+		this->follow.push_back(false);
+		this->notifyLevel.push_back(0);
+		this->hold.push_back(0);
+		this->numChannels.push_back(DEFAULT_CHANNELS);
+		this->meterTrack.push_back(nullptr);
+		this->meterFx.push_back(-1);
+		this->meterGuid.push_back({});
+		this->meterGeneration.push_back(0);
+		this->notify.insert(this->notify.end(), this->channelStride, true);
+		this->peak.insert(this->peak.end(), this->channelStride, NO_LEVEL);
+		this->time.insert(this->time.end(), this->channelStride, 0);
+		return this->size() - 1;
+	}
+
+	// Remove a watcher. Later watchers move down one index.
+	void remove(int watcher) {
+		auto eraseAt = [watcher](auto& values) {
+			values.erase(values.begin() + watcher);
+		};
+		eraseAt(this->levelType);
+		eraseAt(this->target);
+		eraseAt(this->follow);
+		eraseAt(this->notifyLevel);
+		eraseAt(this->hold);
+		eraseAt(this->numChannels);
+		eraseAt(this->meterTrack);
+		eraseAt(this->meterFx);
+		eraseAt(this->meterGuid);
+		eraseAt(this->meterGeneration);
+		auto eraseChannels = [this, watcher](auto& values) {
+			auto first = values.begin() + this->channel(watcher, 0);
+			values.erase(first, first + this->channelStride);
+		};
+		eraseChannels(this->notify);
+		eraseChannels(this->peak);
+		eraseChannels(this->time);
+	}
+
+	// Make room for at least count channels for every watcher. This only
+	// reallocates when count exceeds the current stride, which is rare.
+	void ensureChannels(int count) {
+		if (count <= this->channelStride) {
+			return;
 		}
+		const int oldStride = this->channelStride;
+		this->channelStride = count;
+		restride(this->notify, oldStride, (unsigned char)true);
+		restride(this->peak, oldStride, NO_LEVEL);
+		restride(this->time, oldStride, (DWORD)0);
 	}
 
-	// Returns false if all watchers are disabled.
-	bool disable() {
-		this->reset();
-		this->target = NoTarget();
-		if (!isWatchingAnything()) {
-			stop();
-			return false;
+	private:
+	template<typename T>
+	void restride(vector<T>& values, int oldStride, T fill) {
+		vector<T> newValues(this->size() * this->channelStride, fill);
+		for (int w = 0; w < this->size(); ++w) {
+			copy(values.begin() + w * oldStride,
+				values.begin() + (w + 1) * oldStride,
+				newValues.begin() + this->channel(w, 0));
 		}
-		return true;
+		values.swap(newValues);
 	}
+
+	int channelStride = DEFAULT_CHANNELS;
 };
 
-const int NUM_WATCHERS = 2;
-map<const ReaProject*, array<Watcher, NUM_WATCHERS> > watchers;
+map<const ReaProject*, WatcherSet> watchers;
+// Cache the watchers for the current project so tick doesn't need to look them
+// up in the map.
+const ReaProject* cachedProject = nullptr;
+WatcherSet* cachedWatchers = nullptr;
+
+WatcherSet& currentWatchers() {
+	const ReaProject* project = currentProject();
+	if (!cachedWatchers || project != cachedProject) {
+		cachedWatchers = &watchers[project];
+		cachedProject = project;
+	}
+	return *cachedWatchers;
+}
 
-const char* WATCHER_NAMES[NUM_WATCHERS] = {
+const char* WATCHER_NAMES[DEFAULT_WATCHERS] = {
 	_t("1st watcher"),
 	_t("2nd watcher"),
 };
-const char* CHANNEL_NAMES[NUM_CHANNELS] = {
+
+string getWatcherName(int watcher) {
+	if (watcher < DEFAULT_WATCHERS) {
+		return translate(WATCHER_NAMES[watcher]);
+	}
+	// Translators: The name of a Peak Watcher watcher beyond the second.
+	// {} will be replaced with the watcher number; e.g. "watcher 3".
+	return format(translate("watcher {}"), watcher + 1);
+}
+
+const char* CHANNEL_NAMES[DEFAULT_CHANNELS] = {
 	_t("1st chan"),
 	_t("2nd chan"),
 };
 
+string getChannelName(int channel) {
+	if (channel < DEFAULT_CHANNELS) {
+		return translate(CHANNEL_NAMES[channel]);
+	}
+	// Translators: The name of a Peak Watcher channel beyond the second.
+	// {} will be replaced with the channel number; e.g. "chan 3".
+	return format(translate("chan {}"), channel + 1);
+}
+
 UINT_PTR timer = 0;
+UINT timerInterval = 0;
+const UINT TICK_INTERVAL = 30;
+// While the transport is stopped, we tick less often. Peaks are held between
+// ticks, so nothing is missed; they are just reported a little later.
+const UINT IDLE_TICK_INTERVAL = 150;
+
+// In high resolution mode, master track peaks are measured from every sample
+// sent to the hardware outputs by an audio hook, rather than from the meters
+// REAPER updates for its UI. The audio thread only ever raises these values.
+// The UI thread reads and resets them once each tick into tickHwPeaks, so
+// every watcher of the master sees the same peaks.
+const int MAX_HW_CHANNELS = 64;
+atomic<float> hwPeaks[MAX_HW_CHANNELS];
+float tickHwPeaks[MAX_HW_CHANNELS] = {};
+
+// Which hardware outputs carry the master track's channels. The hardware
+// outputs only measure the master track if it is the only thing sent to them,
+// so the mapping is only valid if the master has a single hardware output, no
+// monitoring FX and no other track sends to hardware outputs.
+struct HwMapping {
+	ReaProject* project = nullptr;
+	int stateCount = -1;
+	bool isValid = false;
+	// The first hardware output and the number of master channels sent to it.
+	int firstOutput = 0;
+	int numChannels = 0;
+};
+HwMapping hwMapping;
+
+const HwMapping& getHwMapping() {
+	ReaProject* project = currentProject();
+	const int stateCount = GetProjectStateChangeCount(project);
+	if (project == hwMapping.project && stateCount == hwMapping.stateCount) {
+		return hwMapping;
+	}
+	hwMapping.project = project;
+	hwMapping.stateCount = stateCount;
+	hwMapping.isValid = false;
+	MediaTrack* master = GetMasterTrack(project);
+	if (GetTrackNumSends(master, 1) != 1 || TrackFX_GetRecCount(master) > 0) {
+		return hwMapping;
+	}
+	for (int t = 0; t < CountTracks(project); ++t) {
+		if (GetTrackNumSends(GetTrack(project, t), 1) > 0) {
+			return hwMapping;
+		}
+	}
+	const int src = *(int*)GetSetTrackSendInfo(master, 1, 0, "I_SRCCHAN",
+		nullptr);
+	const int dst = *(int*)GetSetTrackSendInfo(master, 1, 0, "I_DSTCHAN",
+		nullptr);
+	constexpr int MONO_FLAG = 1 << 10;
+	// We don't know how channels map if the send doesn't start at the master's
+	// first channel.
+	if (src == -1 || (src & (MONO_FLAG - 1)) != 0) {
+		return hwMapping;
+	}
+	const int srcChans = src >> 10;
+	hwMapping.numChannels = srcChans == 0 ? 2 : srcChans == 1 ? 1 : srcChans * 2;
+	if (dst & MONO_FLAG) {
+		hwMapping.numChannels = 1;
+	}
+	hwMapping.firstOutput = dst & (MONO_FLAG - 1);
+	hwMapping.numChannels = min(hwMapping.numChannels,
+		MAX_HW_CHANNELS - hwMapping.firstOutput);
+	hwMapping.isValid = hwMapping.numChannels > 0;
+	return hwMapping;
+}
+
+void onAudioBuffer(bool isPost, int len, double srate,
+	audio_hook_register_t* reg
+) {
+	if (!isPost) {
+		return;
+	}
+	const int numChannels = min(reg->output_nch, MAX_HW_CHANNELS);
+	for (int c = 0; c < numChannels; ++c) {
+		const ReaSample* buf = reg->GetBuffer(true, c);
+		if (!buf) {
+			continue;
+		}
+		float peak = 0.0f;
+		for (int i = 0; i < len; ++i) {
+			const float value = (float)fabs(buf[i]);
+			if (value > peak) {
+				peak = value;
+			}
+		}
+		atomic<float>& held = hwPeaks[c];
+		float old = held.load(memory_order_relaxed);
+		while (peak > old &&
+			!held.compare_exchange_weak(old, peak, memory_order_relaxed)) {
+		}
+	}
+}
+
+audio_hook_register_t audioHook = {onAudioBuffer};
+bool isAudioHookRegistered = false;
+
+bool isWatchingMasterPeaks() {
+	WatcherSet& set = currentWatchers();
+	MediaTrack* master = GetMasterTrack(nullptr);
+	for (int w = 0; w < set.size(); ++w) {
+		// Peak dB is the first level type.
+		if (set.levelType[w] == 0) {
+			MediaTrack** track = get_if<MediaTrack*>(&set.target[w]);
+			if (track && *track == master) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Register or unregister the audio hook according to whether Peak Watcher is
+// running, high resolution mode is enabled, a watcher is watching master track
+// peaks and we know which hardware outputs those peaks are sent to. This is
+// called every tick, so the hook is only running while it is useful. If the
+// hook is running, this also collects the peaks since the last tick.
+void updateAudioHook() {
+	const bool needed = timer && settings::peakWatcherHighResolution &&
+		isWatchingMasterPeaks() && getHwMapping().isValid;
+	if (needed != isAudioHookRegistered) {
+		if (needed) {
+			for (auto& peak : hwPeaks) {
+				peak.store(0.0f, memory_order_relaxed);
+			}
+		}
+		Audio_RegHardwareHook(needed, &audioHook);
+		isAudioHookRegistered = needed;
+	}
+	if (isAudioHookRegistered) {
+		for (int c = 0; c < MAX_HW_CHANNELS; ++c) {
+			tickHwPeaks[c] = hwPeaks[c].exchange(0.0f, memory_order_relaxed);
+		}
+	}
+}
 
 const char FX_LOUDNESS_METER[] = "loudness_meter";
 
-double getLoudnessMeterParam(Watcher& watcher,
-	int configParam, double configValue, int queryParam
+// Incremented whenever an FX chain might have changed, which means cached
+// loudness meter indexes might be stale.
+unsigned int fxChainGeneration = 1;
+
+void onFxChainChange() {
+	++fxChainGeneration;
+}
+
+// Find the loudness meter effect for a watcher, adding it if necessary. The
+// effect is cached by index and GUID, so we only need to search the chain when
+// it changes.
+int getLoudnessMeter(WatcherSet& set, int w, int configParam,
+	double configValue
 ) {
-	assert(holds_alternative<MediaTrack*>(watcher.target));
-	MediaTrack* track = varGet<MediaTrack*>(watcher.target);
-	int fx = TrackFX_AddByName(track, FX_LOUDNESS_METER, /* recFX */ false,
+	MediaTrack* track = varGet<MediaTrack*>(set.target[w]);
+	int& fx = set.meterFx[w];
+	if (fx != -1 && set.meterTrack[w] == track) {
+		if (set.meterGeneration[w] == fxChainGeneration) {
+			return fx;
+		}
+		// The chain changed. Check whether the effect has moved.
+		GUID* guid = TrackFX_GetFXGUID(track, fx);
+		if (!guid || memcmp(guid, &set.meterGuid[w], sizeof(GUID)) != 0) {
+			fx = -1;
+			const int count = TrackFX_GetCount(track);
+			for (int f = 0; f < count; ++f) {
+				guid = TrackFX_GetFXGUID(track, f);
+				if (guid && memcmp(guid, &set.meterGuid[w], sizeof(GUID)) == 0) {
+					fx = f;
+					break;
+				}
+			}
+		}
+		if (fx != -1) {
+			set.meterGeneration[w] = fxChainGeneration;
+			return fx;
+		}
+	}
+	fx = TrackFX_AddByName(track, FX_LOUDNESS_METER, /* recFX */ false,
 		0 /* don't create */);
 	if (fx == -1) {
 		// Add the effect.
@@ -201,7 +470,7 @@ double getLoudnessMeterParam(Watcher& watcher,
 			1 /* create if not found */);
 		if (fx == -1) {
 			// Effect doesn't exist!
-			return NO_LEVEL;
+			return -1;
 		}
 		// Turn off all level types.
 		for (int param = 0; param <= 6; ++param) {
@@ -217,17 +486,36 @@ double getLoudnessMeterParam(Watcher& watcher,
 	// another value earlier if two different values are being watched on the same
 	// track.
 	TrackFX_SetParam(track, fx, configParam, configValue);
-	return TrackFX_GetParam(track, fx, queryParam, nullptr, nullptr);
+	set.meterTrack[w] = track;
+	if (GUID* guid = TrackFX_GetFXGUID(track, fx)) {
+		set.meterGuid[w] = *guid;
+	}
+	// Adding the effect changed the chain, but we already know where it is.
+	set.meterGeneration[w] = ++fxChainGeneration;
+	return fx;
 }
 
-void deleteLoudnessMeter(Watcher& watcher) {
-	assert(holds_alternative<MediaTrack*>(watcher.target));
-	MediaTrack* track = varGet<MediaTrack*>(watcher.target);
+double getLoudnessMeterParam(WatcherSet& set, int w,
+	int configParam, double configValue, int queryParam
+) {
+	assert(holds_alternative<MediaTrack*>(set.target[w]));
+	int fx = getLoudnessMeter(set, w, configParam, configValue);
+	if (fx == -1) {
+		return NO_LEVEL;
+	}
+	return TrackFX_GetParam(set.meterTrack[w], fx, queryParam, nullptr,
+		nullptr);
+}
+
+void deleteLoudnessMeter(WatcherSet& set, int w) {
+	assert(holds_alternative<MediaTrack*>(set.target[w]));
+	MediaTrack* track = varGet<MediaTrack*>(set.target[w]);
 	int fx = TrackFX_AddByName(track, FX_LOUDNESS_METER, /* recFX */ false,
 		0 /* don't create */);
 	if (fx != -1) {
 		TrackFX_Delete(track, fx);
 	}
+	set.meterFx[w] = -1;
 }
 
 bool isTrackLevelTypeSupported(const Target& target) {
@@ -241,9 +529,14 @@ const LevelType LEVEL_TYPES[] = {
 		/* isSupported */ isTrackLevelTypeSupported,
 		/* separateChannels */ true,
 		/* isSmallerSignificant */ false,
-		/* getValue */ [](Watcher& watcher, int channel) {
-			assert(holds_alternative<MediaTrack*>(watcher.target));
-			MediaTrack* track = varGet<MediaTrack*>(watcher.target);
+		/* getValue */ [](WatcherSet& set, int w, int channel) {
+			assert(holds_alternative<MediaTrack*>(set.target[w]));
+			MediaTrack* track = varGet<MediaTrack*>(set.target[w]);
+			if (isAudioHookRegistered && channel < hwMapping.numChannels &&
+					track == GetMasterTrack(nullptr)) {
+				return (double)VAL2DB(
+					tickHwPeaks[hwMapping.firstOutput + channel]);
+			}
 			// #119: We use Track_GetPeakHoldDB even when Peak Watcher's hold
 			//  functionality is disabled because we only measure every 30 ms and we
 			// might miss peaks.
@@ -259,8 +552,8 @@ const LevelType LEVEL_TYPES[] = {
 		/* isSupported */ isTrackLevelTypeSupported,
 		/* separateChannels */ false,
 		/* isSmallerSignificant */ false,
-		/* getValue */ [](Watcher& watcher, int channel) {
-			return getLoudnessMeterParam(watcher, 6, 1.0, 20);
+		/* getValue */ [](WatcherSet& set, int w, int channel) {
+			return getLoudnessMeterParam(set, w, 6, 1.0, 20);
 		},
 		/* reset */ deleteLoudnessMeter,
 	},
@@ -268,8 +561,8 @@ const LevelType LEVEL_TYPES[] = {
 		/* isSupported */ isTrackLevelTypeSupported,
 		/* separateChannels */ false,
 		/* isSmallerSignificant */ false,
-		/* getValue */ [](Watcher& watcher, int channel) {
-			return getLoudnessMeterParam(watcher, 3, 1.0, 18);
+		/* getValue */ [](WatcherSet& set, int w, int channel) {
+			return getLoudnessMeterParam(set, w, 3, 1.0, 18);
 		},
 		/* reset */ deleteLoudnessMeter,
 	},
@@ -277,8 +570,8 @@ const LevelType LEVEL_TYPES[] = {
 		/* isSupported */ isTrackLevelTypeSupported,
 		/* separateChannels */ false,
 		/* isSmallerSignificant */ false,
-		/* getValue */ [](Watcher& watcher, int channel) {
-			return getLoudnessMeterParam(watcher, 4, 1.0, 19);
+		/* getValue */ [](WatcherSet& set, int w, int channel) {
+			return getLoudnessMeterParam(set, w, 4, 1.0, 19);
 		},
 		/* reset */ deleteLoudnessMeter,
 	},
@@ -286,8 +579,8 @@ const LevelType LEVEL_TYPES[] = {
 		/* isSupported */ isTrackLevelTypeSupported,
 		/* separateChannels */ false,
 		/* isSmallerSignificant */ false,
-		/* getValue */ [](Watcher& watcher, int channel) {
-			return getLoudnessMeterParam(watcher, 5, 1.0, 21);
+		/* getValue */ [](WatcherSet& set, int w, int channel) {
+			return getLoudnessMeterParam(set, w, 5, 1.0, 21);
 		},
 		/* reset */ deleteLoudnessMeter,
 	},
@@ -295,8 +588,8 @@ const LevelType LEVEL_TYPES[] = {
 		/* isSupported */ isTrackLevelTypeSupported,
 		/* separateChannels */ false,
 		/* isSmallerSignificant */ false,
-		/* getValue */ [](Watcher& watcher, int channel) {
-			return getLoudnessMeterParam(watcher, 2, 1.0, 17);
+		/* getValue */ [](WatcherSet& set, int w, int channel) {
+			return getLoudnessMeterParam(set, w, 2, 1.0, 17);
 		},
 		/* reset */ deleteLoudnessMeter,
 	},
@@ -304,8 +597,8 @@ const LevelType LEVEL_TYPES[] = {
 		/* isSupported */ isTrackLevelTypeSupported,
 		/* separateChannels */ false,
 		/* isSmallerSignificant */ false,
-		/* getValue */ [](Watcher& watcher, int channel) {
-			return getLoudnessMeterParam(watcher, 1, 1.0, 16);
+		/* getValue */ [](WatcherSet& set, int w, int channel) {
+			return getLoudnessMeterParam(set, w, 1, 1.0, 16);
 		},
 		/* reset */ deleteLoudnessMeter,
 	},
@@ -313,8 +606,8 @@ const LevelType LEVEL_TYPES[] = {
 		/* isSupported */ isTrackLevelTypeSupported,
 		/* separateChannels */ false,
 		/* isSmallerSignificant */ false,
-		/* getValue */ [](Watcher& watcher, int channel) {
-			return getLoudnessMeterParam(watcher, 0, 1.0, 15);
+		/* getValue */ [](WatcherSet& set, int w, int channel) {
+			return getLoudnessMeterParam(set, w, 0, 1.0, 15);
 		},
 		/* reset */ deleteLoudnessMeter,
 	},
@@ -330,8 +623,8 @@ const LevelType LEVEL_TYPES[] = {
 		},
 		/* separateChannels */ false,
 		/* isSmallerSignificant */ true,
-		/* getValue */ [](Watcher& watcher, int channel) {
-			const TrackFx* tfx = get_if<TrackFx>(&watcher.target);
+		/* getValue */ [](WatcherSet& set, int w, int channel) {
+			const TrackFx* tfx = get_if<TrackFx>(&set.target[w]);
 			assert(tfx);
 			char text[10];
 			if (!TrackFX_GetNamedConfigParm(tfx->first, tfx->second,
@@ -346,30 +639,87 @@ const LevelType LEVEL_TYPES[] = {
 constexpr unsigned int NUM_LEVEL_TYPES = sizeof(LEVEL_TYPES) /
 	sizeof(LevelType);
 
-const LevelType& Watcher::levelTypeInfo() {
-	return LEVEL_TYPES[this->levelType];
+const LevelType& getLevelTypeInfo(WatcherSet& set, int w) {
+	return LEVEL_TYPES[set.levelType[w]];
+}
+
+bool isWatcherDisabled(WatcherSet& set, int w) {
+	return holds_alternative<NoTarget>(set.target[w]);
 }
 
-void Watcher::description(ostringstream& s) {
-	if (this->isDisabled()) {
+Target getLatestFollowTarget(WatcherSet& set, int w) {
+	if (holds_alternative<MediaTrack*>(set.target[w])) {
+		return GetLastTouchedTrack();
+	}
+	return set.target[w];
+}
+
+bool isWatcherValid(WatcherSet& set, int w) {
+	if (MediaTrack** track = get_if<MediaTrack*>(&set.target[w])) {
+		return *track && ValidatePtr((void*)*track, "MediaTrack*");
+	}
+	return true;
+}
+
+// The number of channels we need to measure for a watcher's current target.
+int getTargetChannelCount(WatcherSet& set, int w) {
+	if (!getLevelTypeInfo(set, w).separateChannels) {
+		return 1;
+	}
+	if (MediaTrack** track = get_if<MediaTrack*>(&set.target[w])) {
+		int count = *(int*)GetSetMediaTrackInfo(*track, "I_NCHAN", nullptr);
+		return max(min(count, MAX_CHANNELS), 1);
+	}
+	return DEFAULT_CHANNELS;
+}
+
+void resetWatcherLevels(WatcherSet& set, int w) {
+	fill_n(set.peak.begin() + set.channel(w, 0), set.getChannelStride(),
+		NO_LEVEL);
+	const LevelType& levelType = getLevelTypeInfo(set, w);
+	if (!isWatcherDisabled(set, w) && levelType.reset) {
+		levelType.reset(set, w);
+	}
+}
+
+// Returns false if all watchers are disabled.
+bool disableWatcher(WatcherSet& set, int w) {
+	resetWatcherLevels(set, w);
+	set.target[w] = NoTarget();
+	if (!isWatchingAnything()) {
+		stop();
+		return false;
+	}
+	return true;
+}
+
+void describeWatcher(WatcherSet& set, int w, ostringstream& s) {
+	if (isWatcherDisabled(set, w)) {
 		s << translate("not configured");
 		return;
 	}
-	if (this->follow) {
-		if (holds_alternative<MediaTrack*>(this->target)) {
+	if (set.follow[w]) {
+		if (holds_alternative<MediaTrack*>(set.target[w])) {
 			s << translate("following last touched track");
 		}
 	} else {
-		describeTarget(target, s);
+		describeTarget(set.target[w], s);
 	}
-	s << " " << translate(this->levelTypeInfo().name) << " " << this->notifyLevel << " " << translate("threshold");
+	s << " " << translate(getLevelTypeInfo(set, w).name) << " " <<
+		set.notifyLevel[w] << " " << translate("threshold");
 }
 
 void resetWatcher(int watcherIndex, bool report=false) {
-	Watcher& watcher = watchers[currentProject()][watcherIndex];
-	watcher.reset();
+	WatcherSet& set = currentWatchers();
+	if (watcherIndex >= set.size()) {
+		if (report) {
+			outputMessage(translate("watcher disabled"));
+		}
+		return;
+	}
+	resetWatcherLevels(set, watcherIndex);
 	if (report) {
-		if (watcher.isDisabled()) {
+		if (isWatcherDisabled(set, watcherIndex)) {
 			// Translators: Reported when the user tries to reset a Peak Watcher
 			// value, but that watcher is disabled.
 			outputMessage(translate("watcher disabled"));
@@ -380,10 +730,10 @@ void resetWatcher(int watcherIndex, bool report=false) {
 	}
 }
 
-bool isWatchingMultipleValues() {
+bool isWatchingMultipleValues(WatcherSet& set) {
 	int count = 0;
-	for (Watcher& watcher : watchers[currentProject()]) {
-		if (!watcher.isDisabled()) {
+	for (const Target& target : set.target) {
+		if (!holds_alternative<NoTarget>(target)) {
 			++count;
 		}
 		if (count > 1) {
@@ -393,30 +743,34 @@ bool isWatchingMultipleValues() {
 	return count > 1;
 }
 
+void setTimerInterval(UINT interval);
+
 void CALLBACK tick(HWND hwnd, UINT msg, UINT_PTR event, DWORD time) {
-	ostringstream s;
-	s << fixed << setprecision(1);
-	const bool multiple = isWatchingMultipleValues();
-	auto& projWatchers = watchers[currentProject()];
-	for (int w = 0; w < NUM_WATCHERS; ++w) {
-		Watcher& watcher = projWatchers[w];
-		if (watcher.isDisabled()) {
+	latency::Scope latencyScope(latency::SOURCE_PEAK_WATCHER);
+	setTimerInterval(GetPlayState() == 0 ? IDLE_TICK_INTERVAL : TICK_INTERVAL);
+	updateAudioHook();
+	// This runs every tick, so avoid allocating.
+	MessageBuilder s;
+	WatcherSet& set = currentWatchers();
+	const bool multiple = isWatchingMultipleValues(set);
+	for (int w = 0; w < set.size(); ++w) {
+		if (isWatcherDisabled(set, w)) {
 			continue;
 		}
-		const LevelType& levelType = watcher.levelTypeInfo();
-		if (watcher.follow) {
-			Target latest = watcher.getLatestFollowTarget();
-			if (latest != watcher.target) {
+		const LevelType& levelType = getLevelTypeInfo(set, w);
+		if (set.follow[w]) {
+			Target latest = getLatestFollowTarget(set, w);
+			if (latest != set.target[w]) {
 				// We're following a target and it changed.
-				watcher.reset();
-				watcher.target = latest;
-				if (!watcher.isValid()) {
+				resetWatcherLevels(set, w);
+				set.target[w] = latest;
+				if (!isWatcherValid(set, w)) {
 					continue; // No current target, so nothing to do.
 				}
 			}
-		} else if (!watcher.isValid()) {
+		} else if (!isWatcherValid(set, w)) {
 			// We're not following and our target is gone. Disable this watcher.
-			if (!watcher.disable()) {
+			if (!disableWatcher(set, w)) {
 				// All watchers are disabled, so stop processing altogether.
 				return;
 			}
@@ -425,51 +779,57 @@ void CALLBACK tick(HWND hwnd, UINT msg, UINT_PTR event, DWORD time) {
 
 		// If this level type doesn't care about separate channels, we only need
 		// to process one channel.
-		const int numChannels = levelType.separateChannels ?
-			NUM_CHANNELS : 1;
-		bool watcherReported = false;
+		const int numChannels = getTargetChannelCount(set, w);
+		set.ensureChannels(numChannels);
+		set.numChannels[w] = numChannels;
+		const size_t first = set.channel(w, 0);
 		for (int c = 0; c < numChannels; ++c) {
-			auto& chan = watcher.channels[c];
-			double newPeak = levelType.getLevel(watcher, c) ;
-			if (watcher.hold == -1 // Hold disabled
-				|| levelType.isLevelSignificant(newPeak, chan.peak)
-				|| (watcher.hold != 0 && time > chan.time + watcher.hold)
+			double newPeak = levelType.getLevel(set, w, c);
+			const size_t i = first + c;
+			const int hold = set.hold[w];
+			if (hold == -1 // Hold disabled
+				|| levelType.isLevelSignificant(newPeak, set.peak[i])
+				|| (hold != 0 && time > set.time[i] + hold)
 			) {
-				chan.peak = newPeak;
-				chan.time = time;
-				if (chan.notify &&
+				set.peak[i] = newPeak;
+				set.time[i] = time;
+				if (set.notify[i] &&
 						newPeak != NO_LEVEL &&
-						levelType.isLevelSignificant(newPeak, watcher.notifyLevel)) {
-					if (s.tellp() > 0) {
-						s << ", ";
-					}
-					if (!watcherReported && multiple) {
+						levelType.isLevelSignificant(newPeak, set.notifyLevel[w])) {
+					s.clear();
+					if (multiple) {
 						// Only report which watcher if watching more than one target.
-						s << translate(WATCHER_NAMES[w]) << " ";
-						watcherReported = true;
+						s << getWatcherName(w) << " ";
 					}
 					if (levelType.separateChannels) {
-						s << translate(CHANNEL_NAMES[c]) << " ";
+						s << getChannelName(c) << " ";
 					}
-					s << newPeak;
-					outputMessage(s);
+					s.format("{:.1f}", newPeak);
+					// Key by channel so that a queued report for another channel or
+					// watcher isn't replaced.
+					outputMessage(s, /* interrupt */ true, MS_PEAK_WATCHER, (int)i);
 				}
 			}
 		}
-		if (!levelType.separateChannels) {
-			// Copy the value to the other channels for on-demand reporting.
-			for (int c = 1; c < NUM_CHANNELS; ++c) {
-				watcher.channels[c].peak = watcher.channels[0].peak;
-			}
-		}
 	}
 }
 
+void setTimerInterval(UINT interval) {
+	if (!timer || interval == timerInterval) {
+		return;
+	}
+	KillTimer(nullptr, timer);
+	timer = SetTimer(nullptr, 0, interval, tick);
+	timerInterval = interval;
+}
+
 void start() {
 	if (timer) {
 		return;
 	}
-	timer = SetTimer(nullptr, 0, 30, tick);
+	timer = SetTimer(nullptr, 0, TICK_INTERVAL, tick);
+	timerInterval = TICK_INTERVAL;
+	updateAudioHook();
 }
 
 void stop() {
@@ -477,11 +837,12 @@ void stop() {
 		KillTimer(nullptr, timer);
 		timer = 0;
 	}
+	updateAudioHook();
 }
 
 bool isWatchingAnything() {
-	for (Watcher& watcher : watchers[currentProject()]) {
-		if (!watcher.isDisabled()) {
+	for (const Target& target : currentWatchers().target) {
+		if (!holds_alternative<NoTarget>(target)) {
 			return true;
 		}
 	}
@@ -518,61 +879,132 @@ vector<unsigned int> getSupportedLevelTypes(const Target& target) {
 	return types;
 }
 
+// Format the channels for which notification is enabled as a list of ranges;
+// e.g. "1-2, 5".
+string formatNotifyChannels(WatcherSet& set, int w, int count) {
+	ostringstream s;
+	const size_t first = set.channel(w, 0);
+	for (int c = 0; c < count; ++c) {
+		if (!set.notify[first + c]) {
+			continue;
+		}
+		int end = c;
+		while (end + 1 < count && set.notify[first + end + 1]) {
+			++end;
+		}
+		if (s.tellp() > 0) {
+			s << ", ";
+		}
+		s << c + 1;
+		if (end > c) {
+			s << "-" << end + 1;
+		}
+		c = end;
+	}
+	return s.str();
+}
+
+// Parse a list of channel ranges as produced by formatNotifyChannels and
+// enable notification for only those channels.
+void parseNotifyChannels(WatcherSet& set, int w, const char* text) {
+	vector<pair<int, int>> ranges;
+	int maxChannel = 0;
+	const char* p = text;
+	while (*p) {
+		char* end;
+		long from = strtol(p, &end, 10);
+		if (end == p) {
+			// Not a number, so skip this character; e.g. a separator.
+			++p;
+			continue;
+		}
+		p = end;
+		long to = from;
+		while (*p == ' ') {
+			++p;
+		}
+		if (*p == '-') {
+			to = strtol(p + 1, &end, 10);
+			if (end == p + 1) {
+				to = from;
+			}
+			p = end;
+		}
+		from = max(from, 1L);
+		to = min(to, (long)MAX_CHANNELS);
+		if (from > to) {
+			continue;
+		}
+		ranges.push_back({(int)from - 1, (int)to - 1});
+		maxChannel = max(maxChannel, (int)to);
+	}
+	set.ensureChannels(maxChannel);
+	const size_t first = set.channel(w, 0);
+	fill_n(set.notify.begin() + first, set.getChannelStride(), false);
+	for (auto& [from, to] : ranges) {
+		fill(set.notify.begin() + first + from,
+			set.notify.begin() + first + to + 1, true);
+	}
+}
+
 class Dialog {
 	private:
+	// Open dialogs, so they can be updated when a watcher is removed.
+	inline static vector<Dialog*> instances;
 	HWND dialog;
 	Target target;
-	Watcher& watcher;
+	WatcherSet& set;
+	int w;
 	vector<unsigned int> supportedLevelTypes;
 
 	void onOk() {
 		bool targetChanged = false;
-		if (this->watcher.target != this->target) {
-			this->watcher.reset();
-			this->watcher.target = this->target;
+		if (this->set.target[w] != this->target) {
+			resetWatcherLevels(this->set, this->w);
+			this->set.target[w] = this->target;
 			targetChanged = true;
 		}
 
-		this->watcher.follow = IsDlgButtonChecked(this->dialog, ID_PEAK_FOLLOW)
+		this->set.follow[w] = IsDlgButtonChecked(this->dialog, ID_PEAK_FOLLOW)
 			== BST_CHECKED;
 
 		// Retrieve the level type.
 		HWND typeSel = GetDlgItem(this->dialog, ID_PEAK_TYPE);
 		unsigned int newType = this->supportedLevelTypes[ComboBox_GetCurSel(typeSel)];
-		if (newType != this->watcher.levelType) {
+		if (newType != this->set.levelType[w]) {
 			// If the target changed, we already reset.
 			if (!targetChanged) {
-				this->watcher.reset();
+				resetWatcherLevels(this->set, this->w);
 			}
-			this->watcher.levelType = newType;
+			this->set.levelType[w] = newType;
 		}
 
 		// Retrieve the notification state for channels.
-		for (int c = 0; c < NUM_CHANNELS; ++c) {
-			this->watcher.channels[c].notify =
-				IsDlgButtonChecked(this->dialog, ID_PEAK_CHAN1 + c) == BST_CHECKED;
-		}
+		char channels[200];
+		GetDlgItemText(this->dialog, ID_PEAK_CHANNELS, channels, sizeof(channels));
+		parseNotifyChannels(this->set, this->w, channels);
 
 		char inText[7];
 		// Retrieve the entered maximum level.
 		if (GetDlgItemText(this->dialog, ID_PEAK_LEVEL, inText, sizeof(inText)) > 0) {
-			this->watcher.notifyLevel = atof(inText);
+			double& notifyLevel = this->set.notifyLevel[w];
+			notifyLevel = atof(inText);
 			// Restrict the range.
-			this->watcher.notifyLevel =
-				max(min(this->watcher.notifyLevel, 40.0), -40.0);
+			notifyLevel = max(min(notifyLevel, 40.0), -40.0);
 		}
 
 		// Retrieve the hold choice/time.
+		int& hold = this->set.hold[w];
 		if (IsDlgButtonChecked(this->dialog, ID_PEAK_HOLD_DISABLED) == BST_CHECKED) {
-			this->watcher.hold = -1;
+			hold = -1;
 		} else if (IsDlgButtonChecked(this->dialog, ID_PEAK_HOLD_FOREVER) ==
 				BST_CHECKED) {
-			this->watcher.hold = 0;
+			hold = 0;
 		} else if (GetDlgItemText(this->dialog, ID_PEAK_HOLD_TIME, inText,
 				sizeof(inText)) > 0) {
-			this->watcher.hold = atoi(inText);
+			hold = atoi(inText);
 			// Restrict the range.
-			this->watcher.hold = max(min(this->watcher.hold, 20000), 1);
+			hold = max(min(hold, 20000), 1);
 		}
 
 		if (!timer) { // Previously disabled or paused.
@@ -591,7 +1023,7 @@ class Dialog {
 					EnableWindow(GetDlgItem(dialogHwnd, ID_PEAK_HOLD_TIME),
 						id == ID_PEAK_HOLD_FOR ? BST_CHECKED : BST_UNCHECKED);
 				} else if (id == ID_PEAK_RESET) {
-					dialog->watcher.reset();
+					resetWatcherLevels(dialog->set, dialog->w);
 					DestroyWindow(dialogHwnd);
 					delete dialog;
 					return TRUE;
@@ -605,8 +1037,8 @@ class Dialog {
 					delete dialog;
 					return TRUE;
 				} else if (id == ID_PEAK_DISABLE) {
-					dialog->watcher.reset();
-					dialog->watcher.target = NoTarget();
+					resetWatcherLevels(dialog->set, dialog->w);
+					dialog->set.target[dialog->w] = NoTarget();
 					if (!isWatchingAnything()) {
 						stop();
 					}
@@ -625,10 +1057,11 @@ class Dialog {
 	}
 
 	public:
-	Dialog(Target target, Watcher& watcher,
+	Dialog(Target target, WatcherSet& set, int w,
 			vector<unsigned int> supportedLevelTypes):
-			target(target), watcher(watcher),
+			target(target), set(set), w(w),
 			supportedLevelTypes(supportedLevelTypes) {
+		instances.push_back(this);
 		ostringstream s;
 		this->dialog = CreateDialog(pluginHInstance,
 			MAKEINTRESOURCE(ID_PEAK_WATCHER_DLG), GetForegroundWindow(),
@@ -642,7 +1075,7 @@ class Dialog {
 
 		HWND follow = GetDlgItem(this->dialog, ID_PEAK_FOLLOW);
 		EnableWindow(follow, true);
-		bool followChecked = watcher.follow;
+		bool followChecked = set.follow[w];
 		if (!holds_alternative<MediaTrack*>(target)) {
 			// Target doesn't support following.
 			EnableWindow(follow, false);
@@ -660,23 +1093,29 @@ class Dialog {
 			unsigned int t = supportedLevelTypes[i];
 			const LevelType& type = LEVEL_TYPES[t];
 			ComboBox_AddString(typeCombo, translate(type.name));
-			if ( watcher.levelType == t) {
+			if (set.levelType[w] == t) {
 				typeSel = i;
 			}
 		}
 		ComboBox_SetCurSel(typeCombo, typeSel);
 
-		for (int c = 0; c < NUM_CHANNELS; ++c) {
-			CheckDlgButton(this->dialog, ID_PEAK_CHAN1 + c, watcher.channels[c].notify
-				? BST_CHECKED : BST_UNCHECKED);
+		// Show notification settings for all channels of the target, as well as
+		// any others which were previously measured for this watcher.
+		int numChannels = set.numChannels[w];
+		if (MediaTrack** track = get_if<MediaTrack*>(&target)) {
+			numChannels = max(numChannels,
+				*(int*)GetSetMediaTrackInfo(*track, "I_NCHAN", nullptr));
 		}
+		set.ensureChannels(numChannels);
+		SetDlgItemText(this->dialog, ID_PEAK_CHANNELS,
+			formatNotifyChannels(set, w, numChannels).c_str());
 
 		HWND level = GetDlgItem(this->dialog, ID_PEAK_LEVEL);
 #ifdef _WIN32
 		SendMessage(level, EM_SETLIMITTEXT, 6, 0);
 #endif
 		s << fixed << setprecision(2);
-		s << watcher.notifyLevel;
+		s << set.notifyLevel[w];
 		SetWindowText(level, s.str().c_str());
 		s.str("");
 
@@ -684,42 +1123,141 @@ class Dialog {
 #ifdef _WIN32
 		SendMessage(holdTime, EM_SETLIMITTEXT, 5, 0);
 #endif
+		const int hold = set.hold[w];
 		int id;
-		if (watcher.hold == -1) {
+		if (hold == -1) {
 			id = ID_PEAK_HOLD_DISABLED;
-		} else if (watcher.hold == 0) {
+		} else if (hold == 0) {
 			id = ID_PEAK_HOLD_FOREVER;
 		} else {
 			id = ID_PEAK_HOLD_FOR;
-			s << watcher.hold;
+			s << hold;
 			SetWindowText(holdTime, s.str().c_str());
 		}
 		CheckDlgButton(this->dialog, id, BST_CHECKED);
-		EnableWindow(holdTime, watcher.hold > 0);
+		EnableWindow(holdTime, hold > 0);
 
 		ShowWindow(this->dialog, SW_SHOWNORMAL);
 	}
+
+	~Dialog() {
+		erase(instances, this);
+	}
+
+	// Close any dialog for a watcher which is about to be removed and update the
+	// indexes of dialogs for watchers after it.
+	static void onWatcherRemoved(WatcherSet& set, int w) {
+		// Deleting a dialog removes it from instances, so iterate over a copy.
+		const vector<Dialog*> dialogs = instances;
+		for (Dialog* dialog : dialogs) {
+			if (&dialog->set != &set || dialog->w < w) {
+				continue;
+			}
+			if (dialog->w == w) {
+				DestroyWindow(dialog->dialog);
+				delete dialog;
+			} else {
+				--dialog->w;
+			}
+		}
+	}
 };
 
-void report(int watcherIndex, int channel) {
-	assert(watcherIndex < NUM_WATCHERS);
-	assert(channel < NUM_CHANNELS);
-	Watcher& watcher = watchers[currentProject()][watcherIndex];
-	if (watcher.isDisabled()) {
+void removeWatcher(WatcherSet& set, int w) {
+	resetWatcherLevels(set, w);
+	Dialog::onWatcherRemoved(set, w);
+	set.remove(w);
+	if (!isWatchingAnything()) {
+		stop();
+	}
+	// Translators: Reported when the user removes a Peak Watcher watcher.
+	outputMessage(translate("removed"));
+}
+
+// Returns false and reports why if a watcher can't be reported.
+bool checkCanReport(WatcherSet& set, int watcherIndex) {
+	if (watcherIndex >= set.size() || isWatcherDisabled(set, watcherIndex)) {
 		// Translators: Reported when the user tries to report a Peak Watcher
 		// channel, but the Peak Watcher value is disabled.
 		outputMessage(translate("watcher disabled"));
-		return;
+		return false;
 	}
 	if (!timer) {
 		// Translators: Reported when the user tries to report a Peak Watcher
 		// channel, but the Peak Watcher is paused.
+		outputMessage(translate("Peak Watcher paused"));
+		return false;
+	}
+	return true;
+}
+
+// Report the levels of all channels for a watcher.
+void describeLevels(WatcherSet& set, int w, ostringstream& s) {
+	if (!getLevelTypeInfo(set, w).separateChannels) {
+		s << set.peak[set.channel(w, 0)];
+		return;
+	}
+	for (int c = 0; c < set.numChannels[w]; ++c) {
+		if (c > 0) {
+			s << ", ";
+		}
+		s << getChannelName(c) << " " << set.peak[set.channel(w, c)];
+	}
+}
+
+void report(int watcherIndex, int channel) {
+	WatcherSet& set = currentWatchers();
+	if (!checkCanReport(set, watcherIndex)) {
+		return;
+	}
+	if (!getLevelTypeInfo(set, watcherIndex).separateChannels) {
+		// There is only one value for all channels.
+		channel = 0;
+	} else if (channel >= set.numChannels[watcherIndex]) {
+		// Translators: Reported when the user tries to report a Peak Watcher
+		// channel which the watched track doesn't have.
+		outputMessage(translate("no such channel"));
+		return;
+	}
+	ostringstream s;
+	s << fixed << setprecision(1);
+	s << set.peak[set.channel(watcherIndex, channel)];
+	outputMessage(s);
+}
+
+void reportAllChannels(int watcherIndex) {
+	WatcherSet& set = currentWatchers();
+	if (!checkCanReport(set, watcherIndex)) {
+		return;
+	}
+	ostringstream s;
+	s << fixed << setprecision(1);
+	describeLevels(set, watcherIndex, s);
+	outputMessage(s);
+}
+
+void reportAllWatchers() {
+	WatcherSet& set = currentWatchers();
+	if (!isWatchingAnything()) {
+		outputMessage(translate("Peak Watcher not enabled"));
+		return;
+	}
+	if (!timer) {
 		outputMessage(translate("Peak Watcher paused"));
 		return;
 	}
 	ostringstream s;
 	s << fixed << setprecision(1);
-	s << watcher.channels[channel].peak;
+	for (int w = 0; w < set.size(); ++w) {
+		if (isWatcherDisabled(set, w)) {
+			continue;
+		}
+		if (s.tellp() > 0) {
+			s << ", ";
+		}
+		s << getWatcherName(w) << " ";
+		describeLevels(set, w, s);
+	}
 	outputMessage(s);
 }
 
@@ -763,6 +1301,7 @@ string getTrackGuidStr(ReaProject* project, MediaTrack* track) {
   WATCHER TRACK {someGuid} TYPE 0 FOLLOW 1 LEVEL 0.0 HOLD 0 NOTIFY 0 0
   WATCHER TRACKFX {someGuid} 5 TYPE 0 FOLLOW 0 LEVEL -5.0 HOLD -1 NOTIFY 1 1
 >
+ * There is one WATCHER line per watcher and one NOTIFY flag per channel.
  */
 
 const char CONFIG_HEADER[] = "<OSARA_PEAKWATCHER";
@@ -776,61 +1315,70 @@ bool processExtensionLine(const char* line, ProjectStateContext* ctx,
 	}
 	stop();
 	ReaProject* project = GetCurrentProjectInLoadSave();
-	auto& projWatchers = watchers[project];
+	WatcherSet& set = watchers[project];
 	for (int w = 0; ; ++w) {
-		char data[500];
+		char data[2048];
 		ctx->GetLine(data, sizeof(data));
 		if (strcmp(data, CONFIG_FOOTER) == 0) {
 			break;
 		}
-		if (w >= NUM_WATCHERS) {
-			continue;
-		}
 		istringstream input(data);
 		string word;
 		input >> word;
 		if (word != "WATCHER") {
 			continue;
 		}
-		Watcher& watcher = projWatchers[w];
-		watcher.reset();
+		if (w >= MAX_WATCHERS) {
+			// Keep reading until the footer, but ignore extra watchers.
+			continue;
+		}
+		if (w >= set.size()) {
+			set.add();
+		}
+		resetWatcherLevels(set, w);
 		input >> word;
 		if (word == "NONE") {
-			watcher.target = NoTarget();
+			set.target[w] = NoTarget();
 		} else if (word == "TRACK") {
 			input >> word;
-			watcher.target = getTrackFromGuidStr(project, word);
+			set.target[w] = getTrackFromGuidStr(project, word);
 		} else if (word == "TRACKFX") {
 			input >> word;
 			int fx;
 			input >> fx;
 			if (MediaTrack* track = getTrackFromGuidStr(project, word)) {
-				watcher.target = TrackFx(track, fx);
+				set.target[w] = TrackFx(track, fx);
 			}
 		}
 		input >> word;
 		if (word == "TYPE") {
-			input >> watcher.levelType;
+			input >> set.levelType[w];
+			if (set.levelType[w] >= NUM_LEVEL_TYPES) {
+				set.levelType[w] = 0;
+			}
 		}
 		input >> word;
 		if (word == "FOLLOW") {
 			input >> word;
-			watcher.follow = word == "1";
+			set.follow[w] = word == "1";
 		}
 		input >> word;
 		if (word == "LEVEL") {
-			input >> watcher.notifyLevel;
+			input >> set.notifyLevel[w];
 		}
 		input >> word;
 		if (word == "HOLD") {
-			input >> watcher.hold;
+			input >> set.hold[w];
 		}
 		input >> word;
 		if (word == "NOTIFY") {
-			for (auto& channel : watcher.channels) {
-				input >> word;
-				channel.notify = word == "1";
+			vector<unsigned char> notify;
+			while (input >> word && (int)notify.size() < MAX_CHANNELS) {
+				notify.push_back(word == "1");
 			}
+			set.ensureChannels((int)notify.size());
+			copy(notify.begin(), notify.end(),
+				set.notify.begin() + set.channel(w, 0));
 		}
 	}
 	if (project == currentProject() && isWatchingAnything()) {
@@ -847,24 +1395,26 @@ void saveExtensionConfig(ProjectStateContext* ctx, bool isUndo,
 	}
 	ctx->AddLine(CONFIG_HEADER);
 	ReaProject* project = GetCurrentProjectInLoadSave();
-	for (Watcher& watcher : watchers[project]) {
+	WatcherSet& set = watchers[project];
+	for (int w = 0; w < set.size(); ++w) {
 		ostringstream out;
 		out << "WATCHER";
-		if (holds_alternative<NoTarget>(watcher.target)) {
+		const Target& target = set.target[w];
+		if (holds_alternative<NoTarget>(target)) {
 			out << " NONE";
-		} else if (MediaTrack** track = get_if<MediaTrack*>(&watcher.target)) {
+		} else if (MediaTrack* const* track = get_if<MediaTrack*>(&target)) {
 			out << " TRACK " << getTrackGuidStr(project, *track);
-		} else if (TrackFx* tfx = get_if<TrackFx>(&watcher.target)) {
+		} else if (const TrackFx* tfx = get_if<TrackFx>(&target)) {
 			out << " TRACKFX " << getTrackGuidStr(project, tfx->first) <<
 				" " << tfx->second;
 		}
-		out << " TYPE " << watcher.levelType;
-		out << " FOLLOW " << (int)watcher.follow;
-		out << " LEVEL " << watcher.notifyLevel;
-		out << " HOLD " << watcher.hold;
+		out << " TYPE " << set.levelType[w];
+		out << " FOLLOW " << (int)set.follow[w];
+		out << " LEVEL " << set.notifyLevel[w];
+		out << " HOLD " << set.hold[w];
 		out << " NOTIFY";
-		for (auto& channel : watcher.channels) {
-			out << " " << (int)channel.notify;
+		for (int c = 0; c < set.getChannelStride(); ++c) {
+			out << " " << (int)set.notify[set.channel(w, c)];
 		}
 		ctx->AddLine("%s", out.str().c_str());
 	}
@@ -877,6 +1427,8 @@ void BeginLoadProjectState (bool isUndo, struct project_config_extension_t* reg)
 auto const& project = item.first;
 return ! ValidatePtr((void*)project, "ReaProject*");
 	});
+	// The cached set might have been erased.
+	cachedWatchers = nullptr;
 }
 
 void initialize() {
@@ -895,6 +1447,11 @@ void onSwitchTab(){
 	}
 }
 
+void terminate() {
+	// Make sure the audio hook doesn't outlive us.
+	stop();
+}
+
 } // namespace peakWatcher
 
 void cmdPeakWatcher(Command* command) {
@@ -917,32 +1474,88 @@ void cmdPeakWatcher(Command* command) {
 	// MIIM_TYPE is deprecated, but win32_utf8 still relies on it.
 	itemInfo.fMask = MIIM_TYPE | MIIM_ID;
 	itemInfo.fType = MFT_STRING;
-	const ReaProject* project = peakWatcher::currentProject();
-	auto& projWatchers = peakWatcher::watchers[project];
-	for (int w = 0; w < peakWatcher::NUM_WATCHERS; ++w) {
-		itemInfo.wID = w + 1;
+	peakWatcher::WatcherSet& set = peakWatcher::currentWatchers();
+	const int count = set.size();
+	// Menu item ids for each action are offset by a multiple of MAX_WATCHERS so
+	// that the watcher can be derived from the id.
+	enum {
+		MENU_CONFIGURE,
+		MENU_REPORT,
+		MENU_RESET,
+		MENU_REMOVE,
+	};
+	auto insertItem = [&itemInfo](HMENU menu, int pos, UINT id,
+		const string& text
+	) {
+		itemInfo.wID = id;
+		itemInfo.dwTypeData = (char*)text.c_str();
+		itemInfo.cch = (int)text.size();
+		InsertMenuItem(menu, pos, true, &itemInfo);
+	};
+	for (int w = 0; w < count; ++w) {
 		ostringstream s;
-		// Translators: Used when asking which Peak Watcher value to configure.
-		// {} will be replaced with the value number; e.g. "Value &2".
-		// After this, information about the existing configuration for the value
-		// will be appended.
-		s << translate(peakWatcher::WATCHER_NAMES[w]) << ", ";
-		projWatchers[w].description(s);
-		// Make sure this stays around until the InsertMenuItem call.
-		string str = s.str();
-		itemInfo.dwTypeData = (char*)str.c_str();
-		itemInfo.cch = (int)s.tellp();
-		InsertMenuItem(menu, w, true, &itemInfo);
-	}
-	int w = TrackPopupMenu(menu, TPM_NONOTIFY | TPM_RETURNCMD, 0, 0, 0,
+		s << peakWatcher::getWatcherName(w) << ", ";
+		peakWatcher::describeWatcher(set, w, s);
+		const UINT id = MENU_CONFIGURE * peakWatcher::MAX_WATCHERS + w + 1;
+		if (w < peakWatcher::DEFAULT_WATCHERS) {
+			// The default watchers have their own report and reset actions and
+			// can't be removed, so choosing them configures them directly.
+			insertItem(menu, w, id, s.str());
+			continue;
+		}
+		HMENU watcherMenu = CreatePopupMenu();
+		// Translators: An item in the Peak Watcher menu for a watcher which opens
+		// its configuration dialog.
+		insertItem(watcherMenu, 0, id, translate("&Configure..."));
+		// Translators: An item in the Peak Watcher menu for a watcher which
+		// reports the levels of all its channels.
+		insertItem(watcherMenu, 1,
+			MENU_REPORT * peakWatcher::MAX_WATCHERS + w + 1, translate("&Report"));
+		// Translators: An item in the Peak Watcher menu for a watcher which resets
+		// its levels.
+		insertItem(watcherMenu, 2,
+			MENU_RESET * peakWatcher::MAX_WATCHERS + w + 1, translate("R&eset"));
+		// Translators: An item in the Peak Watcher menu for a watcher which
+		// removes it.
+		insertItem(watcherMenu, 3,
+			MENU_REMOVE * peakWatcher::MAX_WATCHERS + w + 1, translate("Re&move"));
+		itemInfo.fMask |= MIIM_SUBMENU;
+		itemInfo.hSubMenu = watcherMenu;
+		// The submenu itself doesn't need an id.
+		insertItem(menu, w, 0, s.str());
+		itemInfo.fMask &= ~MIIM_SUBMENU;
+		itemInfo.hSubMenu = nullptr;
+	}
+	if (count < peakWatcher::MAX_WATCHERS) {
+		// Translators: An item in the menu shown when configuring Peak Watcher
+		// which adds another watcher.
+		insertItem(menu, count, count + 1, translate("&Add watcher"));
+	}
+	const int id = TrackPopupMenu(menu, TPM_NONOTIFY | TPM_RETURNCMD, 0, 0, 0,
 		mainHwnd, nullptr) - 1;
+	// This also destroys the submenus.
 	DestroyMenu(menu);
-	if (w == -1) {
+	if (id == -1) {
 		return;
 	}
-	peakWatcher::Watcher& watcher = projWatchers[w];
+	const int action = id / peakWatcher::MAX_WATCHERS;
+	int w = id % peakWatcher::MAX_WATCHERS;
+	switch (action) {
+		case MENU_REPORT:
+			peakWatcher::reportAllChannels(w);
+			return;
+		case MENU_RESET:
+			peakWatcher::resetWatcher(w, true);
+			return;
+		case MENU_REMOVE:
+			peakWatcher::removeWatcher(set, w);
+			return;
+	}
+	if (w == count) {
+		w = set.add();
+	}
 
-	new peakWatcher::Dialog(target, watcher, types);
+	new peakWatcher::Dialog(target, set, w, types);
 }
 
 void cmdReportPeakWatcherW1C1(Command* command) {
@@ -961,6 +1574,18 @@ void cmdReportPeakWatcherW2C2(Command* command) {
 	peakWatcher::report(1, 1);
 }
 
+void cmdReportPeakWatcherW1(Command* command) {
+	peakWatcher::reportAllChannels(0);
+}
+
+void cmdReportPeakWatcherW2(Command* command) {
+	peakWatcher::reportAllChannels(1);
+}
+
+void cmdReportPeakWatchers(Command* command) {
+	peakWatcher::reportAllWatchers();
+}
+
 void cmdResetPeakWatcherW1(Command* command) {
 	peakWatcher::resetWatcher(0, true);
 }
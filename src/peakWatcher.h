@@ -10,6 +10,9 @@
 namespace peakWatcher {
 void initialize();
 void onSwitchTab();
+void terminate();
+// Called when FX are added, removed or reordered.
+void onFxChainChange();
 }
 
 void cmdPeakWatcher(Command* command);
@@ -17,6 +20,9 @@ void cmdReportPeakWatcherW1C1(Command* command);
 void cmdReportPeakWatcherW1C2(Command* command);
 void cmdReportPeakWatcherW2C1(Command* command);
 void cmdReportPeakWatcherW2C2(Command* command);
+void cmdReportPeakWatcherW1(Command* command);
+void cmdReportPeakWatcherW2(Command* command);
+void cmdReportPeakWatchers(Command* command);
 void cmdResetPeakWatcherW1(Command* command);
 void cmdResetPeakWatcherW2(Command* command);
 void cmdPausePeakWatcher(Command* command);
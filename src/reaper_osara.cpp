@@ -16,6 +16,9 @@
 #include <atlcomcli.h>
 // We only need this on Windows and it apparently causes compilation issues on Mac.
 #include <codecvt>
+#if defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#endif
 #else
 #include "osxa11y_wrapper.h" // NSA11y wrapper for OS X accessibility API
 #endif
@@ -27,6 +30,7 @@
 #include <math.h>
 #include <optional>
 #include <set>
+#include <unordered_map>
 #include <WDL/win32_utf8.h>
 #define REAPERAPI_IMPLEMENT
 #include "osara.h"
@@ -40,7 +44,14 @@
 #include "buildVersion.h"
 #include "fxChain.h"
 #include "translation.h"
+#include "messageBuilder.h"
 #include "updateCheck.h"
+#include "itemIndex.h"
+#include "markerIndex.h"
+#include "tempoMap.h"
+#include "trackStates.h"
+#include "fxTree.h"
+#include "latency.h"
 
 using namespace std;
 using namespace fmt::literals;
@@ -73,25 +84,90 @@ MediaItem* currentItem = nullptr;
 #ifdef _WIN32
 
 wstring_convert<codecvt_utf8_utf16<WCHAR>, WCHAR> utf8Utf16;
-wstring widen(const string& text) {
-	try {
-		return utf8Utf16.from_bytes(text);
-	} catch (range_error) {
-		// #38: Invalid UTF-8. This really shouldn't happen,
-		// but it seems REAPER/extensions sometimes use ANSI strings instead of UTF-8.
-		// This hack just widens the string without any encoding conversion.
-		// This may result in strange characters, but it's better than a crash.
-		wostringstream s;
-		s << text.c_str();
-		return s.str();
+
+wstring_view widenToBuffer(string_view text, bool appendSpace) {
+	// Each thread gets its own buffer, which grows to fit the longest text
+	// converted and is then reused.
+	thread_local wstring buffer;
+	const size_t size = text.size();
+	const char* in = text.data();
+	buffer.resize(size + (appendSpace ? 1 : 0));
+	WCHAR* out = buffer.data();
+	// Most messages are ASCII. In that case, each UTF-16 code unit is just the
+	// zero extended byte, so we don't need to decode anything.
+	size_t i = 0;
+#if defined(_M_X64) || defined(_M_IX86)
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= size; i += 16) {
+		const __m128i chunk = _mm_loadu_si128((const __m128i*)(in + i));
+		if (_mm_movemask_epi8(chunk)) {
+			break; // Not ASCII.
+		}
+		_mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi8(chunk, zero));
+		_mm_storeu_si128((__m128i*)(out + i + 8), _mm_unpackhi_epi8(chunk, zero));
 	}
+#endif
+	for (; i < size && (unsigned char)in[i] < 0x80; ++i) {
+		out[i] = in[i];
+	}
+	size_t outSize = i;
+	if (i < size) {
+		// Not ASCII, so decode the rest.
+		const int inLeft = (int)(size - i);
+		// UTF-8 never needs more UTF-16 code units than bytes, so it fits.
+		int converted = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, in + i,
+			inLeft, out + i, inLeft);
+		if (converted == 0) {
+			// #38: Invalid UTF-8. This really shouldn't happen,
+			// but it seems REAPER/extensions sometimes use ANSI strings instead of
+			// UTF-8. This hack just widens the string without any encoding
+			// conversion. This may result in strange characters, but it's better
+			// than a crash.
+			for (; i < size; ++i) {
+				out[i] = (unsigned char)in[i];
+			}
+			outSize = size;
+		} else {
+			outSize = i + converted;
+		}
+	}
+	if (appendSpace) {
+		out[outSize++] = L' ';
+	}
+	buffer.resize(outSize);
+	return buffer;
+}
+
+wstring widen(const string& text) {
+	return wstring(widenToBuffer(text));
 }
 string narrow(const wstring& text) {
 	return utf8Utf16.to_bytes(text);
 }
 
-string lastMessage;
+// The last message output, so it can be repeated when focus moves. This points
+// to the last output string in the message pipeline, so we don't keep a copy.
+const string* lastMessage = nullptr;
+// We only need to know whether a message is the same as the accName we last
+// set, so we keep its length and hash rather than a copy.
+size_t lastNameLength = 0;
+uint32_t lastNameHash = 0;
 HWND lastMessageHwnd = nullptr;
+
+uint32_t hashMessage(string_view message, bool appendSpace) {
+	// FNV-1a.
+	uint32_t hash = 0x811C9DC5;
+	for (char c: message) {
+		hash ^= (unsigned char)c;
+		hash *= 0x01000193;
+	}
+	if (appendSpace) {
+		hash ^= ' ';
+		hash *= 0x01000193;
+	}
+	return hash;
+}
+
 void _outputMessage(const string& message, bool interrupt) {
 	if (shouldUseUiaNotifications()) {
 		if (sendUiaNotification(message, interrupt)) {
@@ -103,18 +179,15 @@ void _outputMessage(const string& message, bool interrupt) {
 	if (!focus) {
 		return;
 	}
-	if (lastMessage.compare(message) == 0) {
-		// The last message was the same.
-		// Clients may ignore a nameChange event if the name didn't change.
-		// Append a space to make it different.
-		string procMessage = message;
-		procMessage += ' ';
-		accPropServices->SetHwndPropStr(focus, OBJID_CLIENT, CHILDID_SELF, PROPID_ACC_NAME, widen(procMessage).c_str());
-		lastMessage = procMessage;
-	} else {
-		accPropServices->SetHwndPropStr(focus, OBJID_CLIENT, CHILDID_SELF, PROPID_ACC_NAME, widen(message).c_str());
-		lastMessage = message;
-	}
+	lastMessage = &message;
+	// Clients may ignore a nameChange event if the name didn't change. If the
+	// last message was the same, append a space to make it different.
+	const bool appendSpace = message.size() == lastNameLength &&
+		hashMessage(message, false) == lastNameHash;
+	lastNameLength = message.size() + (appendSpace ? 1 : 0);
+	lastNameHash = hashMessage(message, appendSpace);
+	accPropServices->SetHwndPropStr(focus, OBJID_CLIENT, CHILDID_SELF,
+		PROPID_ACC_NAME, widenToBuffer(message, appendSpace).data());
 	// Fire a nameChange event so ATs will report this text.
 	NotifyWinEvent(EVENT_OBJECT_NAMECHANGE, focus, OBJID_CLIENT, CHILDID_SELF);
 	lastMessageHwnd = focus;
@@ -128,17 +201,131 @@ void _outputMessage(const string& message, bool interrupt) {
 
 #endif // _WIN32
 
+// The message pipeline. Rather than passing every message straight to the
+// screen reader, we coalesce messages from noisy sources within a short window.
+// Navigation messages are direct feedback, so they are never delayed. For other
+// sources, the first message is output immediately. Subsequent messages
+// within the window are queued and output together when the window expires.
+// An interrupting message replaces what is queued (or only the queued message
+// with the same key, if any), so only the latest is output. This stops the
+// screen reader falling behind when a key auto-repeats or a jog wheel is
+// turned.
+struct PendingMessage {
+	int key;
+	string text;
+};
+
+struct MessageSourceState {
+	// The coalescing window in ms. 0 means messages are output immediately.
+	DWORD window;
+	// Whether to drop a message which is identical to the last message output
+	// from this source within the window.
+	bool dropDuplicates;
+	DWORD lastOutputTime = 0;
+	string lastOutput;
+	vector<PendingMessage> pending;
+	bool pendingInterrupt = false;
+	bool hasPending = false;
+	CallLater flushLater;
+
+	void queue(string_view message, bool interrupt, int key) {
+		if (interrupt) {
+			if (key == -1) {
+				this->pending.clear();
+			} else {
+				for (auto& entry: this->pending) {
+					if (entry.key == key) {
+						entry.text.assign(message);
+						return;
+					}
+				}
+			}
+		}
+		this->pending.push_back({key, string(message)});
+	}
+};
+
+MessageSourceState messageSources[MS_COUNT] = {
+	{0, false}, // MS_NAVIGATION
+	{100, true}, // MS_TRANSPORT
+	{150, true}, // MS_SURFACE
+	{200, true}, // MS_PEAK_WATCHER
+};
+
+void flushMessageSource(MessageSourceState& state) {
+	state.hasPending = false;
+	state.lastOutputTime = GetTickCount();
+	state.lastOutput.clear();
+	for (const auto& entry: state.pending) {
+		if (!state.lastOutput.empty()) {
+			state.lastOutput += ", ";
+		}
+		state.lastOutput += entry.text;
+	}
+	state.pending.clear();
+	// The output time was recorded when the message was queued, since this runs
+	// after the command which queued it has finished.
+	_outputMessage(state.lastOutput, state.pendingInterrupt);
+}
+
 bool muteNextMessage = false;
-void outputMessage(const string& message, bool interrupt) {
+void outputMessage(string_view message, bool interrupt,
+	MessageSource source, int key
+) {
 	if(muteNextMessage && isHandlingCommand){
 		muteNextMessage = false;
 		return;
 	}
-	_outputMessage(message, interrupt);
+	if (interrupt) {
+		// This message will interrupt anything queued from sources of lower
+		// priority, so those messages are now stale.
+		for (int s = source + 1; s < MS_COUNT; ++s) {
+			MessageSourceState& other = messageSources[s];
+			if (other.hasPending) {
+				other.flushLater.cancel();
+				other.hasPending = false;
+				other.pending.clear();
+			}
+		}
+	}
+	MessageSourceState& state = messageSources[source];
+	if (state.hasPending) {
+		// There's already a flush scheduled. Just queue the message.
+		state.queue(message, interrupt, key);
+		state.pendingInterrupt |= interrupt;
+		latency::markOutput();
+		return;
+	}
+	DWORD elapsed = GetTickCount() - state.lastOutputTime;
+	if (elapsed < state.window) {
+		if (state.dropDuplicates && message == state.lastOutput) {
+			return;
+		}
+		state.queue(message, interrupt, key);
+		state.pendingInterrupt = interrupt;
+		state.hasPending = true;
+		latency::markOutput();
+		state.flushLater = CallLater([&state] {
+			flushMessageSource(state);
+		}, state.window - elapsed);
+		return;
+	}
+	state.lastOutputTime = GetTickCount();
+	state.lastOutput.assign(message);
+	latency::markOutput();
+	_outputMessage(state.lastOutput, interrupt);
 }
 
-void outputMessage(ostringstream& message, bool interrupt) {
-	outputMessage(message.str(), interrupt);
+void outputMessage(ostringstream& message, bool interrupt,
+	MessageSource source, int key
+) {
+	outputMessage(message.str(), interrupt, source, key);
+}
+
+void outputMessage(const MessageBuilder& message, bool interrupt,
+	MessageSource source, int key
+) {
+	outputMessage(message.view(), interrupt, source, key);
 }
 
 bool CallLater::cancel() {
@@ -171,11 +358,10 @@ string formatTimeMeasure(int measure, double beat, int measureLength,
 		HWND midiEditor = MIDIEditor_GetActive();
 		assert(midiEditor);
 		MediaItem_Take* take = MIDIEditor_GetTake (midiEditor);
-		MediaItem* item = GetMediaItemTake_Item(take);
 		// PPQ is per quarter note, but a beat might not be a quarter note depending
 		// on the time signature denominator. For example, if the time signature is
 		// 6/8, there are only PPQ / 2 ticks per beat.
-		beatFractionDenominator = getItemPPQ(item) * 4 / timeDenom;
+		beatFractionDenominator = getTakePPQ(take) * 4 / timeDenom;
 	} else {
 		beatFractionDenominator = 100;
 	}
@@ -192,27 +378,31 @@ string formatTimeMeasure(int measure, double beat, int measureLength,
 		++measure;
 		++wholeBeat;
 		if (includeProjectStartOffset) {
-			int size = 0;
-			int index = projectconfig_var_getoffs("projmeasoffs", &size);
-			assert(size == sizeof(int));
+			// The offset of a project config variable doesn't change, so only look
+			// it up once.
+			static const int index = [] {
+				int size = 0;
+				int index = projectconfig_var_getoffs("projmeasoffs", &size);
+				assert(size == sizeof(int));
+				return index;
+			}();
 			measure += *(int*)projectconfig_var_addr(nullptr, index);
 		}
 	}
-	ostringstream s;
+	MessageBuilder s;
 	if (!useCache || measure != oldMeasure) {
 		if (isLength) {
 			if (includeZeros || measure != 0) {
 				// Translators: Used when reporting a length of time in measures.
 				// {} will be replaced with the number of measures; e.g.
 				// "2 bars".
-				s << format(
-					translate_plural("{} bar", "{} bars", measure), measure)
+				s.format(translate_plural("{} bar", "{} bars", measure), measure)
 					<< " ";
 			}
 		} else {
 			// Translators: Used when reporting the measure of a time position.
 			// {} will be replaced with the measure number; e.g. "bar 2".
-			s << format(translate("bar {}"), measure) << " ";
+			s.format(translate("bar {}"), measure) << " ";
 		}
 		oldMeasure = measure;
 	}
@@ -221,14 +411,13 @@ string formatTimeMeasure(int measure, double beat, int measureLength,
 			if (includeZeros || wholeBeat != 0) {
 				// Translators: Used when reporting a length of time in beats.
 				// {} will be replaced with the number of beats; e.g. "2 beats".
-				s << format(
-					translate_plural("{} beat", "{} beats", wholeBeat),
+				s.format(translate_plural("{} beat", "{} beats", wholeBeat),
 					wholeBeat) << " ";
 			}
 		} else {
 			// Translators: Used when reporting the beat of a time position.
 			// {} will be replaced with the beat number; e.g. "beat 2".
-			s << format(translate("beat {}"), wholeBeat) << " ";
+			s.format(translate("beat {}"), wholeBeat) << " ";
 		}
 		oldBeat = wholeBeat;
 	}
@@ -237,8 +426,7 @@ string formatTimeMeasure(int measure, double beat, int measureLength,
 			if (useTicks) {
 				// Translators: used when reporting a time in ticks. {} will be replaced
 				// with the number of ticks; e.g. "2 ticks".
-				s << format(
-					translate_plural("{} tick", "{} ticks", beatFraction),
+				s.format(translate_plural("{} tick", "{} ticks", beatFraction),
 					beatFraction);
 			} else {
 				s << beatFraction << "%";
@@ -373,8 +561,8 @@ string formatTime(double time, TimeFormat timeFormat,
 			int measure;
 			int measureLength;
 			int timeDenom;
-			double beat = TimeMap2_timeToBeats(nullptr, time, &measure, &measureLength,
-				nullptr, &timeDenom);
+			double beat = tempoMap::timeToBeats(time, &measure, &measureLength,
+				&timeDenom);
 			s = formatTimeMeasure(measure, beat, measureLength, timeDenom,
 				timeFormat == TF_MEASURETICK, false, useCache,
 				includeZeros, includeProjectStartOffset);
@@ -457,9 +645,10 @@ string formatLength(double start, double end, TimeFormat timeFormat,
 		return formatTime(end - start, timeFormat, cache, includeZeros, false);
 	}
 	int startMeasure, startMeasureLength, timeDenom, endMeasure, endMeasureLength;
-	double startBeat = TimeMap2_timeToBeats(nullptr, start, &startMeasure,
-		&startMeasureLength, nullptr, &timeDenom);
-	double endBeat = TimeMap2_timeToBeats(nullptr, end, &endMeasure, &endMeasureLength, nullptr, nullptr);
+	double startBeat = tempoMap::timeToBeats(start, &startMeasure,
+		&startMeasureLength, &timeDenom);
+	double endBeat = tempoMap::timeToBeats(end, &endMeasure, &endMeasureLength,
+		nullptr);
 	int measures = endMeasure - startMeasure ;
 	double beats = 0;
 	constexpr double epsilon = 0.005; // half a percent
@@ -600,12 +789,6 @@ bool isItemSelected(MediaItem* item) {
 	return *(bool*)GetSetMediaItemInfo(item, "B_UISEL", nullptr);
 }
 
-bool isPosInItem(double pos, MediaItem* item) {
-	double start = GetMediaItemInfo_Value(item, "D_POSITION");
-	double end = GetMediaItemInfo_Value(item, "D_POSITION") + GetMediaItemInfo_Value(item, "D_LENGTH");
-	return (start <= pos && pos <= end);
-}
-
 bool isFreeItemPositioningEnabled(MediaTrack* track) {
 	return *(bool*)GetSetMediaTrackInfo(track, "B_FREEMODE", nullptr);
 }
@@ -825,9 +1008,9 @@ void postGoToTrack(int command, MediaTrack* track) {
 	SetCursorContext(0, nullptr);
 	if (!track)
 		return;
-	ostringstream s;
+	MessageBuilder s;
 	auto separate = [&s]() {
-		if (s.tellp() > 0) {
+		if (!s.empty()) {
 			s << " ";
 		}
 	};
@@ -918,25 +1101,30 @@ void postGoToTrack(int command, MediaTrack* track) {
 		// the track has. {} will be replaced by the number of items; e.g.
 		// "2 items".
 		if (itemCount > 0) {
-			s << " " << format(translate_plural("{} item", "{} items", itemCount),
-				itemCount);
+			s << " ";
+			s.format(translate_plural("{} item", "{} items", itemCount), itemCount);
 		}
 		if (isFreeItemPositioningEnabled(track)) {
 			s << " " << translate("free item positioning");
 		}
 	}
-	int count;
-	if (settings::reportFx && (count = TrackFX_GetCount(track)) > 0) {
+	const fxTree::Tree* fxs = settings::reportFx ? &fxTree::getTopLevel(track) :
+		nullptr;
+	if (fxs && fxs->topCount > 0) {
 		// Translators: Reported when navigating tracks before listing the effects on
 		// the track.
 		s << "; " << translate("FX:") << " ";
-		char name[256];
-		for (int f = 0; f < count; ++f) {
-			if (f > 0)
+		bool first = true;
+		for (const fxTree::Fx& fx: fxs->fx) {
+			// Only report effects in the main chain, not inside containers.
+			if (fx.level > 1 || fx.isRec)
+				continue;
+			if (!first)
 				s << ", ";
-			TrackFX_GetFXName(track, f, name, sizeof(name));
-			shortenFxName(name, s);
-			if (!TrackFX_GetEnabled(track, f)) {
+			first = false;
+			const int f = fx.index;
+			shortenFxName(fx.name.c_str(), s);
+			if (!fx.isEnabled) {
 				s << " " << translate("bypassed");
 			}
 			int deltaParam = TrackFX_GetParamFromIdent(track, f, ":delta");
@@ -1229,88 +1417,51 @@ void postCycleTrackFolderCollapsed(int command) {
 	outputMessage(getFolderCompacting(track));
 }
 
-int findRegionEndingAt(double wantedEndPos) {
-	double start = wantedEndPos;
-	for (; ;) {
-		if (start == 0) {
-			return -1;
-		}
-		// GetLastMarkerAndCurRegion doesn't return a region at its end position,
-		// so subtract a bit.
-		double tempPos = max(start - 0.001, 0);
-		int region;
-		GetLastMarkerAndCurRegion(nullptr, tempPos, nullptr, &region);
-		if (region < 0) {
-			return -1;
-		}
-		double end;
-		EnumProjectMarkers(region, nullptr, &start, &end, nullptr, nullptr);
-		if (end == wantedEndPos) {
-			return region;
-		}
-		// If there are overlapping regions, GetLastMarkerAndCurRegion will return
-		// the region which starts nearest to the given position. There might be a
-		// region which starts earlier but ends earlier. The next iteration will
-		// try the region just prior to this region's start position.
-	}
-	return -1;
-}
-
 void postGoToMarker(int command) {
 	ostringstream s;
-	int marker, region;
-	double markerPos;
 	double cursorPos = GetCursorPosition();
-	GetLastMarkerAndCurRegion(nullptr, cursorPos, &marker, &region);
-	const char* name;
-	int number;
-	if (marker >= 0) {
-		EnumProjectMarkers(marker, nullptr, &markerPos, nullptr, &name, &number);
-		if (markerPos == cursorPos) {
-			fakeFocus = FOCUS_MARKER;
-			if (name[0]) {
-				// Translators: Reported when moving to a named project marker. {} will
-				// be replaced with the marker's name; e.g. "intro marker".
-				s << format(translate("{} marker"), name) << " ";
-			} else {
-				// Translators: Reported when moving to an unnamed project marker. {}
-				// will be replaced with the marker's name; e.g. "marker 2".
-				s << format(translate("marker {}"), number) << " ";
-			}
+	auto marker = markerIndex::findLastMarker(cursorPos);
+	if (marker && marker->start == cursorPos) {
+		fakeFocus = FOCUS_MARKER;
+		if (!marker->name.empty()) {
+			// Translators: Reported when moving to a named project marker. {} will
+			// be replaced with the marker's name; e.g. "intro marker".
+			s << format(translate("{} marker"), marker->name) << " ";
+		} else {
+			// Translators: Reported when moving to an unnamed project marker. {}
+			// will be replaced with the marker's name; e.g. "marker 2".
+			s << format(translate("marker {}"), marker->number) << " ";
 		}
 	}
-	double start, end;
-	if (region >= 0) {
-		EnumProjectMarkers(region, nullptr, &start, &end, &name, &number);
-		if (start == cursorPos) {
-			fakeFocus = FOCUS_REGION;
-			if (name[0]) {
-				// Translators: Reported when moving to the start of a named region. {}
-				// will be replaced with the region's name; e.g. "intro region start".
-				s << format(translate("{} region start"), name) << " ";
-			} else {
-				// Translators: Reported when moving to the start of an unnamed region.
-				// {} will be replaced with the region's number; e.g.
-				// "region 2 start".
-				s << format(translate("region {} start"), number) << " ";
-			}
+	auto region = markerIndex::findRegion(cursorPos);
+	if (region && region->start == cursorPos) {
+		fakeFocus = FOCUS_REGION;
+		if (!region->name.empty()) {
+			// Translators: Reported when moving to the start of a named region. {}
+			// will be replaced with the region's name; e.g. "intro region start".
+			s << format(translate("{} region start"), region->name) << " ";
+		} else {
+			// Translators: Reported when moving to the start of an unnamed region.
+			// {} will be replaced with the region's number; e.g.
+			// "region 2 start".
+			s << format(translate("region {} start"), region->number) << " ";
 		}
 	}
-	region = findRegionEndingAt(cursorPos);
-	if (region >= 0) {
-		EnumProjectMarkers(region, nullptr, nullptr, nullptr, &name, &number);
+	region = markerIndex::findRegionEndingAt(cursorPos);
+	if (region) {
 		fakeFocus = FOCUS_REGION;
-		if (name[0]) {
+		if (!region->name.empty()) {
 			// Translators: Reported when moving to the end of a named region. {}
 			// will be replaced with the region's name; e.g. "intro region end".
-			s << format(translate("{} region end"), name) << " ";
+			s << format(translate("{} region end"), region->name) << " ";
 		} else {
 			// Translators: Reported when moving to the end of an unnamed region.
 			// {} will be replaced with the region's number; e.g.
 			// "region 2 end".
-			s << format(translate("region {} end"), number) << " ";
+			s << format(translate("region {} end"), region->number) << " ";
 		}
 	}
+	double start, end;
 	GetSet_LoopTimeRange(false, false, &start, &end, false);
 	if (start != end) {
 		if (cursorPos == start) {
@@ -1347,7 +1498,6 @@ void postGoToMarker(int command) {
 // if that marker/region doesn't exist or there are two at the same position.
 // This function reports only if the number matches the target number.
 void postGoToSpecificMarker(int command) {
-	int count = CountProjectMarkers(0, nullptr, nullptr);
 	int wantNum;
 	bool wantReg = false;
 	// Work out the desired marker/region number based on the command id.
@@ -1363,38 +1513,33 @@ void postGoToSpecificMarker(int command) {
 		wantNum = command - 41760;
 	} else
 		return; // Shouldn't happen.
-	for (int i = 0; i < count; ++i) {
-		bool reg;
-		int num;
-		const char* name;
-		EnumProjectMarkers(i, &reg, nullptr, nullptr, &name, &num);
-		if (num != wantNum || reg != wantReg)
-			continue;
-		fakeFocus = reg ? FOCUS_REGION : FOCUS_MARKER;
-		ostringstream s;
-		if (name[0]) {
-			if (reg) {
-				// Translators: used when reporting a named region. {} will be
-				// replaced with the name of the region; e.g. "intro region"
-				s << format(translate("{} region"), name);
-			} else {
-				// Translators: used when reporting a named marker. {} will be
-				// replaced with the name of the marker; e.g. "v2 marker"
-				s << format(translate("{} marker"), name);
-			}
-		} else{ // unnamed
-			if(reg){
-				// Translators: used to report an unnamed region. {} is replaced with the region number.  
-				s << format(translate("region {}"), num);
-			} else {
-				// Translators: used to report an unnamed marker. {} is replaced with the marker number.  
-				s << format(translate("marker {}"), num);
-			}
-		}
-		s << " " << formatCursorPosition();
-		outputMessage(s);
+	auto marker = markerIndex::findByNumber(wantNum, wantReg);
+	if (!marker) {
 		return;
 	}
+	fakeFocus = wantReg ? FOCUS_REGION : FOCUS_MARKER;
+	ostringstream s;
+	if (!marker->name.empty()) {
+		if (wantReg) {
+			// Translators: used when reporting a named region. {} will be
+			// replaced with the name of the region; e.g. "intro region"
+			s << format(translate("{} region"), marker->name);
+		} else {
+			// Translators: used when reporting a named marker. {} will be
+			// replaced with the name of the marker; e.g. "v2 marker"
+			s << format(translate("{} marker"), marker->name);
+		}
+	} else{ // unnamed
+		if(wantReg){
+			// Translators: used to report an unnamed region. {} is replaced with the region number.  
+			s << format(translate("region {}"), marker->number);
+		} else {
+			// Translators: used to report an unnamed marker. {} is replaced with the marker number.  
+			s << format(translate("marker {}"), marker->number);
+		}
+	}
+	s << " " << formatCursorPosition();
+	outputMessage(s);
 }
 
 void postChangeVolumeH(double volume, int command, const char* commandMessage) {
@@ -1472,7 +1617,8 @@ void postChangeHorizontalZoom(int command) {
 	outputMessage(format(translate("{} pixels/second"), formatDouble(hZoom, 1)));
 }
 
-void formatPan(double pan, ostringstream& output) {
+template<typename Stream>
+void formatPanImpl(double pan, Stream& output) {
 	pan *=100.0;
 	if (pan == 0) {
 		// Translators: Panned to the center.
@@ -1488,6 +1634,14 @@ void formatPan(double pan, ostringstream& output) {
 	}
 }
 
+void formatPan(double pan, ostringstream& output) {
+	formatPanImpl(pan, output);
+}
+
+void formatPan(double pan, MessageBuilder& output) {
+	formatPanImpl(pan, output);
+}
+
 void postChangeTrackPan(int command) {
 	MediaTrack* track = GetLastTouchedTrack();
 	if (!track)
@@ -1513,28 +1667,31 @@ void postCycleRippleMode(int command) {
 void reportRepeat(bool repeat) {
 	outputMessage(repeat ?
 		translate("repeat on") :
-		translate("repeat off"));
+		translate("repeat off"), /* interrupt */ true, MS_TRANSPORT);
 }
 
 void postToggleRepeat(int command) {
 	reportRepeat(GetToggleCommandState(1068)); // Transport: Toggle repeat
 }
 
-void addTakeFxNames(MediaItem_Take* take, ostringstream &s) {
+void addTakeFxNames(MediaItem_Take* take, MessageBuilder& s) {
 	if (!settings::reportFx)
 		return;
-	int count = TakeFX_GetCount(take);
-	if (count == 0)
+	const fxTree::Tree& fxs = fxTree::getTopLevel(take);
+	if (fxs.topCount == 0)
 		return;
 	// Translators: Reported when switching takes before listing the effects on
 	// the take.
 	s << "; " << translate("FX:") << " ";
-	char name[256];
-	for (int f = 0; f < count; ++f) {
-		if (f > 0)
+	bool first = true;
+	for (const fxTree::Fx& fx: fxs.fx) {
+		// Only report effects in the main chain, not inside containers.
+		if (fx.level > 1)
+			continue;
+		if (!first)
 			s << ", ";
-		TakeFX_GetFXName(take, f, name, sizeof(name));
-		shortenFxName(name, s);
+		first = false;
+		shortenFxName(fx.name.c_str(), s);
 	}
 }
 
@@ -1551,7 +1708,7 @@ void postSwitchToTake(int command) {
 		}
 		return;
 	}
-	ostringstream s;
+	MessageBuilder s;
 	s << (int)(size_t)GetSetMediaItemTakeInfo(take, "IP_TAKENUMBER", nullptr) + 1 << " "
 		<< GetTakeName(take);
 	addTakeFxNames(take, s);
@@ -1700,15 +1857,17 @@ void postToggleMasterTrackVisible(int command) {
 void reportTransportState(int state) {
 	if (!settings::reportTransport)
 		return;
+	const char* message;
 	if (state & 2) {
-		outputMessage(translate("pause"));
+		message = translate("pause");
 	} else if (state & 4) {
-		outputMessage(translate("record"));
+		message = translate("record");
 	} else if (state & 1) {
-		outputMessage(translate("play"));
+		message = translate("play");
 	} else {
-		outputMessage(translate("stop"));
+		message = translate("stop");
 	}
+	outputMessage(message, /* interrupt */ true, MS_TRANSPORT);
 }
 
 void postChangeTransportState(int command) {
@@ -2594,13 +2753,20 @@ PostCustomCommand POST_CUSTOM_COMMANDS[] = {
 };
 
 using MExplorerPostExecute = void (*)(int, HWND);
-map<int, MExplorerPostExecute> mExplorerPostCommands{
+struct MExplorerPostCommand {
+	int cmd;
+	MExplorerPostExecute execute;
+};
+const MExplorerPostCommand MEXPLORER_POST_COMMANDS[] = {
 	{42178, postMExplorerChangeVolume }, // Preview: decrease volume by 1 dB
 	{42177, postMExplorerChangeVolume}, // Preview: increase volume by 1 dB
 };
 
-map<int, PostCommandExecute> postCommandsMap;
-map<int, string> POST_COMMAND_MESSAGES = {
+struct PostCommandMessage {
+	int cmd;
+	const char* message;
+};
+const PostCommandMessage POST_COMMAND_MESSAGES[] = {
 	{40625, _t("set selection start")}, // Time selection: Set start point
 	{40222, _t("set loop start")}, // Loop points: Set start point
 	{40223, _t("set loop end")}, // Loop points: Set end point
@@ -2621,7 +2787,7 @@ map<int, string> POST_COMMAND_MESSAGES = {
 	{40491, _t("all tracks unarmed")}, // Track: Unarm all tracks for recording
 	{42467, _t("all delta solos reset")}, // FX: Clear delta solo for all project FX
 };
-const set<int> MOVE_FROM_PLAY_CURSOR_COMMANDS = {
+const int MOVE_FROM_PLAY_CURSOR_COMMANDS[] = {
 	40104, // View: Move cursor left one pixel
 	40105, // View: Move cursor right one pixel
 	41042, // Go forward one measure
@@ -2634,9 +2800,7 @@ const set<int> MOVE_FROM_PLAY_CURSOR_COMMANDS = {
 40647, // View: Move cursor right to grid division
 };
 
-map<int, PostCommandExecute> midiPostCommandsMap;
-map<int, pair<PostCommandExecute, bool>> midiEventListPostCommandsMap;
-map<int, string> MIDI_POST_COMMAND_MESSAGES = {
+const PostCommandMessage MIDI_POST_COMMAND_MESSAGES[] = {
 	{40204, _t("grid whole")}, // Grid: Set to 1
 	{40203, _t("grid half")}, // Grid: Set to 1/2
 	{40190, _t("grid thirty second")}, // Grid: Set to 1/32
@@ -2673,11 +2837,15 @@ struct ToggleCommandMessage {
 	const char* onMsg;
 	const char* offMsg;
 };
+struct ToggleCommand {
+	pair<int, int> id;
+	ToggleCommandMessage message;
+};
 
 // Messages for toggle actions. Specify null messages to report nothing. If a
 // toggle action isn't included here or in another of OSARA's action maps,
 // OSARA will fall back to reporting the toggle state and the action name.
-map<pair<int, int>, ToggleCommandMessage> TOGGLE_COMMAND_MESSAGES = {
+const ToggleCommand TOGGLE_COMMAND_MESSAGES[] = {
 	// {{sectionId, actionId}, {onMsg, offMsg}}, // actionName
 	// Specify nullptr to report nothing for a particular message.
 	// Main section toggles
@@ -2772,20 +2940,65 @@ bool showReaperContextMenu(const int menu) {
 
 const char* WCS_DIALOG = "#32770";
 
-bool isClassName(HWND hwnd, string className) {
+#ifdef _WIN32
+// Getting a class name copies it into a buffer. Windows are classified for
+// almost every event and keystroke, so class names are cached by class atom,
+// which is much cheaper to get.
+string_view getClassName(HWND hwnd) {
+	static unordered_map<ATOM, string> names;
+	const ATOM atom = (ATOM)GetClassLongPtr(hwnd, GCW_ATOM);
+	if (!atom) {
+		return {};
+	}
+	auto it = names.find(atom);
+	if (it == names.end()) {
+		char buffer[256];
+		if (GetClassName(hwnd, buffer, sizeof(buffer)) == 0) {
+			return {};
+		}
+		it = names.emplace(atom, buffer).first;
+	}
+	return it->second;
+}
+#endif
+
+bool isClassName(HWND hwnd, string_view className) {
+#ifdef _WIN32
+	return hwnd && getClassName(hwnd) == className;
+#else
 	char buffer[50];
 	if (GetClassName(hwnd, buffer, sizeof(buffer)) == 0) {
 		return false;
 	}
-	return className.compare(buffer) == 0;
+	return className == buffer;
+#endif
 }
 
 #ifdef _WIN32
 
-HWND getSendContainer(HWND hwnd) {
-	if (!isClassName(hwnd, "Button")) {
-		return nullptr;
-	}
+// Classifications of windows which are checked for most events and
+// keystrokes. These are cached for each window and dropped when the window is
+// destroyed.
+enum WindowFlags {
+	WF_TRACK_VIEW = 1 << 0,
+	WF_LIST_VIEW = 1 << 1,
+	WF_MIDI_EDITOR_EVENT_LIST = 1 << 2,
+};
+
+struct WindowInfo {
+	ATOM atom = 0;
+	int flags = 0;
+	// If this is a button for a send in the Track I/O window, the window
+	// containing the send's controls.
+	HWND sendContainer = nullptr;
+};
+
+unordered_map<HWND, WindowInfo> windowInfoCache;
+// Windows we miss the destruction of (e.g. because they were destroyed before
+// the hook was registered) would otherwise accumulate.
+constexpr size_t MAX_WINDOW_INFO_CACHE = 1000;
+
+HWND findSendContainer(HWND hwnd) {
 	hwnd = GetWindow(hwnd, GW_HWNDPREV);
 	if (!isClassName(hwnd, "Static")) {
 		return nullptr;
@@ -2797,6 +3010,42 @@ HWND getSendContainer(HWND hwnd) {
 	return hwnd;
 }
 
+const WindowInfo& getWindowInfo(HWND hwnd) {
+	static const WindowInfo none;
+	if (!hwnd) {
+		return none;
+	}
+	const ATOM atom = (ATOM)GetClassLongPtr(hwnd, GCW_ATOM);
+	auto it = windowInfoCache.find(hwnd);
+	// Check the atom in case a handle we missed the destruction of was reused.
+	if (it != windowInfoCache.end() && it->second.atom == atom) {
+		return it->second;
+	}
+	if (windowInfoCache.size() >= MAX_WINDOW_INFO_CACHE) {
+		windowInfoCache.clear();
+	}
+	WindowInfo info;
+	info.atom = atom;
+	const string_view className = getClassName(hwnd);
+	if (className == "REAPERTrackListWindow" || className == "REAPERtrackvu" ||
+			className == "REAPERTCPDisplay") {
+		info.flags |= WF_TRACK_VIEW;
+	} else if (className == "SysListView32") {
+		info.flags |= WF_LIST_VIEW;
+		if (isClassName(GetAncestor(hwnd, GA_PARENT), "REAPERmidieditorwnd")) {
+			info.flags |= WF_MIDI_EDITOR_EVENT_LIST;
+		}
+	} else if (className == "Button") {
+		info.sendContainer = findSendContainer(hwnd);
+	}
+	return windowInfoCache[hwnd] = info;
+}
+
+
+HWND getSendContainer(HWND hwnd) {
+	return getWindowInfo(hwnd).sendContainer;
+}
+
 void sendMenu(HWND sendWindow) {
 	// #24: The controls are exposed via MSAA,
 	// but this is difficult for most users to use, especially with the broken MSAA implementation.
@@ -2863,20 +3112,15 @@ void sendMenu(HWND sendWindow) {
 }
 
 bool isTrackViewWindow(HWND hwnd) {
-	WCHAR className[22] = L"\0";
-	GetClassNameW(hwnd, className, ARRAYSIZE(className));
-	return wcscmp(className, L"REAPERTrackListWindow") == 0
-		|| wcscmp(className, L"REAPERtrackvu") == 0
-		|| wcscmp(className, L"REAPERTCPDisplay") == 0;
+	return getWindowInfo(hwnd).flags & WF_TRACK_VIEW;
 }
 
 bool isListView(HWND hwnd) {
-	return isClassName(hwnd, "SysListView32");
+	return getWindowInfo(hwnd).flags & WF_LIST_VIEW;
 }
 
 bool isMidiEditorEventListView(HWND hwnd) {
-	return isListView(hwnd)
-		&& isClassName(GetAncestor(hwnd, GA_PARENT), "REAPERmidieditorwnd");
+	return getWindowInfo(hwnd).flags & WF_MIDI_EDITOR_EVENT_LIST;
 }
 
 void sendNameChangeEventToMidiEditorEventListItem(HWND hwnd) {
@@ -2932,7 +3176,7 @@ bool maybeAnnotatePreferenceDescription() {
 		}
 		// Set the accDescription on the control.
 		accPropServices->SetHwndPropStr(focus, OBJID_CLIENT, CHILDID_SELF,
-			PROPID_ACC_DESCRIPTION, widen(string(text)).c_str());
+			PROPID_ACC_DESCRIPTION, widenToBuffer(text).data());
 		NotifyWinEvent(EVENT_OBJECT_DESCRIPTIONCHANGE, focus, OBJID_CLIENT,
 			CHILDID_SELF);
 	}, 300);
@@ -3223,7 +3467,8 @@ void moveToItem(int direction, bool clearSelection=true, bool select=true) {
 	if (!track)
 		return;
 	double cursor = GetCursorPosition();
-	int count = CountTrackMediaItems(track);
+	const auto& trackItems = itemIndex::get(track);
+	int count = (int)trackItems.items.size();
 	double pos;
 	int start = direction == 1 ? 0 : count - 1;
 	if (currentItem && ValidatePtr((void*)currentItem, "MediaItem*")
@@ -3244,70 +3489,73 @@ void moveToItem(int direction, bool clearSelection=true, bool select=true) {
 	} else
 		currentItem = nullptr; // Invalid.
 
-	for (int i = start; 0 <= i && i < count; i += direction) {
-		MediaItem* item = GetTrackMediaItem(track, i);
-		pos = *(double*)GetSetMediaItemInfo(item, "D_POSITION", nullptr);
-		if (direction == 1 ? pos < cursor : pos > cursor)
-			continue; // Not the right direction.
-		currentItem = item;
-		if ((clearSelection || select) && makeUndoPoint)
-			Undo_BeginBlock();
-		if (clearSelection) {
-			Main_OnCommand(40289, 0); // Item: Unselect all items
-			isSelectionContiguous = true;
-		}
-		if (select)
-			GetSetMediaItemInfo(item, "B_UISEL", &bTrue);
-		if ((clearSelection || select) && makeUndoPoint)
-			Undo_EndBlock(translate("Change Item Selection"), 0);
-		SetEditCurPos(pos, true, true); // Seek playback.
-		fakeFocus = FOCUS_ITEM;
-		selectedEnvelopeIsTake = true;
-		SetCursorContext(1, nullptr);
-		if (!shouldReportTimeMovement()) {
-			return;
-		}
+	const int i = itemIndex::findItem(track, cursor, direction, start);
+	if (i == -1) {
+		return;
+	}
+	MediaItem* item = trackItems.items[i];
+	pos = trackItems.starts[i];
+	currentItem = item;
+	if ((clearSelection || select) && makeUndoPoint)
+		Undo_BeginBlock();
+	if (clearSelection) {
+		Main_OnCommand(40289, 0); // Item: Unselect all items
+		isSelectionContiguous = true;
+	}
+	if (select)
+		GetSetMediaItemInfo(item, "B_UISEL", &bTrue);
+	if ((clearSelection || select) && makeUndoPoint)
+		Undo_EndBlock(translate("Change Item Selection"), 0);
+	// Changing the selection doesn't move items, so the index remains valid.
+	itemIndex::markCurrent(track);
+	SetEditCurPos(pos, true, true); // Seek playback.
+	fakeFocus = FOCUS_ITEM;
+	selectedEnvelopeIsTake = true;
+	SetCursorContext(1, nullptr);
+	if (!shouldReportTimeMovement()) {
+		return;
+	}
 
-		// Report the item.
-		ostringstream s;
-		s << i + 1;
-		if (isItemSelected(item)) {
-			// One selected item is the norm, so don't report selected in this case.
-			if (CountSelectedMediaItems(0) > 1) {
-				s << " " << translate("selected");
-			}
-		} else {
-			s << " " << translate("unselected");
-		}
-		if (*(bool*)GetSetMediaItemInfo(item, "B_MUTE", nullptr)) {
-			s << " " << translate("muted");
+	// Report the item.
+	MessageBuilder s;
+	s << i + 1;
+	if (isItemSelected(item)) {
+		// One selected item is the norm, so don't report selected in this case.
+		if (CountSelectedMediaItems(0) > 1) {
+			s << " " << translate("selected");
 		}
-		if (isItemLocked(item)) {
-			// Translators: Used when navigating items to indicate that an item is
-			// locked.
-			s << " " << translate("locked");
-		}
-		int groupId = *(int*)GetSetMediaItemInfo(item, "I_GROUPID", nullptr);
-		if (groupId) {
-			// Translators: Used when navigating items to indicate that an item is
-			// grouped. {} will be replaced with the group number; e.g. "group 1".
-			s << " " << format(translate("group {}"), groupId);
-		}
-		MediaItem_Take* take = GetActiveTake(item);
-		if (take) {
-			s << " " << GetTakeName(take);
-		}
-		int takeCount = CountTakes(item);
-		if (takeCount > 1) {
-			// Translators: Used when navigating items to indicate the number of
-			// takes. {} will be replaced with the number; e.g. "2 takes".
-			s << " " << format(translate("{} takes"), takeCount);
-		}
-		s << " " << formatCursorPosition();
-		addTakeFxNames(take, s);
-		outputMessage(s);
-		return;
+	} else {
+		s << " " << translate("unselected");
+	}
+	if (*(bool*)GetSetMediaItemInfo(item, "B_MUTE", nullptr)) {
+		s << " " << translate("muted");
+	}
+	if (isItemLocked(item)) {
+		// Translators: Used when navigating items to indicate that an item is
+		// locked.
+		s << " " << translate("locked");
 	}
+	int groupId = *(int*)GetSetMediaItemInfo(item, "I_GROUPID", nullptr);
+	if (groupId) {
+		// Translators: Used when navigating items to indicate that an item is
+		// grouped. {} will be replaced with the group number; e.g. "group 1".
+		s << " ";
+		s.format(translate("group {}"), groupId);
+	}
+	MediaItem_Take* take = GetActiveTake(item);
+	if (take) {
+		s << " " << GetTakeName(take);
+	}
+	int takeCount = CountTakes(item);
+	if (takeCount > 1) {
+		// Translators: Used when navigating items to indicate the number of
+		// takes. {} will be replaced with the number; e.g. "2 takes".
+		s << " ";
+		s.format(translate("{} takes"), takeCount);
+	}
+	s << " " << formatCursorPosition();
+	addTakeFxNames(take, s);
+	outputMessage(s);
 }
 
 void cmdMoveToNextItem(Command* command) {
@@ -3651,7 +3899,7 @@ void reportTempoTimeSig() {
 	int timesig_num=0;
 	int timesig_denom=0;
 	double pos=GetPlayPosition();
-	TimeMap_GetTimeSigAtTime(proj, pos, &timesig_num, &timesig_denom, &tempo);
+	tempoMap::getTimeSigAtTime(pos, &timesig_num, &timesig_denom, &tempo);
 	outputMessage(format("{}, {}/{}", formatDouble(tempo, 1, false), timesig_num, timesig_denom));
 }
 
@@ -3661,6 +3909,7 @@ void cmdManageTempoTimeSigMarkers(Command* command) {
 		return;
 	}
 	Main_OnCommand(40256, 0); // Tempo envelope: Insert tempo/time signature change marker at edit cursor...
+	tempoMap::invalidate();
 }
 
 void cmdSwitchProjectTab(Command* command) {
@@ -3748,15 +3997,13 @@ string formatTrackRange(int start, const char* startName,
 		"start"_a=startText, "end"_a=endText);
 }
 
-template <typename Func>
-string formatTracksWithState(const char* prefix, Func checkState,
-	bool includeMaster, bool multiLine, bool outputIfNone = true
+// Formats a list of tracks for reporting. trackNumbers contains the 1 based
+// numbers of the tracks in order. Unless multiLine is true, consecutive tracks
+// are summarised as ranges.
+string formatTrackList(const char* prefix, bool includesMaster,
+	const vector<int>& trackNumbers, bool multiLine, bool outputIfNone = true
 ) {
 	const char* separator = multiLine ? "\r\n" : ", ";
-	int rangeStart = 0;
-	char* startingTrackName;
-	char* prevTrackName;
-	bool inActiveRange = false;
 	ostringstream s;
 
 	if (prefix) {
@@ -3765,76 +4012,53 @@ string formatTracksWithState(const char* prefix, Func checkState,
 	}
 
 	int count = 0;
-	if(includeMaster) {
-		MediaTrack* master = GetMasterTrack(nullptr);
-		if (checkState(master)) {
-			++count;
-			s << translate("master") << separator;
-		}
+	if (includesMaster) {
+		++count;
+		s << translate("master") << separator;
 	}
 
-	int trackCount = CountTracks(0);
-	for (int i = 0; i < trackCount; ++i) {
-		const int trackNumber = i + 1;
-		MediaTrack* track = GetTrack(nullptr, i);
-		char* name = (char*)GetSetMediaTrackInfo(track, "P_NAME", nullptr);
+	auto getName = [](int trackNumber) {
+		MediaTrack* track = GetTrack(nullptr, trackNumber - 1);
+		return (char*)GetSetMediaTrackInfo(track, "P_NAME", nullptr);
+	};
+	const int matchCount = (int)trackNumbers.size();
+	for (int m = 0; m < matchCount; ++m) {
+		const int trackNumber = trackNumbers[m];
 		if (multiLine) {
 			// We don't summarise ranges in this case. We output each track.
-			if (checkState(track)) {
-				++count;
-				if (count > 1) {
-					s << separator;
-				}
+			++count;
+			if (count > 1) {
+				s << separator;
+			}
+			if (settings::reportTrackNumbers) {
+				s << trackNumber;
+			}
+			char* name = getName(trackNumber);
+			if (name && name[0]) {
 				if (settings::reportTrackNumbers) {
-					s << trackNumber;
-				}
-				if (name && name[0]) {
-					if (settings::reportTrackNumbers) {
-						s << " ";
-					}
-					s << name;
-				} else if (!settings::reportTrackNumbers) {
-					// There's no name and track number reporting is disabled. We report
-					// the number in lieu of the name.
-					s << i + 1;
+					s << " ";
 				}
+				s << name;
+			} else if (!settings::reportTrackNumbers) {
+				// There's no name and track number reporting is disabled. We report
+				// the number in lieu of the name.
+				s << trackNumber;
 			}
 			continue;
 		}
-
-		if (checkState(track)) {
-			prevTrackName = name;
-			if (trackNumber == trackCount) {
-				// No more tracks. Output the last range.
-				++count;
-				if (count > 1) {
-					s << separator;
-				}
-				s << formatTrackRange(inActiveRange ? rangeStart : trackCount,
-					inActiveRange ? startingTrackName : name, trackCount, name, separator);
-				break;
-			}
-			if (inActiveRange) {
-				// Not interested in tracks within a range, only those at each end.
-				continue;
-			}
-			inActiveRange = true;
-			rangeStart = trackNumber;
-			startingTrackName = name;
-		} else {
-			if (inActiveRange) {
-				// This track doesn't match. Output the previous range.
-				++count;
-				if (count > 1) {
-					s << separator;
-				}
-				s << formatTrackRange(rangeStart, startingTrackName, i, prevTrackName,
-					separator);
-				startingTrackName = nullptr;
-				rangeStart = 0;
-				inActiveRange = false;
-			}
+		// Find the end of the range of consecutive tracks starting here.
+		int last = m;
+		while (last + 1 < matchCount &&
+				trackNumbers[last + 1] == trackNumbers[last] + 1) {
+			++last;
+		}
+		++count;
+		if (count > 1) {
+			s << separator;
 		}
+		s << formatTrackRange(trackNumber, getName(trackNumber),
+			trackNumbers[last], getName(trackNumbers[last]), separator);
+		m = last;
 	}
 
 	if (count == 0) {
@@ -3848,6 +4072,33 @@ string formatTracksWithState(const char* prefix, Func checkState,
 	return s.str();
 }
 
+template <typename Func>
+string formatTracksWithState(const char* prefix, Func checkState,
+	bool includeMaster, bool multiLine, bool outputIfNone = true
+) {
+	vector<int> trackNumbers;
+	int trackCount = CountTracks(0);
+	for (int i = 0; i < trackCount; ++i) {
+		if (checkState(GetTrack(nullptr, i))) {
+			trackNumbers.push_back(i + 1);
+		}
+	}
+	return formatTrackList(prefix,
+		includeMaster && checkState(GetMasterTrack(nullptr)), trackNumbers,
+		multiLine, outputIfNone);
+}
+
+// Like formatTracksWithState, but uses the track state table rather than
+// checking every track. checkState is only used for the master track.
+template <typename Func>
+string formatTracksWithState(const char* prefix, trackStates::State state,
+	Func checkState, bool includeMaster, bool multiLine
+) {
+	return formatTrackList(prefix,
+		includeMaster && checkState(GetMasterTrack(nullptr)),
+		trackStates::getTrackNumbers(state), multiLine);
+}
+
 template <typename Func>
 void reportTracksWithState(const char* prefix, Func checkState,
 	bool includeMaster
@@ -3862,15 +4113,30 @@ void reportTracksWithState(const char* prefix, Func checkState,
 	}
 }
 
+template <typename Func>
+void reportTracksWithState(const char* prefix, trackStates::State state,
+	Func checkState, bool includeMaster
+) {
+	bool multiLine = lastCommandRepeatCount == 1;
+	string s = formatTracksWithState(multiLine ? nullptr : prefix, state,
+		checkState, includeMaster, multiLine);
+	if (multiLine) {
+		reviewMessage(prefix, s.c_str());
+	} else {
+		outputMessage(s);
+	}
+}
+
 void cmdReportMutedTracks(Command* command) {
-	reportTracksWithState(translate("Muted"), isTrackMuted, /* includeMaster */ true);
+	reportTracksWithState(translate("Muted"), trackStates::MUTED, isTrackMuted,
+		/* includeMaster */ true);
 }
 
 void cmdReportSoloedTracks(Command* command) {
 	bool multiLine = lastCommandRepeatCount == 1;
 	ostringstream s;
-	s << formatTracksWithState(translate("soloed"), isTrackSoloed, /* includeMaster */ true,
-		multiLine);
+	s << formatTracksWithState(translate("soloed"), trackStates::SOLOED,
+		isTrackSoloed, /* includeMaster */ true, multiLine);
 	string defeat = formatTracksWithState(translate("defeating solo"),
 		isTrackDefeatingSolo, /* includeMaster */ false, multiLine,
 		/* outputIfNone */ false);
@@ -3885,12 +4151,13 @@ void cmdReportSoloedTracks(Command* command) {
 }
 
 void cmdReportArmedTracks(Command* command) {
-	reportTracksWithState(translate("Armed"), isTrackArmed, /* includeMaster */ false);
+	reportTracksWithState(translate("Armed"), trackStates::ARMED, isTrackArmed,
+		/* includeMaster */ false);
 }
 
 void cmdReportMonitoredTracks(Command* command) {
-	reportTracksWithState(translate("Monitored"), isTrackMonitored,
-		/* includeMaster */ false);
+	reportTracksWithState(translate("Monitored"), trackStates::MONITORED,
+		isTrackMonitored, /* includeMaster */ false);
 }
 
 void cmdReportPhaseInvertedTracks(Command* command) {
@@ -3922,6 +4189,32 @@ string formatItemsWithState(Func stateCheck, bool multiLine) {
 	return s.str();
 }
 
+// Like formatItemsWithState, but only checks the items on selected tracks
+// which contain pos, using the item index.
+string formatItemsAtPosOnSelectedTracks(double pos, bool multiLine) {
+	const char* separator = multiLine ? "\r\n" : ", ";
+	ostringstream s;
+	int count = 0;
+	for (int t = 0; t < CountTracks(nullptr); ++t) {
+		MediaTrack* track = GetTrack(nullptr, t);
+		if (!isTrackSelected(track)) {
+			continue;
+		}
+		const auto& trackItems = itemIndex::get(track);
+		for (int i: itemIndex::findItemsAt(track, pos)) {
+			++count;
+			if (count > 1) {
+				s << separator;
+			}
+			s << t + 1 << "." << i + 1;
+			MediaItem_Take* take = GetActiveTake(trackItems.items[i]);
+			if (take)
+				s << " " << GetTakeName(take);
+		}
+	}
+	return s.str();
+}
+
 void cmdReportSelection(Command* command) {
 	const bool multiLine = lastCommandRepeatCount == 1;
 	const char* separator = multiLine ? "\r\n" : ", ";
@@ -4637,40 +4930,27 @@ void cmdReportRegionMarkerItems(Command* command) {
 		}
 	};
 	double pos = GetPlayState()? GetPlayPosition():GetCursorPosition();
-	double start,end;
-	bool isrgn;
-	int number;
-	const char* name{nullptr};
-	int idx = 0;
-	while(EnumProjectMarkers(idx++, &isrgn, &start, &end, &name, &number)>0) {
-		if(!(isrgn && start <= pos && pos <= end)) {
-			continue;
-		} 
+	for (auto region: markerIndex::findRegionsContaining(pos)) {
 		separate();
-		if(name[0]) {
-			s << name ;
+		if(!region->name.empty()) {
+			s << region->name ;
 		} else {
 			// Translators: used to report an unnamed region. {} is replaced with the region number.  
-			s << format(translate("region {}"), number);
+			s << format(translate("region {}"), region->number);
 		}
 	}
-	int markerIdx;
-	GetLastMarkerAndCurRegion(nullptr, pos, &markerIdx, nullptr);
-	if(markerIdx >=0) {
-		EnumProjectMarkers(markerIdx, nullptr, nullptr, nullptr, &name, &number);
+	auto marker = markerIndex::findLastMarker(pos);
+	if(marker) {
 		separate();
-		if (name[0]) {
-			s << name;
+		if (!marker->name.empty()) {
+			s << marker->name;
 		} else {
 			// Translators: used to report an unnamed marker. {} is replaced with the marker number.  
-			s << format(translate("marker {}"), number);
+			s << format(translate("marker {}"), marker->number);
 		}
 	}
 	separate();
-	s << formatItemsWithState([pos](MediaItem* item) -> bool{
-		MediaTrack* track = GetMediaItem_Track(item);
-		return (isTrackSelected(track) && isPosInItem(pos, item));
-	}, multiLine);
+	s << formatItemsAtPosOnSelectedTracks(pos, multiLine);
 	if(multiLine) {
 		// Translators: The title of the review message for the action "OSARA: Report regions, last project marker and items on selected tracks at current position".
 		reviewMessage(translate("At Current Position"), s.str().c_str());
@@ -4877,6 +5157,9 @@ Command COMMANDS[] = {
 	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Report Peak Watcher value for first watcher second channel")}, "OSARA_REPORTPEAKWATCHERT1C2", cmdReportPeakWatcherW1C2},
 	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Report Peak Watcher value for second watcher first channel")}, "OSARA_REPORTPEAKWATCHERT2C1", cmdReportPeakWatcherW2C1},
 	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Report Peak Watcher value for second watcher second channel")}, "OSARA_REPORTPEAKWATCHERT2C2", cmdReportPeakWatcherW2C2},
+	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Report Peak Watcher values for all channels of first watcher")}, "OSARA_REPORTPEAKWATCHERT1", cmdReportPeakWatcherW1},
+	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Report Peak Watcher values for all channels of second watcher")}, "OSARA_REPORTPEAKWATCHERT2", cmdReportPeakWatcherW2},
+	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Report Peak Watcher values for all watchers")}, "OSARA_REPORTPEAKWATCHERS", cmdReportPeakWatchers},
 	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Reset Peak Watcher first watcher")}, "OSARA_RESETPEAKWATCHERT1", cmdResetPeakWatcherW1},
 	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Reset Peak Watcher second watcher")}, "OSARA_RESETPEAKWATCHERT2", cmdResetPeakWatcherW2},
 	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Pause/resume Peak Watcher")}, "OSARA_PAUSEPEAKWATCHER", cmdPausePeakWatcher},
@@ -4933,6 +5216,8 @@ Command COMMANDS[] = {
 	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Check for update")}, "OSARA_UPDATE", cmdCheckForUpdate},
 	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Open online documentation")}, "OSARA_OPENDOC", cmdOpenDoc},
 	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Report tempo and time signature at play cursor; press twice to add/edit tempo markers")}, "OSARA_MANAGETEMPOTIMESIGMARKERS", cmdManageTempoTimeSigMarkers},
+	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Toggle latency measurement")}, "OSARA_TOGGLELATENCY", latency::cmdToggleLatencyMeasurement},
+	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Report latency measurements")}, "OSARA_REPORTLATENCY", latency::cmdReportLatency},
 	{MIDI_EDITOR_SECTION, {DEFACCEL, _t("OSARA: Enable noncontiguous selection/toggle selection of current chord/note")}, "OSARA_MIDITOGGLESEL", cmdMidiToggleSelection},
 	{MIDI_EDITOR_SECTION, {DEFACCEL, _t("OSARA: Move to next chord")}, "OSARA_NEXTCHORD", cmdMidiMoveToNextChord},
 	{MIDI_EDITOR_SECTION, {DEFACCEL, _t("OSARA: Move to previous chord")}, "OSARA_PREVCHORD", cmdMidiMoveToPreviousChord},
@@ -4946,6 +5231,8 @@ Command COMMANDS[] = {
 	{MIDI_EDITOR_SECTION, {DEFACCEL, _t("OSARA: Move to previous CC")}, "OSARA_PREVCC", cmdMidiMoveToPreviousCC},
 	{MIDI_EDITOR_SECTION, {DEFACCEL, _t("OSARA: Move to next CC and add to selection")}, "OSARA_NEXTCCKEEPSEL", cmdMidiMoveToNextCCKeepSel},
 	{MIDI_EDITOR_SECTION, {DEFACCEL, _t("OSARA: Move to previous CC and add to selection")}, "OSARA_PREVCCKEEPSEL", cmdMidiMoveToPreviousCCKeepSel},
+	{MIDI_EDITOR_SECTION, {DEFACCEL, _t("OSARA: Move to next CC in current CC lane")}, "OSARA_NEXTCCINLANE", cmdMidiMoveToNextCCInLane},
+	{MIDI_EDITOR_SECTION, {DEFACCEL, _t("OSARA: Move to previous CC in current CC lane")}, "OSARA_PREVCCINLANE", cmdMidiMoveToPreviousCCInLane},
 	{MIDI_EDITOR_SECTION, {DEFACCEL, _t("OSARA: Move to previous midi item on track")}, "OSARA_MIDIPREVITEM", cmdMidiMoveToPrevItem},
 	{MIDI_EDITOR_SECTION, {DEFACCEL, _t("OSARA: Move to next midi item on track")}, "OSARA_MIDINEXTITEM", cmdMidiMoveToNextItem},
 	{MIDI_EDITOR_SECTION, {DEFACCEL, _t("OSARA: Select all notes with the same pitch starting in time selection")}, "OSARA_SELSAMEPITCHTIMESEL", cmdMidiSelectSamePitchStartingInTimeSelection},
@@ -4957,76 +5244,168 @@ Command COMMANDS[] = {
 	{ MEDIA_EXPLORER_SECTION, {DEFACCEL, _t("OSARA: Mute next message from OSARA")}, "OSARA_MX_MUTENEXTMESSAGE", cmdMuteNextMessage},
 	{0, {}, nullptr, nullptr},
 };
-map<pair<int, int>, Command*> commandsMap;
+
+// Everything OSARA knows about how to handle a command, so that handling a
+// key press only requires a single lookup. The tables above are merged into
+// this when OSARA is initialised.
+struct CommandDispatch {
+	int section;
+	int cmd;
+	// One of OSARA's own commands.
+	Command* osaraCommand = nullptr;
+	PostCommandExecute postExecute = nullptr;
+	MExplorerPostExecute mExplorerPostExecute = nullptr;
+	const char* postMessage = nullptr;
+	const ToggleCommandMessage* toggleMessage = nullptr;
+	bool moveFromPlayCursor = false;
+	bool changesValueInMidiEventList = false;
+};
+
+// Sorted by section and then command.
+vector<CommandDispatch> dispatchTable;
+
+bool compareDispatch(const CommandDispatch& dispatch, pair<int, int> id) {
+	return make_pair(dispatch.section, dispatch.cmd) < id;
+}
+
+const CommandDispatch* findDispatch(int section, int cmd) {
+	auto it = lower_bound(dispatchTable.cbegin(), dispatchTable.cend(),
+		make_pair(section, cmd), compareDispatch);
+	if (it == dispatchTable.cend() || it->section != section || it->cmd != cmd) {
+		return nullptr;
+	}
+	return &*it;
+}
+
+// Get the dispatch entry for a command so it can be filled in, adding it if
+// necessary. This should only be used during initialisation. Fields should be
+// filled with setDispatchField so that if a command is in a table twice, the
+// first registration wins.
+CommandDispatch& addDispatch(int section, int cmd) {
+	auto it = lower_bound(dispatchTable.begin(), dispatchTable.end(),
+		make_pair(section, cmd), compareDispatch);
+	if (it == dispatchTable.end() || it->section != section || it->cmd != cmd) {
+		it = dispatchTable.insert(it, CommandDispatch{section, cmd});
+	}
+	return *it;
+}
+
+template<typename T>
+void setDispatchField(T& field, T value) {
+	if (!field) {
+		field = value;
+	}
+}
+
+void buildDispatchTable() {
+	for (int i = 0; POST_COMMANDS[i].cmd; ++i) {
+		setDispatchField(addDispatch(MAIN_SECTION, POST_COMMANDS[i].cmd).postExecute,
+			POST_COMMANDS[i].execute);
+	}
+	for (auto& message: POST_COMMAND_MESSAGES) {
+		setDispatchField(addDispatch(MAIN_SECTION, message.cmd).postMessage,
+			message.message);
+	}
+	for (int cmd: MOVE_FROM_PLAY_CURSOR_COMMANDS) {
+		addDispatch(MAIN_SECTION, cmd).moveFromPlayCursor = true;
+	}
+	for (auto& midiPostCommand: MIDI_POST_COMMANDS) {
+		setDispatchField(
+			addDispatch(MIDI_EDITOR_SECTION, midiPostCommand.cmd).postExecute,
+			midiPostCommand.execute);
+		if (midiPostCommand.supportedInMidiEventList) {
+			auto& dispatch = addDispatch(MIDI_EVENT_LIST_SECTION,
+				midiPostCommand.cmd);
+			if (!dispatch.postExecute) {
+				dispatch.postExecute = midiPostCommand.execute;
+				dispatch.changesValueInMidiEventList =
+					midiPostCommand.changesValueInMidiEventList;
+			}
+		}
+	}
+	for (auto& message: MIDI_POST_COMMAND_MESSAGES) {
+		setDispatchField(addDispatch(MIDI_EDITOR_SECTION, message.cmd).postMessage,
+			message.message);
+	}
+	for (auto& command: MEXPLORER_POST_COMMANDS) {
+		setDispatchField(
+			addDispatch(MEDIA_EXPLORER_SECTION, command.cmd).mExplorerPostExecute,
+			command.execute);
+	}
+	for (auto& toggle: TOGGLE_COMMAND_MESSAGES) {
+		setDispatchField(
+			addDispatch(toggle.id.first, toggle.id.second).toggleMessage,
+			&toggle.message);
+	}
+}
 
 /*** Initialisation, termination and inner workings. */
 
 bool isHandlingCommand = false;
 
-bool handlePostCommand(int section, int command, int val, int valHw,
+bool handlePostCommand(const CommandDispatch& dispatch, int val, int valHw,
 	int relMode, HWND hwnd
 ) {
+	const int section = dispatch.section;
+	const int command = dispatch.cmd;
 	if (section==MAIN_SECTION) {
-		const auto postIt = postCommandsMap.find(command);
-		if (postIt != postCommandsMap.end()) {
+		if (dispatch.postExecute) {
 			isHandlingCommand = true;
-			if (settings::moveFromPlayCursor) {
-				const auto cursorIt = MOVE_FROM_PLAY_CURSOR_COMMANDS.find(command);
-				if (cursorIt != MOVE_FROM_PLAY_CURSOR_COMMANDS.end()) {
-					if (GetPlayState() & 1) { // Playing
-						SetEditCurPos(GetPlayPosition(), false, false);
-					}
+			if (settings::moveFromPlayCursor && dispatch.moveFromPlayCursor) {
+				if (GetPlayState() & 1) { // Playing
+					SetEditCurPos(GetPlayPosition(), false, false);
 				}
 			}
 			// #244: If the command was triggered via MIDI, pass the MIDI data when
 			// executing the command so that toggles, etc. work as expected.
 			KBD_OnMainActionEx(command, val, valHw, relMode, hwnd, nullptr);
-			postIt->second(command);
+			latency::markActionEnd();
+			dispatch.postExecute(command);
 			lastCommand=command;
 			lastCommandTime = GetTickCount();
 			isHandlingCommand = false;
 			return true;
 		}
-		const auto mIt = POST_COMMAND_MESSAGES.find(command);
-		if (mIt != POST_COMMAND_MESSAGES.end()) {
+		if (dispatch.postMessage) {
 			isHandlingCommand = true;
 			KBD_OnMainActionEx(command, val, valHw, relMode, hwnd, nullptr);
-			outputMessage(translate(mIt->second));
+			latency::markActionEnd();
+			outputMessage(translate(dispatch.postMessage));
 			lastCommandTime = GetTickCount();
 			isHandlingCommand = false;
 			return true;
 		}
 	}else if (section==MIDI_EDITOR_SECTION) {
-		const auto it = midiPostCommandsMap.find(command);
-		if (it != midiPostCommandsMap.end()) {
+		if (dispatch.postExecute) {
 			isHandlingCommand = true;
 			HWND editor = MIDIEditor_GetActive();
 			MIDIEditor_OnCommand(editor, command);
-			it->second(command);
+			latency::markActionEnd();
+			dispatch.postExecute(command);
 			lastCommandTime = GetTickCount();
 			isHandlingCommand = false;
 			return true;
 		}
-		const auto mIt = MIDI_POST_COMMAND_MESSAGES.find(command);
-		if (mIt != MIDI_POST_COMMAND_MESSAGES.end()) {
+		if (dispatch.postMessage) {
 			isHandlingCommand = true;
 			HWND editor = MIDIEditor_GetActive();
 			MIDIEditor_OnCommand(editor, command);
-			outputMessage(translate(mIt->second));
+			latency::markActionEnd();
+			outputMessage(translate(dispatch.postMessage));
 			lastCommandTime = GetTickCount();
 			isHandlingCommand = false;
 			return true;
 		}
 	}else if (section==MIDI_EVENT_LIST_SECTION) {
-		const auto it = midiEventListPostCommandsMap.find(command);
-		if (it != midiEventListPostCommandsMap.end()) {
+		if (dispatch.postExecute) {
 			isHandlingCommand = true;
 			lastCommandTime = GetTickCount();
 			HWND editor = MIDIEditor_GetActive();
 			MIDIEditor_OnCommand(editor, command);
-			it->second.first(command);
+			latency::markActionEnd();
+			dispatch.postExecute(command);
 			#ifdef _WIN32
-			if (it->second.second) { // changesValueInMidiEventList
+			if (dispatch.changesValueInMidiEventList) {
 				HWND focus = GetFocus();
 				if (focus && isMidiEditorEventListView(focus)) {
 					sendNameChangeEventToMidiEditorEventListItem(focus);
@@ -5037,11 +5416,11 @@ bool handlePostCommand(int section, int command, int val, int valHw,
 			return true;
 		}
 	} else if(section == MEDIA_EXPLORER_SECTION) {
-		const auto it = mExplorerPostCommands.find(command);
-		if(it != mExplorerPostCommands.end()){
+		if (dispatch.mExplorerPostExecute) {
 			isHandlingCommand = true;
 			SendMessage(hwnd, WM_COMMAND, command, 0);
-			it->second(command, hwnd);
+			latency::markActionEnd();
+			dispatch.mExplorerPostExecute(command, hwnd);
 			lastCommandTime = GetTickCount();
 			isHandlingCommand = false;
 			return true;
@@ -5050,28 +5429,37 @@ bool handlePostCommand(int section, int command, int val, int valHw,
 	return false;
 }
 
-bool handleToggleCommand(KbdSectionInfo* section, int command, int val, int valHw, int relMode, HWND hwnd) {
-	const auto entry = TOGGLE_COMMAND_MESSAGES.find({section->uniqueID, command});
-	if (entry != TOGGLE_COMMAND_MESSAGES.end() && !entry->second.onMsg &&
-			!entry->second.offMsg) {
+// This isn't cached, since custom actions can be created, deleted or remapped
+// at any time and REAPER doesn't notify us.
+bool isCustomAction(KbdSectionInfo* section, int command) {
+	const char* name = getActionName(command, section, false);
+	// The string "Custom: " in this context doesn't seem to be in the REAPER
+	// template language pack, so this should be constant regardless of language.
+	return strncmp(name, "Custom: ", 8) == 0;
+}
+
+bool handleToggleCommand(KbdSectionInfo* section, int command,
+	const CommandDispatch* dispatch, int val, int valHw, int relMode, HWND hwnd
+) {
+	const ToggleCommandMessage* entry = dispatch ? dispatch->toggleMessage :
+		nullptr;
+	if (entry && !entry->onMsg && !entry->offMsg) {
 		return false; // Ignore.
 	}
 	int oldState = GetToggleCommandState2(section, command);
 	if (oldState == -1) {
 		return false; // Not a toggle action.
 	}
-	const char* name = getActionName(command, section, false);
-	if (strncmp(name, "Custom: ", 8) == 0) {
+	if (isCustomAction(section, command)) {
 		// This is a custom action. Rather than reporting it generically, let OSARA
 		// report and/or handle the inner actions. This is particularly important
 		// for OSARA setting toggles, which would otherwise just be dropped.
-		// The string "Custom: " in this context doesn't seem to be in the REAPER
-		// template language pack, so this should be constant regardless of language.
 		return false;
 	}
 	HWND oldFocus = GetFocus();
 	isHandlingCommand = true;
 	section->onAction(command, val, valHw, relMode, hwnd);
+	latency::markActionEnd();
 	if (oldFocus != GetFocus()) {
 		// Don't report if the focus changes. The focus changing is better
 		// feedback and we don't want to interrupt that.
@@ -5083,8 +5471,8 @@ bool handleToggleCommand(KbdSectionInfo* section, int command, int val, int valH
 		isHandlingCommand = false;
 		return true; // No change, report nothing.
 	}
-	if (entry != TOGGLE_COMMAND_MESSAGES.end()) {
-		const char* message = newState ? entry->second.onMsg : entry->second.offMsg;
+	if (entry) {
+		const char* message = newState ? entry->onMsg : entry->offMsg;
 		if (message) {
 			outputMessage(translate(message));
 		}
@@ -5100,9 +5488,44 @@ bool handleToggleCommand(KbdSectionInfo* section, int command, int val, int valH
 	return true;
 }
 
+// Startup is split into stages so that REAPER isn't held up by work which
+// isn't needed to handle the first keystroke. The time taken by each stage is
+// recorded for the latency report.
+// 1. REAPER_PLUGIN_ENTRYPOINT: configuration, translations, peak watcher
+// project config, commands, hooks and menus. Translations can't be deferred
+// because action names are translated when they're registered here, and REAPER
+// doesn't let us rename actions later. When a precompiled catalog is present,
+// loading it is cheap; only the po fallback parses text. Peak watcher must
+// register for project config here, since REAPER loads the last project before
+// any later stage and would otherwise drop its configuration. The registration
+// itself does no other work.
+// 2. delayedInit, once REAPER is running: UIA and the control surface.
+// 3. idleInit, a little later: custom command lookup, offering to configure
+// REAPER and the update check.
+
+// Feedback for commands from other extensions (e.g. SWS) is looked up by name
+// once those extensions have loaded. This is done when idle or when the first
+// command is run, whichever happens first.
+bool canResolvePostCustomCommands = false;
+bool arePostCustomCommandsResolved = false;
+
+void resolvePostCustomCommands() {
+	if (arePostCustomCommandsResolved || !canResolvePostCustomCommands) {
+		return;
+	}
+	arePostCustomCommandsResolved = true;
+	const int64_t start = latency::now();
+	for (int i = 0; POST_CUSTOM_COMMANDS[i].id; ++i) {
+		int cmd = NamedCommandLookup(POST_CUSTOM_COMMANDS[i].id);
+		if (cmd)
+			setDispatchField(addDispatch(MAIN_SECTION, cmd).postExecute,
+				POST_CUSTOM_COMMANDS[i].execute);
+	}
+	latency::recordStartupStage("custom commands", latency::now() - start);
+}
+
 bool handleCommand(KbdSectionInfo* section, int command, int val, int valHw, int relMode, HWND hwnd) {
-	if (isHandlingCommand)
-		return false; // Prevent re-entrance.
+	onMidiCommand();
 	constexpr int MAIN_ALT_REC_SECTION = 100;
 	if ((MAIN_ALT1_SECTION <= section->uniqueID &&
 				section->uniqueID <= MAIN_ALT16_SECTION) ||
@@ -5113,20 +5536,27 @@ bool handleCommand(KbdSectionInfo* section, int command, int val, int valHw, int
 		// since we don't need to special case these alt sections everywhere.
 		section = SectionFromUniqueID(MAIN_SECTION);
 	}
-	const auto it = commandsMap.find(make_pair(section->uniqueID, command));
-	if (it != commandsMap.end()
+	if (isHandlingCommand) {
+		// An OSARA command is running a REAPER action.
+		return false; // Prevent re-entrance.
+	}
+	latency::Scope latencyScope(section->uniqueID, command);
+	resolvePostCustomCommands();
+	const CommandDispatch* dispatch = findDispatch(section->uniqueID, command);
+	Command* osaraCommand = dispatch ? dispatch->osaraCommand : nullptr;
+	if (osaraCommand
 		// Allow shortcut help to be disabled.
-		&& (!isShortcutHelpEnabled || it->second->execute == cmdShortcutHelp)
+		&& (!isShortcutHelpEnabled || osaraCommand->execute == cmdShortcutHelp)
 	) {
 		isHandlingCommand = true;
-		if (it->second->gaccel.accel.cmd == lastCommand &&
+		if (osaraCommand->gaccel.accel.cmd == lastCommand &&
 				GetTickCount() - lastCommandTime < 500) {
 			++lastCommandRepeatCount;
 		} else {
 			lastCommandRepeatCount = 0;
 		}
-		it->second->execute(it->second);
-		lastCommand = it->second->gaccel.accel.cmd;
+		osaraCommand->execute(osaraCommand);
+		lastCommand = osaraCommand->gaccel.accel.cmd;
 		lastCommandTime = GetTickCount();
 		isHandlingCommand = false;
 		return true;
@@ -5141,16 +5571,18 @@ bool handleCommand(KbdSectionInfo* section, int command, int val, int valHw, int
 		outputMessage(getActionName(command, section, false));
 		return true;
 	}
-	if (handlePostCommand(section->uniqueID, command, val, valHw, relMode,
-			hwnd)) {
+	if (dispatch && handlePostCommand(*dispatch, val, valHw, relMode, hwnd)) {
 		return true;
 	}
 	if (handleSettingCommand(command)) {
 		return true;
 	}
-	if (handleToggleCommand(section, command, val, valHw, relMode, hwnd)) {
+	if (handleToggleCommand(section, command, dispatch, val, valHw, relMode,
+			hwnd)) {
 		return true;
 	}
+	// REAPER will handle this itself, so there's nothing to measure.
+	latencyScope.discard();
 	return false;
 }
 
@@ -5161,9 +5593,21 @@ bool handleMainCommandFallback(int command, int flag) {
 
 IReaperControlSurface* surface = nullptr;
 
+// Initialisation which isn't needed to handle the first keystroke.
+void idleInit() {
+	resolvePostCustomCommands();
+	int64_t start = latency::now();
+	maybeAutoConfigReaperOptimal();
+	latency::recordStartupStage("auto config", latency::now() - start);
+	start = latency::now();
+	startUpdateCheck();
+	latency::recordStartupStage("update check", latency::now() - start);
+}
+
 // Initialisation that must be done after REAPER_PLUGIN_ENTRYPOINT;
 // e.g. because it depends on stuff registered by other plug-ins.
 void delayedInit() {
+	const int64_t start = latency::now();
 #ifdef _WIN32
 	initializeUia();
 #endif
@@ -5171,13 +5615,11 @@ void delayedInit() {
 	plugin_register("csurf_inst", (void*)surface);
 	NF_GetSWSTrackNotes = (decltype(NF_GetSWSTrackNotes))plugin_getapi(
 		"NF_GetSWSTrackNotes");
-	for (int i = 0; POST_CUSTOM_COMMANDS[i].id; ++i) {
-		int cmd = NamedCommandLookup(POST_CUSTOM_COMMANDS[i].id);
-		if (cmd)
-			postCommandsMap.insert(make_pair(cmd, POST_CUSTOM_COMMANDS[i].execute));
-	}
-	maybeAutoConfigReaperOptimal();
-	startUpdateCheck();
+	canResolvePostCustomCommands = true;
+	latency::recordStartupStage("delayed", latency::now() - start);
+	// Give REAPER a chance to finish starting (e.g. loading the last project)
+	// first.
+	CallLater(idleInit, 1000);
 }
 
 void handleCustomMenu(const char* menuId, HMENU menu, int flag) {
@@ -5257,6 +5699,17 @@ DWORD prevForegroundTime = 0;
 HWND prevPrevForegroundHwnd = nullptr;
 
 void CALLBACK handleWinEvent(HWINEVENTHOOK hook, DWORD event, HWND hwnd, LONG objId, long childId, DWORD thread, DWORD time) {
+	if (event == EVENT_OBJECT_DESTROY) {
+		if (objId == OBJID_WINDOW && childId == CHILDID_SELF) {
+			windowInfoCache.erase(hwnd);
+		}
+		return;
+	}
+	if (event == EVENT_OBJECT_SHOW && objId != OBJID_WINDOW) {
+		// For example, the mouse cursor or caret. We only care about dialogs.
+		return;
+	}
+	latency::Scope latencyScope(latency::SOURCE_WIN_EVENT);
 	if (event == EVENT_OBJECT_FOCUS) {
 		HWND foreground = GetForegroundWindow();
 		if (foreground != prevForegroundHwnd) {
@@ -5314,7 +5767,11 @@ void CALLBACK handleWinEvent(HWINEVENTHOOK hook, DWORD event, HWND hwnd, LONG ob
 				// you select an item, REAPERTrackListWindow gets focus.
 				// Sometimes, focus moves after the action executes. Therefore, repeat
 				// the message so the user doesn't miss it.
-				outputMessage(lastMessage);
+				// This is a repeat of something already output, so it bypasses the
+				// message pipeline.
+				if (lastMessage) {
+					_outputMessage(*lastMessage, true);
+				}
 			} else {
 				lastMessageHwnd = nullptr;
 			}
@@ -5342,7 +5799,7 @@ void CALLBACK handleWinEvent(HWINEVENTHOOK hook, DWORD event, HWND hwnd, LONG ob
 			maybeAnnotatePreferenceDescription();
 		}
 	} else if (event == EVENT_OBJECT_SHOW) {
-		if (isClassName(hwnd, "#32770")) {
+		if (isClassName(hwnd, WCS_DIALOG)) {
 			static CallLater fxLater;
 			fxLater.cancel();
 			if (GetFocusedFX(nullptr, nullptr, nullptr)) {
@@ -5356,6 +5813,7 @@ void CALLBACK handleWinEvent(HWINEVENTHOOK hook, DWORD event, HWND hwnd, LONG ob
 	}
 }
 HWINEVENTHOOK winEventHook = nullptr;
+HWINEVENTHOOK focusEventHook = nullptr;
 
 #endif // _WIN32
 
@@ -5367,11 +5825,17 @@ REAPER_PLUGIN_DLL_EXPORT int REAPER_PLUGIN_ENTRYPOINT(REAPER_PLUGIN_HINSTANCE hI
 		if (rec->caller_version != REAPER_PLUGIN_VERSION || !rec->GetFunc || REAPERAPI_LoadAPI(rec->GetFunc) != 0)
 			return 0; // Incompatible.
 
+		const int64_t start = latency::now();
 		pluginHInstance = hInstance;
 		mainHwnd = rec->hwnd_main;
 		loadConfig();
 		resetTimeCache();
+		// Translations are usually the largest part of this stage, so record them
+		// separately.
+		const int64_t translationStart = latency::now();
 		initTranslation();
+		latency::recordStartupStage("translations",
+			latency::now() - translationStart);
 		peakWatcher::initialize();
 
 #ifdef _WIN32
@@ -5379,22 +5843,18 @@ REAPER_PLUGIN_DLL_EXPORT int REAPER_PLUGIN_ENTRYPOINT(REAPER_PLUGIN_HINSTANCE hI
 			return 0;
 		}
 		guiThread = GetWindowThreadProcessId(mainHwnd, nullptr);
-		winEventHook = SetWinEventHook(EVENT_OBJECT_SHOW, EVENT_OBJECT_FOCUS,
+		// Only register for the events we handle. Hide and reorder events lie
+		// between show and focus and are very frequent, so use two ranges.
+		winEventHook = SetWinEventHook(EVENT_OBJECT_DESTROY, EVENT_OBJECT_SHOW,
+			hInstance, handleWinEvent, 0, guiThread, WINEVENT_INCONTEXT);
+		focusEventHook = SetWinEventHook(EVENT_OBJECT_FOCUS, EVENT_OBJECT_FOCUS,
 			hInstance, handleWinEvent, 0, guiThread, WINEVENT_INCONTEXT);
 		annotateSpuriousDialogs(mainHwnd);
 #else
 		NSA11yWrapper::init();
 #endif
 
-		for (int i = 0; POST_COMMANDS[i].cmd; ++i)
-			postCommandsMap.insert(make_pair(POST_COMMANDS[i].cmd, POST_COMMANDS[i].execute));
-
-		for (auto &midiPostCommand: MIDI_POST_COMMANDS) {
-			midiPostCommandsMap.insert(make_pair(midiPostCommand.cmd, midiPostCommand.execute));
-			if (midiPostCommand.supportedInMidiEventList) {
-				midiEventListPostCommandsMap.insert(make_pair(midiPostCommand.cmd, make_pair(midiPostCommand.execute, midiPostCommand.changesValueInMidiEventList)));
-			}
-		}
+		buildDispatchTable();
 
 		for (int i = 0; COMMANDS[i].execute; ++i) {
 			if (COMMANDS[i].id) {
@@ -5411,7 +5871,8 @@ REAPER_PLUGIN_DLL_EXPORT int REAPER_PLUGIN_ENTRYPOINT(REAPER_PLUGIN_HINSTANCE hI
 					COMMANDS[i].gaccel.accel.cmd = rec->Register("custom_action", &action);
 				}
 			}
-			commandsMap.insert(make_pair(make_pair(COMMANDS[i].section, COMMANDS[i].gaccel.accel.cmd), &COMMANDS[i]));
+			setDispatchField(addDispatch(COMMANDS[i].section,
+				COMMANDS[i].gaccel.accel.cmd).osaraCommand, &COMMANDS[i]);
 		}
 		registerSettingCommands();
 		// hookcommand can only handle actions for the main section, so we need hookcommand2.
@@ -5429,14 +5890,17 @@ REAPER_PLUGIN_DLL_EXPORT int REAPER_PLUGIN_ENTRYPOINT(REAPER_PLUGIN_HINSTANCE hI
 #ifdef _WIN32
 		keyboardHook = SetWindowsHookEx(WH_KEYBOARD, keyboardHookProc, nullptr, guiThread);
 #endif
+		latency::recordStartupStage("load", latency::now() - start);
 		return 1;
 
 	} else {
 		// Unload.
 		delete surface;
+		peakWatcher::terminate();
 #ifdef _WIN32
 		UnhookWindowsHookEx(keyboardHook);
 		UnhookWinEvent(winEventHook);
+		UnhookWinEvent(focusEventHook);
 		terminateUia();
 		accPropServices->Release();
 #else
@@ -26,8 +26,7 @@
 #define ID_PEAK_HOLD_TIME 207
 #define ID_PEAK_FOLLOW 208
 #define ID_PEAK_DISABLE 209
-#define ID_PEAK_CHAN1 210
-#define ID_PEAK_CHAN2 211
+#define ID_PEAK_CHANNELS 210
 
 #define ID_CONFIG_DLG 300
 
@@ -47,3 +47,6 @@ BoolSetting(reportNotes, MIDI_EDITOR_SECTION,
 BoolSetting(reportSurfaceChanges, MAIN_SECTION,
 	"Report changes made via &control surfaces",
 	false)
+BoolSetting(peakWatcherHighResolution, MAIN_SECTION,
+	"Measure master track peaks in Peak Watcher at &high resolution",
+	false)
@@ -0,0 +1,170 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Tempo map snapshot code
+ * Copyright 2026 OSARA contributors
+ * License: GNU General Public License version 2.0
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "tempoMap.h"
+
+using namespace std;
+
+namespace tempoMap {
+
+// The part of the tempo map between one tempo marker and the next. Within a
+// segment, the time signature doesn't change and, unless isRamp is true, the
+// tempo is constant, so measures and beats can be calculated directly.
+struct Segment {
+	double start;
+	// The position of start.
+	int measure;
+	double beat;
+	int measureLength;
+	int timeDenom;
+	double tempo;
+	double beatsPerSecond;
+	// True if the tempo changes gradually to that of the next marker.
+	bool isRamp;
+};
+
+// Sorted by start. The first segment covers the project default tempo from
+// time 0 until the first marker.
+vector<Segment> segments;
+
+ReaProject* cachedProject = nullptr;
+int cachedStateCount = -1;
+int cachedCount = -1;
+
+Segment makeSegment(ReaProject* project, double start, double end,
+	double tempo, bool isRamp
+) {
+	Segment segment{start};
+	segment.tempo = tempo;
+	segment.isRamp = isRamp;
+	segment.beat = TimeMap2_timeToBeats(project, start, &segment.measure,
+		&segment.measureLength, nullptr, &segment.timeDenom);
+	if (end <= start) {
+		// The last segment. The tempo is constant from here on, so any interval
+		// will do.
+		end = start + 1;
+	}
+	const double quarters = TimeMap2_timeToQN(project, end) -
+		TimeMap2_timeToQN(project, start);
+	// PPQ and tempo are per quarter note, but a beat is a note of the time
+	// signature denominator; e.g. an eighth note in 6/8.
+	segment.beatsPerSecond = quarters / (end - start) * segment.timeDenom / 4;
+	return segment;
+}
+
+void update() {
+	ReaProject* project = EnumProjects(-1, nullptr, 0);
+	const int stateCount = GetProjectStateChangeCount(project);
+	const int count = CountTempoTimeSigMarkers(project);
+	if (project == cachedProject && stateCount == cachedStateCount &&
+			count == cachedCount) {
+		return;
+	}
+	cachedProject = project;
+	cachedStateCount = stateCount;
+	cachedCount = count;
+	segments.clear();
+	segments.reserve(count + 1);
+	double start = 0;
+	double firstTime = 0;
+	if (count > 0) {
+		GetTempoTimeSigMarker(project, 0, &firstTime, nullptr, nullptr, nullptr,
+			nullptr, nullptr, nullptr);
+	}
+	if (count == 0 || firstTime > 0) {
+		double tempo = 0;
+		int num, denom;
+		TimeMap_GetTimeSigAtTime(project, 0, &num, &denom, &tempo);
+		segments.push_back(makeSegment(project, 0, count > 0 ? firstTime : 0,
+			tempo, false));
+	}
+	for (int i = 0; i < count; ++i) {
+		double tempo;
+		bool isRamp;
+		if (!GetTempoTimeSigMarker(project, i, &start, nullptr, nullptr, &tempo,
+				nullptr, nullptr, &isRamp)) {
+			break;
+		}
+		double end = 0;
+		if (i + 1 < count) {
+			GetTempoTimeSigMarker(project, i + 1, &end, nullptr, nullptr, nullptr,
+				nullptr, nullptr, nullptr);
+		} else {
+			// A gradual tempo change on the last marker has nothing to change to.
+			isRamp = false;
+		}
+		if (!segments.empty() && start < segments.back().start) {
+			// Markers out of order. This shouldn't happen, but if it does, use the
+			// REAPER API for everything rather than guessing.
+			segments.clear();
+			return;
+		}
+		segments.push_back(makeSegment(project, start, end, tempo, isRamp));
+	}
+}
+
+// Returns the segment containing time, or nullptr if the REAPER API must be
+// used instead.
+const Segment* findSegment(double time) {
+	update();
+	auto it = upper_bound(segments.cbegin(), segments.cend(), time,
+		[](double time, const Segment& segment) { return time < segment.start; });
+	if (it == segments.cbegin()) {
+		// Before time 0.
+		return nullptr;
+	}
+	--it;
+	if (it->isRamp) {
+		return nullptr;
+	}
+	return &*it;
+}
+
+double timeToBeats(double time, int* measure, int* measureLength,
+	int* timeDenom
+) {
+	const Segment* segment = findSegment(time);
+	if (!segment) {
+		return TimeMap2_timeToBeats(nullptr, time, measure, measureLength,
+			nullptr, timeDenom);
+	}
+	const double beats = segment->beat +
+		(time - segment->start) * segment->beatsPerSecond;
+	const double measures = floor(beats / segment->measureLength);
+	if (measure) {
+		*measure = segment->measure + (int)measures;
+	}
+	if (measureLength) {
+		*measureLength = segment->measureLength;
+	}
+	if (timeDenom) {
+		*timeDenom = segment->timeDenom;
+	}
+	return beats - measures * segment->measureLength;
+}
+
+void getTimeSigAtTime(double time, int* timeSigNum, int* timeSigDenom,
+	double* tempo
+) {
+	const Segment* segment = findSegment(time);
+	if (!segment) {
+		TimeMap_GetTimeSigAtTime(nullptr, time, timeSigNum, timeSigDenom, tempo);
+		return;
+	}
+	*timeSigNum = segment->measureLength;
+	*timeSigDenom = segment->timeDenom;
+	*tempo = segment->tempo;
+}
+
+void invalidate() {
+	cachedProject = nullptr;
+}
+
+}
@@ -0,0 +1,30 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Tempo map snapshot header
+ * Copyright 2026 OSARA contributors
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include "osara.h"
+
+// Caches the tempo and time signature markers in the current project so that
+// converting times to measures and beats doesn't need to walk REAPER's tempo
+// map for every report; e.g. while reporting time movement during playback.
+// The snapshot is rebuilt when the project or its tempo markers change.
+// Segments with gradual tempo changes fall back to the REAPER API.
+namespace tempoMap {
+
+// Like TimeMap2_timeToBeats for the current project. Returns the beat within
+// the measure.
+double timeToBeats(double time, int* measure, int* measureLength,
+	int* timeDenom);
+// Like TimeMap_GetTimeSigAtTime for the current project.
+void getTimeSigAtTime(double time, int* timeSigNum, int* timeSigDenom,
+	double* tempo);
+// Called when a command changes the tempo map, so the snapshot is rebuilt
+// even if REAPER hasn't updated the project state yet.
+void invalidate();
+
+}
@@ -0,0 +1,95 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Track state table code
+ * Copyright 2026 OSARA contributors
+ * License: GNU General Public License version 2.0
+ */
+
+#include <algorithm>
+#include <vector>
+#include "trackStates.h"
+#include "trackTable.h"
+
+using namespace std;
+
+namespace trackStates {
+
+// Whether each state in the table is current. A state that isn't must be
+// rebuilt before it is used.
+bool isValid[STATE_COUNT] = {};
+ReaProject* cachedProject = nullptr;
+
+bool queryState(MediaTrack* track, State state) {
+	switch (state) {
+		case MUTED:
+			return isTrackMuted(track);
+		case SOLOED:
+			return isTrackSoloed(track);
+		case ARMED:
+			return isTrackArmed(track);
+		case MONITORED:
+			return isTrackMonitored(track);
+		default:
+			return false;
+	}
+}
+
+void invalidate() {
+	fill(begin(isValid), end(isValid), false);
+}
+
+// Only the requested state is queried, so reporting one state after the track
+// list changes doesn't cost a query for every state.
+void rebuild(State state) {
+	for (auto& entry: trackTable::getTracks()) {
+		if (queryState(entry.track, state)) {
+			entry.states |= 1 << state;
+		} else {
+			entry.states &= ~(1 << state);
+		}
+	}
+	isValid[state] = true;
+}
+
+vector<int> getTrackNumbers(State state) {
+	ReaProject* project = EnumProjects(-1, nullptr, 0);
+	if (project != cachedProject) {
+		cachedProject = project;
+		invalidate();
+	}
+	if (!isValid[state]) {
+		rebuild(state);
+	}
+	vector<int> numbers;
+	const auto& tracks = trackTable::getTracks();
+	for (int i = 0; i < (int)tracks.size(); ++i) {
+		if (tracks[i].states & (1 << state)) {
+			numbers.push_back(i + 1);
+		}
+	}
+	return numbers;
+}
+
+void update(MediaTrack* track, State state, bool enabled) {
+	if (!isValid[state] || track == GetMasterTrack(nullptr)) {
+		// The table will be rebuilt before it is next used anyway.
+		return;
+	}
+	trackTable::Entry* entry = trackTable::get(track);
+	if (!entry) {
+		return;
+	}
+	if (enabled) {
+		entry->states |= 1 << state;
+	} else {
+		entry->states &= ~(1 << state);
+	}
+}
+
+void onTrackListChange() {
+	// New tracks have no states yet. This can happen many times while a project
+	// loads, so don't rebuild until the table is next used.
+	invalidate();
+}
+
+}
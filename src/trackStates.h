@@ -0,0 +1,35 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Track state table header
+ * Copyright 2026 OSARA contributors
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <vector>
+#include "osara.h"
+
+// Keeps track of which tracks are muted, soloed, etc. so that reporting all
+// such tracks doesn't need to query every track in the project.
+// The states are stored in the track table. They are fed by the control surface
+// and each state is rebuilt lazily when it is next needed after the track list
+// changes or the project is switched. The master track isn't included.
+namespace trackStates {
+
+enum State {
+	MUTED,
+	SOLOED,
+	ARMED,
+	MONITORED,
+	STATE_COUNT
+};
+
+// Returns the numbers (1 based) of the tracks in a state, in order.
+std::vector<int> getTrackNumbers(State state);
+// Called by the control surface when REAPER notifies it of a state change.
+void update(MediaTrack* track, State state, bool enabled);
+// Called when tracks are added, removed or reordered.
+void onTrackListChange();
+
+}
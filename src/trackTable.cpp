@@ -0,0 +1,75 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Track table code
+ * Copyright 2026 OSARA contributors
+ * License: GNU General Public License version 2.0
+ */
+
+#include <unordered_map>
+#include <vector>
+#include "trackTable.h"
+
+using namespace std;
+
+namespace trackTable {
+
+vector<Entry> tracks;
+Entry master;
+// False if the table needs to be compacted before it is used.
+bool isValid = false;
+
+void compact() {
+	unordered_map<MediaTrack*, size_t> oldIndexes;
+	oldIndexes.reserve(tracks.size());
+	for (size_t i = 0; i < tracks.size(); ++i) {
+		oldIndexes[tracks[i].track] = i;
+	}
+	const int count = CountTracks(nullptr);
+	vector<Entry> newTracks(count);
+	for (int i = 0; i < count; ++i) {
+		MediaTrack* track = GetTrack(nullptr, i);
+		auto it = oldIndexes.find(track);
+		if (it != oldIndexes.end()) {
+			newTracks[i] = std::move(tracks[it->second]);
+		}
+		newTracks[i].track = track;
+	}
+	tracks = std::move(newTracks);
+	MediaTrack* masterTrack = GetMasterTrack(nullptr);
+	if (master.track != masterTrack) {
+		master = Entry();
+		master.track = masterTrack;
+	}
+	isValid = true;
+}
+
+Entry* get(MediaTrack* track) {
+	if (!isValid) {
+		compact();
+	}
+	if (track == master.track) {
+		return &master;
+	}
+	const int number = (int)(size_t)GetSetMediaTrackInfo(track,
+		"IP_TRACKNUMBER", nullptr);
+	if (number < 1 || number > (int)tracks.size()) {
+		return nullptr;
+	}
+	Entry& entry = tracks[number - 1];
+	return entry.track == track ? &entry : nullptr;
+}
+
+vector<Entry>& getTracks() {
+	if (!isValid) {
+		compact();
+	}
+	return tracks;
+}
+
+void onTrackListChange() {
+	// This can happen many times while a project loads, so don't compact until
+	// the table is next used.
+	isValid = false;
+}
+
+}
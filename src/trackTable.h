@@ -0,0 +1,49 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Track table header
+ * Copyright 2026 OSARA contributors
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "osara.h"
+#include "envelopeIndex.h"
+#include "fxTree.h"
+#include "itemIndex.h"
+
+// A table of per-track data cached by OSARA, stored densely in track order so
+// that looking up a track is an array access rather than a map lookup.
+// The table is compacted lazily after the track list changes, at which point
+// entries for deleted tracks are dropped and entries for remaining tracks are
+// kept.
+namespace trackTable {
+
+struct Entry {
+	MediaTrack* track = nullptr;
+	// Track states as last reported to the control surface. See
+	// controlSurface.cpp.
+	uint8_t surfaceStates = 0;
+	// A bit mask of trackStates::State values.
+	uint8_t states = 0;
+	// Built on demand by itemIndex.
+	std::unique_ptr<itemIndex::TrackItems> items;
+	// Built on demand by fxTree.
+	std::unique_ptr<fxTree::Tree> fx;
+	// Built on demand by envelopeIndex.
+	std::unique_ptr<envelopeIndex::Envelopes> envelopes;
+};
+
+// Returns the entry for a track, or nullptr if the track isn't in the table;
+// e.g. because it belongs to another project.
+Entry* get(MediaTrack* track);
+// Returns the entries for all tracks except the master track, in track order.
+// The entry for track number n (1 based) is at index n - 1.
+std::vector<Entry>& getTracks();
+// Called when tracks are added, removed or reordered.
+void onTrackListChange();
+
+}
@@ -5,9 +5,20 @@
  * License: GNU General Public License version 2.0
  */
 
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <fstream>
+#include <sstream>
 #include <map>
+#include <unordered_map>
+#include <utility>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include <tinygettext/dictionary.hpp>
 #include <tinygettext/po_parser.hpp>
 #include "osara.h"
@@ -32,7 +43,354 @@ map<string, string> REAPER_LANG_TO_CODE = {
 
 tinygettext::Dictionary translationDict;
 
+// A binary catalog compiled from a po file by site_scons/makeCatalog.py. See
+// there for a description of the format. The catalog is memory mapped and
+// stays mapped until OSARA is unloaded, so strings in it can be returned
+// directly. All of our platforms are little endian, so we read integers
+// directly.
+struct CatalogHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t sourceSize;
+	uint32_t pluralFormsOffset;
+	uint32_t entryCount;
+	uint32_t bucketCount;
+	uint32_t bucketsOffset;
+	uint32_t entriesOffset;
+	uint32_t poolOffset;
+	uint32_t poolSize;
+};
+
+struct CatalogEntry {
+	uint32_t hash;
+	uint32_t keyOffset;
+	uint32_t formCount;
+	uint32_t formsOffset;
+};
+
+const uint32_t CATALOG_VERSION = 2;
+const uint32_t CATALOG_NO_OFFSET = 0xFFFFFFFF;
+const char CATALOG_CONTEXT_SEPARATOR = '\x04';
+
+const CatalogHeader* catalog = nullptr;
+const uint32_t* catalogBuckets = nullptr;
+const CatalogEntry* catalogEntries = nullptr;
+const char* catalogPool = nullptr;
+tinygettext::PluralForms catalogPluralForms;
+
+uint32_t fnv1a(const char* data, size_t size, uint32_t hash = 0x811C9DC5) {
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= (unsigned char)data[i];
+		hash *= 0x01000193;
+	}
+	return hash;
+}
+
+// Get the size and modification time of a file. The time is only useful for
+// comparison with that of another file. Returns false on failure.
+bool getFileInfo(const string& path, uint64_t& size, uint64_t& modified) {
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExW(widen(path).c_str(), GetFileExInfoStandard,
+			&data)) {
+		return false;
+	}
+	size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	modified = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) |
+		data.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) {
+		return false;
+	}
+	size = st.st_size;
+	modified = st.st_mtime;
+#endif
+	return true;
+}
+
+// Map a file into memory. Returns nullptr on failure.
+const char* mapFile(const string& path, size_t& size) {
+#ifdef _WIN32
+	HANDLE file = CreateFileW(widen(path).c_str(), GENERIC_READ,
+		FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return nullptr;
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(file);
+		return nullptr;
+	}
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0,
+		nullptr);
+	CloseHandle(file);
+	if (!mapping) {
+		return nullptr;
+	}
+	void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	// The view keeps the mapping alive.
+	CloseHandle(mapping);
+	size = (size_t)fileSize.QuadPart;
+	return (const char*)data;
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd == -1) {
+		return nullptr;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return nullptr;
+	}
+	void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return nullptr;
+	}
+	size = st.st_size;
+	return (const char*)data;
+#endif
+}
+
+void unmapFile(const char* data, size_t size) {
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+#else
+	munmap((void*)data, size);
+#endif
+}
+
+// Check that a mapped catalog is well formed so that lookups don't need to do
+// any bounds checking.
+bool validateCatalog(const char* data, size_t size) {
+	if (size < sizeof(CatalogHeader)) {
+		return false;
+	}
+	auto header = (const CatalogHeader*)data;
+	if (memcmp(header->magic, "OSCT", 4) != 0 ||
+			header->version != CATALOG_VERSION) {
+		return false;
+	}
+	const uint32_t bucketCount = header->bucketCount;
+	if (bucketCount == 0 || (bucketCount & (bucketCount - 1)) != 0) {
+		return false;
+	}
+	auto fits = [size](uint64_t offset, uint64_t length) {
+		return offset + length <= size;
+	};
+	if (!fits(header->bucketsOffset, (uint64_t)bucketCount * sizeof(uint32_t)) ||
+			!fits(header->entriesOffset,
+				(uint64_t)header->entryCount * sizeof(CatalogEntry)) ||
+			!fits(header->poolOffset, header->poolSize) ||
+			header->bucketsOffset % 4 != 0 || header->entriesOffset % 4 != 0) {
+		return false;
+	}
+	const uint32_t poolSize = header->poolSize;
+	const char* pool = data + header->poolOffset;
+	// With the pool null terminated, any offset within it is a valid string.
+	if (poolSize == 0 || pool[poolSize - 1] != '\0') {
+		return false;
+	}
+	if (header->pluralFormsOffset != CATALOG_NO_OFFSET &&
+			header->pluralFormsOffset >= poolSize) {
+		return false;
+	}
+	auto buckets = (const uint32_t*)(data + header->bucketsOffset);
+	for (uint32_t b = 0; b < bucketCount; ++b) {
+		if (buckets[b] > header->entryCount) {
+			return false;
+		}
+	}
+	auto entries = (const CatalogEntry*)(data + header->entriesOffset);
+	for (uint32_t e = 0; e < header->entryCount; ++e) {
+		const CatalogEntry& entry = entries[e];
+		if (entry.keyOffset >= poolSize || entry.formCount == 0) {
+			return false;
+		}
+		uint32_t offset = entry.formsOffset;
+		for (uint32_t f = 0; f < entry.formCount; ++f) {
+			if (offset >= poolSize) {
+				return false;
+			}
+			offset += (uint32_t)strlen(pool + offset) + 1;
+		}
+	}
+	return true;
+}
+
+// Load a catalog if it exists and isn't older than the po file, if any. Reading
+// and hashing the po file would cost nearly as much as parsing it, so we only
+// compare its size and modification time.
+bool loadCatalog(const string& path, const string& poPath) {
+	uint64_t catSize, catModified, poSize, poModified;
+	if (!getFileInfo(path, catSize, catModified)) {
+		return false;
+	}
+	const bool havePo = getFileInfo(poPath, poSize, poModified);
+	if (havePo && poModified > catModified) {
+		// The po file has been changed since the catalog was compiled.
+		return false;
+	}
+	size_t size = 0;
+	const char* data = mapFile(path, size);
+	if (!data) {
+		return false;
+	}
+	auto header = (const CatalogHeader*)data;
+	if (!validateCatalog(data, size) ||
+			(havePo && header->sourceSize != poSize)) {
+		// Corrupt or stale.
+		unmapFile(data, size);
+		return false;
+	}
+	catalog = header;
+	catalogBuckets = (const uint32_t*)(data + header->bucketsOffset);
+	catalogEntries = (const CatalogEntry*)(data + header->entriesOffset);
+	catalogPool = data + header->poolOffset;
+	if (header->pluralFormsOffset != CATALOG_NO_OFFSET) {
+		catalogPluralForms = tinygettext::PluralForms::from_string(
+			catalogPool + header->pluralFormsOffset);
+	}
+	return true;
+}
+
+const CatalogEntry* findCatalogEntry(const char* context, const char* msg) {
+	const size_t msgLen = strlen(msg);
+	uint32_t hash;
+	size_t contextLen = 0;
+	if (context) {
+		contextLen = strlen(context);
+		hash = fnv1a(context, contextLen);
+		hash = fnv1a(&CATALOG_CONTEXT_SEPARATOR, 1, hash);
+		hash = fnv1a(msg, msgLen, hash);
+	} else {
+		hash = fnv1a(msg, msgLen);
+	}
+	const uint32_t mask = catalog->bucketCount - 1;
+	for (uint32_t b = hash & mask; catalogBuckets[b]; b = (b + 1) & mask) {
+		const CatalogEntry& entry = catalogEntries[catalogBuckets[b] - 1];
+		if (entry.hash != hash) {
+			continue;
+		}
+		const char* key = catalogPool + entry.keyOffset;
+		if (context) {
+			if (strncmp(key, context, contextLen) != 0 ||
+					key[contextLen] != CATALOG_CONTEXT_SEPARATOR) {
+				continue;
+			}
+			key += contextLen + 1;
+		}
+		if (strcmp(key, msg) == 0) {
+			return &entry;
+		}
+	}
+	return nullptr;
+}
+
+const char* getCatalogForm(const CatalogEntry& entry, uint32_t form) {
+	const char* str = catalogPool + entry.formsOffset;
+	for (uint32_t f = 0; f < form; ++f) {
+		str += strlen(str) + 1;
+	}
+	return str;
+}
+
+unsigned int getPluralIndex(int num) {
+	const auto pluralForms = catalog ? catalogPluralForms :
+		translationDict.get_plural_forms();
+	return pluralForms ? pluralForms.get_plural(num) : 0;
+}
+
+// Look up a translation without caching. msgPlural is null if this isn't a
+// plural message.
+string lookupTranslation(const char* context, const char* msg,
+	const char* msgPlural = nullptr, int num = 1
+) {
+	if (catalog) {
+		const CatalogEntry* entry = findCatalogEntry(context, msg);
+		if (!entry) {
+			return msgPlural && num != 1 ? msgPlural : msg;
+		}
+		uint32_t form = msgPlural ? getPluralIndex(num) : 0;
+		if (form >= entry->formCount) {
+			form = 0;
+		}
+		return getCatalogForm(*entry, form);
+	}
+	if (msgPlural) {
+		return translationDict.translate_plural(msg, msgPlural, num);
+	}
+	if (context) {
+		return translationDict.translate_ctxt(context, msg);
+	}
+	return translationDict.translate(msg);
+}
+
+struct PairHash {
+	size_t operator()(const pair<const void*, const void*>& key) const {
+		return hash<const void*>()(key.first) * 31 + hash<const void*>()(key.second);
+	}
+};
+
+// Interned translations, keyed by message address. The values are copied so
+// that returned pointers remain valid regardless of how the dictionary stores
+// its strings. unordered_map never moves its values, so the pointers stay
+// valid as more translations are cached.
+unordered_map<const char*, string> translationCache;
+unordered_map<pair<const void*, const void*>, string, PairHash>
+	contextTranslationCache;
+// Keyed by message address and the plural form, which is the plural index for
+// the locale plus whether num is 1. The latter is needed because untranslated
+// messages fall back to English plural rules.
+unordered_map<pair<const void*, const void*>, string, PairHash>
+	pluralTranslationCache;
+
+const char* translate(const char* msg) {
+	auto it = translationCache.find(msg);
+	if (it == translationCache.end()) {
+		it = translationCache.emplace(msg, lookupTranslation(nullptr, msg)).first;
+	}
+	return it->second.c_str();
+}
+
+const char* translate_ctxt(const char* context, const char* msg) {
+	const pair<const void*, const void*> key(context, msg);
+	auto it = contextTranslationCache.find(key);
+	if (it == contextTranslationCache.end()) {
+		it = contextTranslationCache.emplace(key,
+			lookupTranslation(context, msg)).first;
+	}
+	return it->second.c_str();
+}
+
+const char* translate_plural(const char* msg, const char* msgPlural, int num) {
+	const size_t form = getPluralIndex(num) * 2 + (num == 1);
+	const pair<const void*, const void*> key(msg, (const void*)form);
+	auto it = pluralTranslationCache.find(key);
+	if (it == pluralTranslationCache.end()) {
+		it = pluralTranslationCache.emplace(key,
+			lookupTranslation(nullptr, msg, msgPlural, num)).first;
+	}
+	return it->second.c_str();
+}
+
+string translate(const string& msg) {
+	return lookupTranslation(nullptr, msg.c_str());
+}
+
+string translate_ctxt(const string& context, const string& msg) {
+	return lookupTranslation(context.c_str(), msg.c_str());
+}
+
+string translate_plural(const string& msg, const string& msgPlural, int num) {
+	return lookupTranslation(nullptr, msg.c_str(), msgPlural.c_str(), num);
+}
+
 void initTranslation() {
+	translationCache.clear();
+	contextTranslationCache.clear();
+	pluralTranslationCache.clear();
 	// Figure out which file name to load. We base it on the REAPER language
 	// pack.
 	char langpack[200];
@@ -55,22 +413,29 @@ void initTranslation() {
 	if (nameIt != REAPER_LANG_TO_CODE.end()) {
 		name = nameIt->second;
 	}
-	name += ".po";
 	// OSARA translations are stored in osara/locale in the REAPER resource
 	// directory.
 	string path(GetResourcePath());
 	path += "/osara/locale/";
 	path += name;
+	const string poPath = path + ".po";
+	if (loadCatalog(path + ".cat", poPath)) {
+		return;
+	}
+	// There's no usable catalog, so fall back to parsing the po file.
 #ifdef _WIN32
 	// REAPER provides UTF-8 strings. However, on Windows, ifstream will
 	// interpret a narrow (8 bit) string as an ANSI string. The easiest way to
 	// deal with this is to convert the string to UTF-16, which Windows will
 	// interpret correctly.
-	ifstream input(widen(path));
+	ifstream input(widen(poPath), ios::binary);
 #else
-	ifstream input(path);
+	ifstream input(poPath, ios::binary);
 #endif
-	tinygettext::POParser::parse(path, input, translationDict);
+	if (!input.is_open()) {
+		return;
+	}
+	tinygettext::POParser::parse(poPath, input, translationDict);
 }
 
 BOOL CALLBACK translateWindow(HWND hwnd, LPARAM lParam) {
@@ -80,7 +445,8 @@ BOOL CALLBACK translateWindow(HWND hwnd, LPARAM lParam) {
 	if (!text[0]) {
 		return true;
 	}
-	string translated = translate_ctxt(context, text);
+	// text is a temporary buffer, so we can't use the translation cache.
+	string translated = translate_ctxt(string(context), string(text));
 	if (translated == text) {
 		// No translation.
 		return true;
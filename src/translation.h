@@ -17,18 +17,20 @@ extern tinygettext::Dictionary translationDict;
 void initTranslation();
 void translateDialog(HWND dialog);
 
-template<typename S>
-auto translate(S msg) {
-	return translationDict.translate(msg);
-}
-template<typename S>
-auto translate_ctxt(S context, S msg) {
-	return translationDict.translate_ctxt(context, msg);
-}
-template<typename S, typename N>
-auto translate_plural(S msg, S msgPlural, N num) {
-	return translationDict.translate_plural(msg, msgPlural, num);
-}
+// Translations are cached, keyed by the address of the message. This avoids a
+// lookup every time a message is reported. This is safe because messages
+// passed as const char* are always string literals or strings in static
+// tables. Never pass a temporary buffer to these overloads; pass a
+// std::string instead.
+const char* translate(const char* msg);
+const char* translate_ctxt(const char* context, const char* msg);
+const char* translate_plural(const char* msg, const char* msgPlural, int num);
+
+// std::strings can't be cached by address.
+std::string translate(const std::string& msg);
+std::string translate_ctxt(const std::string& context, const std::string& msg);
+std::string translate_plural(const std::string& msg,
+	const std::string& msgPlural, int num);
 
 // This function is used to mark a string as translatable without actually
 // translating it. This is useful for strings in compile time data structures.
@@ -9,6 +9,7 @@
 #include <ole2.h>
 #include <tlhelp32.h>
 #include <atlcomcli.h>
+#include <atomic>
 #include <memory>
 #include <utility>
 #include "osara.h"
@@ -161,31 +162,106 @@ WNDCLASSEX getWindowClass() {
 
 WNDCLASSEX windowClass;
 
-bool initializeUia() {
-	uiaCore = make_unique<UiaCore>();
-	// If UiaRaiseNotificationEvent is available, UiaDisconnectProvider and
-	// UiaDisconnectAllProviders will also be available, so we don't need to
-	// check those.
-	if (!uiaCore->RaiseNotificationEvent) {
-		uiaCore = nullptr;
-		return false;
+// Raising a UIA event can block for a while if a client is slow to respond.
+// To avoid stalling REAPER's UI, our UIA window and provider are owned by a
+// dedicated thread. The main thread passes requests to that thread via a
+// lock-free single producer, single consumer queue.
+enum UiaRequestType {
+	UIA_REQUEST_NOTIFY,
+	UIA_REQUEST_RESET,
+};
+
+struct UiaRequest {
+	UiaRequestType type;
+	wstring message;
+	bool interrupt;
+};
+
+class UiaRequestQueue {
+	public:
+	// Called on the main thread only.
+	bool push(UiaRequestType type, wstring_view message = {},
+		bool interrupt = true
+	) {
+		const size_t tail = this->tail.load(memory_order_relaxed);
+		const size_t next = (tail + 1) % SIZE;
+		if (next == this->head.load(memory_order_acquire)) {
+			return false; // Full.
+		}
+		UiaRequest& request = this->requests[tail];
+		request.type = type;
+		// Each slot keeps its buffer, so this usually doesn't allocate.
+		request.message.assign(message);
+		request.interrupt = interrupt;
+		this->tail.store(next, memory_order_release);
+		return true;
 	}
-	windowClass = getWindowClass();
-	if (!RegisterClassEx(&windowClass)) {
-		return false;
+
+	// Called on the UIA thread only.
+	bool pop(UiaRequest& request) {
+		const size_t head = this->head.load(memory_order_relaxed);
+		if (head == this->tail.load(memory_order_acquire)) {
+			return false; // Empty.
+		}
+		UiaRequest& slot = this->requests[head];
+		request.type = slot.type;
+		request.interrupt = slot.interrupt;
+		// Swap rather than move so that both buffers are kept for reuse.
+		swap(request.message, slot.message);
+		this->head.store((head + 1) % SIZE, memory_order_release);
+		return true;
 	}
+
+	private:
+	static constexpr size_t SIZE = 64;
+	UiaRequest requests[SIZE];
+	atomic<size_t> head = 0;
+	atomic<size_t> tail = 0;
+};
+
+UiaRequestQueue uiaQueue;
+HANDLE uiaThread = nullptr;
+// Signalled by the main thread when there are requests in uiaQueue.
+HANDLE uiaWakeEvent = nullptr;
+// Signalled by the main thread when the UIA thread should exit. This is
+// separate from the queue so that terminating never waits for queue space.
+HANDLE uiaTerminateEvent = nullptr;
+// Signalled by the UIA thread once it has finished initialising.
+HANDLE uiaReadyEvent = nullptr;
+// Whether the UIA thread is running with a window. This is only accessed by
+// the main thread.
+bool isUiaAvailable = false;
+// Set by the UIA thread when raising a notification fails, so that the main
+// thread can fall back to MSAA.
+atomic<bool> uiaRaiseFailed = false;
+
+// How long to wait for the UIA thread to start or exit.
+const DWORD UIA_THREAD_TIMEOUT = 5000;
+
+enum UiaInitState {
+	UIA_INIT_PENDING,
+	UIA_INIT_DONE,
+	// The main thread gave up waiting for initialisation.
+	UIA_INIT_ABANDONED,
+};
+atomic<int> uiaInitState = UIA_INIT_PENDING;
+
+bool createUiaWindow() {
+	// This is an unowned top level window. A child of REAPER's main window would
+	// attach this thread's input queue to the main thread's, which would defeat
+	// the purpose of this thread.
 	uiaWnd = CreateWindowEx(
 		// Make it transparent because it has to have width/height.
-		WS_EX_TRANSPARENT,
+		WS_EX_TRANSPARENT | WS_EX_TOOLWINDOW | WS_EX_NOACTIVATE,
 		WINDOW_CLASS_NAME,
 		"Reaper OSARA Notifications",
-		WS_CHILD | WS_DISABLED,
+		WS_POPUP | WS_DISABLED,
 		0,
 		0,
 		// UIA notifications fail if the window has 0 width/height.
 		1,
 		1,
-		mainHwnd,
+		nullptr,
 		0,
 		pluginHInstance,
 		nullptr
@@ -200,7 +276,7 @@ bool initializeUia() {
 	return true;
 }
 
-bool terminateUia() {
+void destroyUiaWindow() {
 	if (uiaProvider) {
 		// Null out uiaProvider so it can't be returned by WM_GETOBJECT during
 		// disconnection.
@@ -209,20 +285,199 @@ bool terminateUia() {
 		uiaCore->DisconnectProvider(tmpProv);
 	}
 	ShowWindow(uiaWnd, SW_HIDE);
-	if (!DestroyWindow(uiaWnd)) {
+	DestroyWindow(uiaWnd);
+	uiaWnd = nullptr;
+	uiaCore->DisconnectAllProviders();
+}
+
+void raiseUiaNotification(const wstring& message, bool interrupt) {
+	if (!UiaClientsAreListening()) {
+		return;
+	}
+	BSTR displayString = SysAllocString(message.c_str());
+	BSTR activityId = SysAllocString(L"REAPER_OSARA");
+	const HRESULT res = uiaCore->RaiseNotificationEvent(
+		uiaProvider,
+		NotificationKind_Other,
+		interrupt ? NotificationProcessing_MostRecent : NotificationProcessing_All,
+		displayString,
+		activityId
+	);
+	SysFreeString(displayString);
+	SysFreeString(activityId);
+	if (FAILED(res)) {
+		uiaRaiseFailed.store(true, memory_order_relaxed);
+	}
+}
+
+DWORD WINAPI uiaThreadProc(LPVOID param) {
+	CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+	const bool created = createUiaWindow();
+	if (uiaInitState.exchange(UIA_INIT_DONE) == UIA_INIT_ABANDONED) {
+		// The main thread has given up on us.
+		if (created) {
+			destroyUiaWindow();
+		}
+		CoUninitialize();
+		return 0;
+	}
+	// The main thread checks uiaWnd once we signal that we're ready.
+	SetEvent(uiaReadyEvent);
+	if (!created) {
+		CoUninitialize();
+		return 0;
+	}
+	// Reused for every request so its buffer isn't reallocated each time.
+	UiaRequest request;
+	const HANDLE events[] = {uiaTerminateEvent, uiaWakeEvent};
+	for (;;) {
+		DWORD res = MsgWaitForMultipleObjects(2, events, FALSE, INFINITE,
+			QS_ALLINPUT);
+		if (res == WAIT_OBJECT_0) {
+			destroyUiaWindow();
+			CoUninitialize();
+			return 0;
+		} else if (res == WAIT_OBJECT_0 + 1) {
+			while (uiaQueue.pop(request)) {
+				switch (request.type) {
+					case UIA_REQUEST_NOTIFY:
+						raiseUiaNotification(request.message, request.interrupt);
+						break;
+					case UIA_REQUEST_RESET:
+						ShowWindow(uiaWnd, SW_HIDE);
+						ShowWindow(uiaWnd, SW_SHOWNA);
+						break;
+				}
+			}
+		} else {
+			// We must pump messages so that we can respond to WM_GETOBJECT.
+			MSG msg;
+			while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
+				TranslateMessage(&msg);
+				DispatchMessage(&msg);
+			}
+		}
+	}
+}
+
+void closeUiaEvents() {
+	for (HANDLE* event: {&uiaWakeEvent, &uiaTerminateEvent, &uiaReadyEvent}) {
+		if (*event) {
+			CloseHandle(*event);
+			*event = nullptr;
+		}
+	}
+}
+
+// Pin this dll so it stays loaded after REAPER unloads it. We need this when we
+// give up waiting for the UIA thread, since that thread runs code in this dll.
+// Returns false if this fails, in which case the caller must keep waiting.
+bool keepModuleLoaded() {
+	HMODULE module;
+	return GetModuleHandleEx(
+		GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_PIN,
+		(LPCTSTR)&keepModuleLoaded, &module);
+}
+
+// Clean up after initialisation failed. The UIA thread must not be running.
+void failUiaInit() {
+	closeUiaEvents();
+	UnregisterClass(WINDOW_CLASS_NAME, pluginHInstance);
+	uiaCore = nullptr;
+}
+
+bool initializeUia() {
+	uiaCore = make_unique<UiaCore>();
+	// If UiaRaiseNotificationEvent is available, UiaDisconnectProvider and
+	// UiaDisconnectAllProviders will also be available, so we don't need to
+	// check those.
+	if (!uiaCore->RaiseNotificationEvent) {
+		uiaCore = nullptr;
+		return false;
+	}
+	windowClass = getWindowClass();
+	if (!RegisterClassEx(&windowClass)) {
+		uiaCore = nullptr;
+		return false;
+	}
+	uiaWakeEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	uiaTerminateEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	uiaReadyEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	if (!uiaWakeEvent || !uiaTerminateEvent || !uiaReadyEvent) {
+		failUiaInit();
+		return false;
+	}
+	uiaThread = CreateThread(nullptr, 0, uiaThreadProc, nullptr, 0, nullptr);
+	if (!uiaThread) {
+		failUiaInit();
+		return false;
+	}
+	// This only waits for the window to be created, which doesn't involve any
+	// UIA client. Still, don't hang REAPER's startup if something goes wrong.
+	if (WaitForSingleObject(uiaReadyEvent, UIA_THREAD_TIMEOUT) != WAIT_OBJECT_0) {
+		if (keepModuleLoaded() &&
+				uiaInitState.exchange(UIA_INIT_ABANDONED) == UIA_INIT_PENDING) {
+			// The thread will exit by itself once it finishes initialising. It won't
+			// touch the events, but it still uses the window class and uiaCore, so
+			// leave those alone. It might still be running when we're unloaded, so
+			// we've pinned this dll.
+			closeUiaEvents();
+			CloseHandle(uiaThread);
+			uiaThread = nullptr;
+			return false;
+		}
+		// Either the thread finished just as we gave up, so it's about to signal,
+		// or we couldn't pin this dll, so we can't leave the thread running.
+		WaitForSingleObject(uiaReadyEvent, INFINITE);
+	}
+	CloseHandle(uiaReadyEvent);
+	uiaReadyEvent = nullptr;
+	if (!uiaWnd) {
+		// The thread has exited or is about to.
+		WaitForSingleObject(uiaThread, UIA_THREAD_TIMEOUT);
+		CloseHandle(uiaThread);
+		uiaThread = nullptr;
+		failUiaInit();
+		return false;
+	}
+	isUiaAvailable = true;
+	return true;
+}
+
+bool terminateUia() {
+	if (!uiaThread) {
+		return false;
+	}
+	isUiaAvailable = false;
+	// The window must be destroyed by the thread which created it. We must wait
+	// for that here because this dll is about to be unloaded.
+	SetEvent(uiaTerminateEvent);
+	bool exited = WaitForSingleObject(uiaThread, UIA_THREAD_TIMEOUT) ==
+		WAIT_OBJECT_0;
+	if (!exited && !keepModuleLoaded()) {
+		// The thread would crash if this dll were unloaded while it is running, so
+		// we have no choice but to keep waiting.
+		exited = WaitForSingleObject(uiaThread, INFINITE) == WAIT_OBJECT_0;
+	}
+	CloseHandle(uiaThread);
+	uiaThread = nullptr;
+	if (!exited) {
+		// The thread is stuck in a UIA client. It still needs its events, window
+		// class and uiaCore, so we can't clean those up. We've pinned this dll so
+		// that the thread can finish safely.
 		return false;
 	}
+	closeUiaEvents();
 	if (!UnregisterClass(WINDOW_CLASS_NAME, pluginHInstance)) {
 		return false;
 	}
-	uiaCore->DisconnectAllProviders();
 	uiaCore = nullptr;
 	return true;
 }
 
 bool shouldUseUiaNotifications() {
 	static const bool cachedResult = []() -> bool {
-		if (!uiaWnd) {
+		if (!isUiaAvailable) {
 			// Not available (requires Windows 10 fall creators update or above).
 			return false;
 		}
@@ -246,20 +501,33 @@ bool shouldUseUiaNotifications() {
 	return cachedResult;
 }
 
-bool sendUiaNotification(const string& message, bool interrupt) {
+bool sendUiaNotification(string_view message, bool interrupt) {
+	if (!isUiaAvailable) {
+		return false;
+	}
+	// If no client is listening, there's nothing to speak the message, so don't
+	// fall back to MSAA either.
 	if (!UiaClientsAreListening() || message.empty()) {
 		return true;
 	}
-	return (uiaCore->RaiseNotificationEvent(
-		uiaProvider,
-		NotificationKind_Other,
-		interrupt ? NotificationProcessing_MostRecent : NotificationProcessing_All,
-		SysAllocString(widen(message).c_str()),
-		SysAllocString(L"REAPER_OSARA")
-	) == S_OK);
+	// The event is raised asynchronously on the UIA thread, so we can't know
+	// whether this one succeeds. If raising a previous notification failed,
+	// fall back to MSAA until UIA is reset. We also fail if the queue is full,
+	// which means the UIA thread is stuck.
+	if (uiaRaiseFailed.load(memory_order_relaxed) ||
+			!uiaQueue.push(UIA_REQUEST_NOTIFY, widenToBuffer(message), interrupt)) {
+		return false;
+	}
+	SetEvent(uiaWakeEvent);
+	return true;
 }
 
 void resetUia() {
-	ShowWindow(uiaWnd, SW_HIDE);
-	ShowWindow(uiaWnd, SW_SHOWNA);
+	if (!isUiaAvailable) {
+		return;
+	}
+	uiaRaiseFailed.store(false, memory_order_relaxed);
+	if (uiaQueue.push(UIA_REQUEST_RESET)) {
+		SetEvent(uiaWakeEvent);
+	}
 }